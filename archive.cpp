@@ -0,0 +1,385 @@
+﻿#include "archive.h"
+#include "jointrecords.h"
+#include "threadpool.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+using namespace BVH;
+
+//!
+//! Layout of a .bvha file , all values in the byte order of the host which wrote it. The header
+//! holds ByteOrderMark , a file of the other byte order is rejected by open():
+//!
+//!     ArchiveHeader
+//!     BinaryJoint[jointCount]     every joint including End Sites in pre-order
+//!     char[namesSize]             the joint names , not null terminated
+//!     blocks                      at the offsets of the index
+//!     uint64_t[blockCount + 1]    the index , the offset of every block and the end of the last one
+//!
+//! A block of n frames holds for every channel:
+//!
+//!     int32_t[channelCount]       the code of the first frame
+//!     uint8_t[channelCount]       the bits of one difference
+//!     the n - 1 zig-zag coded differences of every channel , each channel starts on a new byte
+//!     8 zero bytes , so the decoder may always load 64 bits
+//!
+//! Lossless codes are the float bits with the other bits flipped for negative values , so that
+//! they sort like the values , lossy codes are the values divided by the precision and rounded.
+//!
+
+static const char ArchiveMagic[4] = { 'B' , 'V' , 'H' , 'A' };
+static const uint32_t ArchiveVersion = 1;
+static const uint32_t ByteOrderMark = 0x01020304;
+static const size_t BlockPadding = 8;
+
+struct ArchiveHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t jointCount;
+    uint32_t channelCount;
+    float frameInterval;
+    uint64_t frameCount;
+    uint32_t blockFrames;
+    uint32_t reserved;
+    float precision;
+    uint32_t reserved2;
+    uint64_t namesOffset;
+    uint64_t namesSize;
+    uint64_t indexOffset;
+};
+
+static_assert(sizeof(ArchiveHeader) == 72 , "unexpected padding in ArchiveHeader");
+
+static inline uint32_t orderedBits(uint32_t bits)
+{
+    return bits ^ ((0u - (bits >> 31)) & 0x7fffffffu);
+}
+
+static inline uint32_t floatCode(float value , double scale)
+{
+    if (scale == 0.0)
+    {
+        uint32_t bits;
+        std::memcpy(&bits , &value , sizeof(bits));
+        return orderedBits(bits);
+    }
+    const double code = std::floor(static_cast<double>(value) * scale + 0.5);
+    return static_cast<uint32_t>(static_cast<int32_t>(std::min(2147483647.0 , std::max(-2147483648.0 , code))));
+}
+
+static inline float codeValue(uint32_t code , double precision)
+{
+    if (precision == 0.0)
+    {
+        const uint32_t bits = orderedBits(code);
+        float value;
+        std::memcpy(&value , &bits , sizeof(value));
+        return value;
+    }
+    return static_cast<float>(static_cast<int32_t>(code) * precision);
+}
+
+static inline uint32_t zigZag(uint32_t difference)
+{
+    return (difference << 1) ^ (0u - (difference >> 31));
+}
+
+static inline uint32_t unZigZag(uint32_t value)
+{
+    return (value >> 1) ^ (0u - (value & 1));
+}
+
+static uint32_t bitWidth(uint32_t value)
+{
+    uint32_t width = 0;
+    while (value)
+    {
+        ++width;
+        value >>= 1;
+    }
+    return width;
+}
+
+//!
+//! \brief readDifference The difference which starts \a position bits into \a stream.
+//! \remarks Loads 64 bits , the padding of the block keeps the load inside of it.
+//!
+static inline uint32_t readDifference(const uint8_t* stream , size_t position , uint64_t mask)
+{
+    uint64_t bits;
+    std::memcpy(&bits , stream + (position >> 3) , sizeof(bits));
+    return unZigZag(static_cast<uint32_t>((bits >> (position & 7)) & mask));
+}
+
+static size_t streamSize(size_t count , uint32_t width)
+{
+    return (count * width + 7) / 8;
+}
+
+//!
+//! \brief encodeBlock Append the frames [first , last) of \a rows to \a out.
+//!
+static void encodeBlock(const float* rows , size_t stride , size_t first , size_t last , double scale ,
+                        std::vector<uint8_t>& out)
+{
+    const size_t count = last - first;
+    std::vector<uint32_t> differences(count);
+    std::vector<uint8_t> streams;
+    out.resize(stride * (sizeof(int32_t) + 1));
+    for (size_t c = 0; c < stride; ++c)
+    {
+        const float* column = rows + first * stride + c;
+        uint32_t previous = floatCode(column[0] , scale);
+        std::memcpy(out.data() + c * sizeof(int32_t) , &previous , sizeof(previous));
+
+        uint32_t maximum = 0;
+        for (size_t i = 1; i < count; ++i)
+        {
+            const uint32_t code = floatCode(column[i * stride] , scale);
+            differences[i] = zigZag(code - previous);
+            maximum |= differences[i];
+            previous = code;
+        }
+        const uint32_t width = bitWidth(maximum);
+        out[stride * sizeof(int32_t) + c] = static_cast<uint8_t>(width);
+
+        uint64_t bits = 0;
+        uint32_t bitCount = 0;
+        for (size_t i = 1; i < count; ++i)
+        {
+            bits |= static_cast<uint64_t>(differences[i]) << bitCount;
+            bitCount += width;
+            while (bitCount >= 8)
+            {
+                streams.push_back(static_cast<uint8_t>(bits));
+                bits >>= 8;
+                bitCount -= 8;
+            }
+        }
+        if (bitCount)
+            streams.push_back(static_cast<uint8_t>(bits));
+    }
+    out.insert(out.end() , streams.begin() , streams.end());
+    out.insert(out.end() , BlockPadding , 0);
+}
+
+bool MotionArchive::write(const BvhDocument &document , const std::string &filename , const ArchiveOptions &options)
+{
+    if (document.isEmpty() || options.blockFrames == 0 || !(options.precision >= 0.0f))
+        return false;
+
+    std::shared_ptr<MotionStore> motion = document.currentMotion();
+
+    std::vector<BinaryJoint> records;
+    std::string names;
+    toJointRecords(*document.skeleton() , records , names);
+
+    const size_t frameCount = motion->frameCount();
+    const size_t stride = motion->channelCount();
+    const size_t blockCount = (frameCount + options.blockFrames - 1) / options.blockFrames;
+    const double scale = options.precision > 0.0f ? 1.0 / options.precision : 0.0;
+    const float* rows = motion->data();
+    std::vector<std::vector<uint8_t>> blocks(blockCount);
+    ThreadPool::globalInstance().parallelFor(blockCount , [&](size_t block) {
+        const size_t first = block * options.blockFrames;
+        encodeBlock(rows , stride , first , std::min(frameCount , first + options.blockFrames) , scale , blocks[block]);
+    } , options.threadCount);
+
+    ArchiveHeader header;
+    std::memset(&header , 0 , sizeof(header));
+    std::memcpy(header.magic , ArchiveMagic , sizeof(ArchiveMagic));
+    header.version = ArchiveVersion;
+    header.byteOrder = ByteOrderMark;
+    header.jointCount = static_cast<uint32_t>(records.size());
+    header.channelCount = static_cast<uint32_t>(stride);
+    header.frameInterval = document.frameInterval();
+    header.frameCount = frameCount;
+    header.blockFrames = options.blockFrames;
+    header.precision = options.precision;
+    header.namesOffset = sizeof(ArchiveHeader) + records.size() * sizeof(BinaryJoint);
+    header.namesSize = names.size();
+
+    std::vector<uint64_t> index(1 , header.namesOffset + header.namesSize);
+    for (const std::vector<uint8_t>& block : blocks)
+        index.push_back(index.back() + block.size());
+    header.indexOffset = index.back();
+
+    std::FILE* file = std::fopen(filename.c_str() , "wb");
+    if (!file)
+        return false;
+
+    bool ok = std::fwrite(&header , sizeof(header) , 1 , file) == 1;
+    ok = ok && std::fwrite(records.data() , sizeof(BinaryJoint) , records.size() , file) == records.size();
+    ok = ok && (names.empty() || std::fwrite(names.data() , 1 , names.size() , file) == names.size());
+    for (const std::vector<uint8_t>& block : blocks)
+        ok = ok && std::fwrite(block.data() , 1 , block.size() , file) == block.size();
+    ok = ok && std::fwrite(index.data() , sizeof(uint64_t) , index.size() , file) == index.size();
+
+    if (std::fclose(file) != 0)
+        ok = false;
+    return ok;
+}
+
+MotionArchive::MotionArchive()
+{
+
+}
+
+bool MotionArchive::open(const std::string &filename)
+{
+    close();
+
+    std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+    if (!file->open(filename , MappedFile::RandomAccess))
+        return false;
+
+    ArchiveHeader header;
+    if (file->size() < sizeof(header))
+        return false;
+    std::memcpy(&header , file->data() , sizeof(header));
+
+    if (std::memcmp(header.magic , ArchiveMagic , sizeof(ArchiveMagic)) != 0 ||
+        header.version != ArchiveVersion || header.byteOrder != ByteOrderMark || header.jointCount == 0 ||
+        header.blockFrames == 0 || !(header.precision >= 0.0f))
+        return false;
+
+    const uint64_t recordsEnd = sizeof(ArchiveHeader) + uint64_t(header.jointCount) * sizeof(BinaryJoint);
+    const uint64_t blockCount = header.frameCount / header.blockFrames + (header.frameCount % header.blockFrames != 0);
+    if (header.namesOffset != recordsEnd || header.indexOffset < header.namesOffset ||
+        header.indexOffset > file->size() || header.namesSize > header.indexOffset - header.namesOffset ||
+        blockCount >= (file->size() - header.indexOffset) / sizeof(uint64_t))
+        return false;
+
+    std::vector<uint64_t> index(static_cast<size_t>(blockCount + 1));
+    std::memcpy(index.data() , file->data() + header.indexOffset , index.size() * sizeof(uint64_t));
+    const uint64_t minimumBlock = uint64_t(header.channelCount) * (sizeof(int32_t) + 1) + BlockPadding;
+    if (index.front() != header.namesOffset + header.namesSize || index.back() != header.indexOffset)
+        return false;
+    for (size_t b = 0; b + 1 < index.size(); ++b)
+    {
+        if (index[b + 1] < index[b] || index[b + 1] - index[b] < minimumBlock)
+            return false;
+    }
+
+    Joint* root = fromJointRecords(file->data() + sizeof(ArchiveHeader) , header.jointCount ,
+                                   file->data() + header.namesOffset , header.namesSize);
+    if (!root)
+        return false;
+
+    Skeleton skeleton(root);
+    delete root;
+    if (skeleton.channelCount() != header.channelCount)
+        return false;
+
+    m_file = file;
+    m_skeleton = skeleton;
+    m_frameInterval = header.frameInterval;
+    m_precision = header.precision;
+    m_frameCount = static_cast<size_t>(header.frameCount);
+    m_channelCount = header.channelCount;
+    m_blockFrames = header.blockFrames;
+    m_blockOffsets.swap(index);
+    return true;
+}
+
+void MotionArchive::close()
+{
+    m_file.reset();
+    m_skeleton = Skeleton();
+    m_frameInterval = 0.0f;
+    m_precision = 0.0f;
+    m_frameCount = 0;
+    m_channelCount = 0;
+    m_blockFrames = 0;
+    m_blockOffsets.clear();
+}
+
+bool MotionArchive::decodeBlock(size_t block , size_t first , size_t last , float *rows , size_t rowStride) const
+{
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(m_file->data()) + m_blockOffsets[block];
+    const size_t size = static_cast<size_t>(m_blockOffsets[block + 1] - m_blockOffsets[block]);
+    const size_t blockFirst = block * m_blockFrames;
+    const size_t count = std::min(m_frameCount , blockFirst + m_blockFrames) - blockFirst;
+
+    //! The frames of the block which are written , relative to its first frame
+    const size_t begin = std::max(first , blockFirst) - blockFirst;
+    const size_t end = std::min(last , blockFirst + count) - blockFirst;
+    float* out = rows + (blockFirst + begin - first) * rowStride;
+
+    const uint8_t* widths = data + m_channelCount * sizeof(int32_t);
+    const uint8_t* stream = widths + m_channelCount;
+    size_t streamsSize = 0;
+    for (size_t c = 0; c < m_channelCount; ++c)
+    {
+        if (widths[c] > 32)
+            return false;
+        streamsSize += streamSize(count - 1 , widths[c]);
+    }
+    if (stream + streamsSize + BlockPadding > data + size)
+        return false;
+
+    const double precision = m_precision;
+    for (size_t c = 0; c < m_channelCount; ++c)
+    {
+        uint32_t code;
+        std::memcpy(&code , data + c * sizeof(int32_t) , sizeof(code));
+        const uint32_t width = widths[c];
+        const uint64_t mask = (uint64_t(1) << width) - 1;
+
+        //! Run through the frames before the range , then write one frame per difference
+        size_t position = 0;
+        for (size_t i = 1; i <= begin; ++i , position += width)
+            code += readDifference(stream , position , mask);
+        float* value = out + c;
+        *value = codeValue(code , precision);
+        for (size_t i = begin + 1; i < end; ++i , position += width)
+        {
+            code += readDifference(stream , position , mask);
+            value += rowStride;
+            *value = codeValue(code , precision);
+        }
+        stream += streamSize(count - 1 , width);
+    }
+    return true;
+}
+
+bool MotionArchive::decode(size_t first , size_t last , float *rows , size_t rowStride , unsigned threadCount) const
+{
+    if (!isOpen() || first > last || last > m_frameCount)
+        return false;
+    if (first == last)
+        return true;
+
+    const size_t firstBlock = first / m_blockFrames;
+    const size_t lastBlock = (last - 1) / m_blockFrames + 1;
+    std::atomic<bool> ok(true);
+    ThreadPool::globalInstance().parallelFor(lastBlock - firstBlock , [&](size_t i) {
+        if (!decodeBlock(firstBlock + i , first , last , rows , rowStride))
+            ok.store(false , std::memory_order_relaxed);
+    } , threadCount);
+    return ok.load();
+}
+
+BvhDocument MotionArchive::toDocument(size_t first , size_t last , unsigned threadCount) const
+{
+    if (!isOpen() || first > last || last > m_frameCount)
+        return BvhDocument();
+
+    Joint* root = m_skeleton.createJoints();
+    std::shared_ptr<MotionStore> frames = MotionStore::create(root->channelJoints() , last - first);
+    if (!decode(first , last , frames->data() , frames->channelCount() , threadCount))
+    {
+        delete root;
+        return BvhDocument();
+    }
+
+    //! The joints are bound to the new store , the document adopts it
+    BvhDocument doc;
+    doc.loadRootJoint(root);
+    doc.setFrameInterval(m_frameInterval);
+    return doc;
+}
@@ -0,0 +1,117 @@
+﻿#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "bvh.h"
+#include "mappedfile.h"
+#include "skeleton.h"
+
+namespace BVH {
+
+//!
+//! \brief The ArchiveOptions struct Options which control MotionArchive::write().
+//!
+struct ArchiveOptions {
+    //!
+    //! \brief blockFrames The frames of one block , the smallest unit which is decoded.
+    //!
+    uint32_t blockFrames = 256;
+
+    //!
+    //! \brief precision 0 stores the values losslessly , otherwise every value is rounded to a
+    //!        multiple of \a precision , so it is off by at most half of it.
+    //!
+    float precision = 0.0f;
+
+    //!
+    //! \brief threadCount The number of threads which encode blocks , 0 uses every hardware thread.
+    //!
+    unsigned threadCount = 0;
+};
+
+//!
+//! \brief The MotionArchive class A compressed .bvha file which decodes any range of frames.
+//! \remarks The motion is split into blocks of ArchiveOptions::blockFrames frames. Every channel
+//!          of a block starts with the value of its first frame , followed by the differences
+//!          between successive frames which are bit-packed with the fewest bits that hold all of
+//!          them. Lossless archives take the differences of the float bit patterns , mapped so that
+//!          their order is the order of the values , the others of the values as multiples of the
+//!          precision. An index of the block offsets at the end of the file lets decode() touch
+//!          only the blocks of the frames it is asked for , and blocks are decoded in parallel.
+//!
+//!          The file is mapped , the hierarchy is read by open() and the blocks when they are decoded.
+//!
+class MotionArchive {
+public:
+    MotionArchive();
+
+    //!
+    //! \brief write Compress the motion of \a document into \a filename.
+    //! \return false if the document has no hierarchy or the file could not be written
+    //!
+    static bool write(const BvhDocument& document , const std::string& filename ,
+                      const ArchiveOptions& options = ArchiveOptions());
+
+    //!
+    //! \brief open Map an archive and read its hierarchy and block index.
+    //! \return false if the file could not be opened or is not a valid archive
+    //!
+    bool open(const std::string& filename);
+    void close();
+    bool isOpen() const { return static_cast<bool>(m_file); }
+
+    const Skeleton& skeleton() const { return m_skeleton; }
+    float frameInterval() const { return m_frameInterval; }
+    float precision() const { return m_precision; }
+    size_t frameCount() const { return m_frameCount; }
+    size_t channelCount() const { return m_channelCount; }
+    size_t blockFrames() const { return m_blockFrames; }
+    size_t blockCount() const { return m_blockOffsets.empty() ? 0 : m_blockOffsets.size() - 1; }
+
+    //!
+    //! \brief compressedSize The bytes of all blocks.
+    //!
+    size_t compressedSize() const { return m_blockOffsets.empty() ? 0 : static_cast<size_t>(m_blockOffsets.back() - m_blockOffsets.front()); }
+
+    //!
+    //! \brief decode The frames [first , last).
+    //! \param rows (last - first) rows of channelCount() values , \a rowStride floats apart
+    //! \param threadCount The number of threads which decode blocks , 0 uses every hardware thread
+    //! \return false if the range is outside of the archive or a block is damaged
+    //!
+    bool decode(size_t first , size_t last , float* rows , size_t rowStride , unsigned threadCount = 0) const;
+
+    //!
+    //! \brief toDocument A document with the frames [first , last).
+    //! \return An empty document if the archive is not open or decode() fails
+    //!
+    BvhDocument toDocument(size_t first , size_t last , unsigned threadCount = 0) const;
+    BvhDocument toDocument(unsigned threadCount = 0) const { return toDocument(0 , m_frameCount , threadCount); }
+
+private:
+    MotionArchive(const MotionArchive& other) = delete;
+    MotionArchive& operator = (const MotionArchive& other) = delete;
+
+    bool decodeBlock(size_t block , size_t first , size_t last , float* rows , size_t rowStride) const;
+
+    std::shared_ptr<MappedFile> m_file;
+    Skeleton m_skeleton;
+    float m_frameInterval = 0.0f;
+    float m_precision = 0.0f;
+    size_t m_frameCount = 0;
+    size_t m_channelCount = 0;
+    size_t m_blockFrames = 0;
+
+    //!
+    //! \brief m_blockOffsets The file offset of every block and of the end of the last one
+    //!
+    std::vector<uint64_t> m_blockOffsets;
+};
+
+}
+
+#endif // ARCHIVE_H
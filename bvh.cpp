@@ -1,10 +1,19 @@
 ﻿#include "bvh.h"
-#include <sstream>
+#include "bvhtokenizer.h"
+#include "channellayout.h"
+#include "mappedfile.h"
+#include "namehash.h"
+#include "parsecache.h"
+#include "rotationkernels.h"
+#include "skeletonregistry.h"
+#include "textwriter.h"
+#include "threadpool.h"
 #include <vector>
 #include <cassert>
-#include <iomanip>
-#include <iostream>
-#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <atomic>
+#include <unordered_map>
 using namespace BVH;
 using namespace std;
 
@@ -14,7 +23,12 @@ Joint::Joint(Joint *parent)
     , m_rotationOrder(AxisOrder::Invalid)
 {
     if (parent)
+    {
+        m_depth = parent->m_depth + 1;
+        m_indexInParent = parent->m_children.size();
         parent->m_children.push_back(this);
+        parent->hierarchyChanged();
+    }
 }
 
 
@@ -41,33 +55,44 @@ void Joint::apendChild(Joint *child)
     if (child->parent())
     {
         if (child->parent() == this) return;
-        auto& children = child->parent()->m_children;
-        for(auto i = children.begin(); i != children.end(); ++i)
-        {
-            if (*i == child)
-            {
-                children.erase(i);
-                break;
-            }
-        }
-    }    
+        child->parent()->removeChild(child);
+    }
     child->m_parent = this;
+    child->m_indexInParent = m_children.size();
     m_children.push_back(child);
+    child->updateDepth();
+    hierarchyChanged();
 }
 
 void Joint::removeChild(Joint *child)
 {
     assert(child != nullptr);
     assert(child->parent() == this);
-    for(auto i = m_children.begin() ; i != m_children.end() ; ++i)
+    if (child->m_parent != this)
+        return;
+
+    size_t index = child->m_indexInParent;
+    if (index >= m_children.size() || m_children[index] != child)
     {
-        if (*i == child)
-        {
-            m_children.erase(i);
-            child->m_parent = nullptr;
-            break;
-        }
+        index = static_cast<size_t>(indexOfChild(child));
+    }
+    m_children.erase(m_children.begin() + index);
+    for (size_t i = index; i < m_children.size(); ++i)
+    {
+        m_children[i]->m_indexInParent = i;
     }
+    child->m_parent = nullptr;
+    child->m_indexInParent = 0;
+    child->updateDepth();
+    hierarchyChanged();
+}
+
+void Joint::setAsEndSite(bool isEndSite)
+{
+    if (m_isEndSite == isEndSite)
+        return;
+    m_isEndSite = isEndSite;
+    hierarchyChanged();
 }
 
 void Joint::setParent(Joint *parent)
@@ -89,30 +114,17 @@ void Joint::setParent(Joint *parent)
 bool Joint::isChildInTree(Joint *child, bool bRecursive) const
 {
     assert(child != nullptr);
-    if (bRecursive)
+    if (!bRecursive)
     {
-        for(const auto i : m_children)
-        {
-            if (i == child)
-            {
-                return true;
-            }
-            else if (i->isChildInTree(child , true))
-            {
-                return true;
-            }
-            else
-                continue;
-        }
+        return child->m_parent == this;
     }
-    else
+
+    //! Walk up from the child instead of searching the whole subtree
+    for (const Joint* i = child->m_parent; i; i = i->m_parent)
     {
-        for(const auto i : m_children)
+        if (i == this)
         {
-            if (i == child)
-            {
-                return true;
-            }
+            return true;
         }
     }
     return false;
@@ -120,6 +132,13 @@ bool Joint::isChildInTree(Joint *child, bool bRecursive) const
 
 int Joint::indexOfChild(Joint *child) const
 {
+    if (child && child->m_parent == this
+            && child->m_indexInParent < m_children.size()
+            && m_children[child->m_indexInParent] == child)
+    {
+        return static_cast<int>(child->m_indexInParent);
+    }
+
     int counter = 0;
     for(auto i : m_children)
     {
@@ -134,43 +153,203 @@ int Joint::indexOfChild(Joint *child) const
 
 Joint *Joint::childAt(int index) const
 {
-    int counter = 0;
-    for(auto i : m_children)
+    if (index < 0 || static_cast<size_t>(index) >= m_children.size())
+    {
+        return nullptr;
+    }
+    return m_children[index];
+}
+
+Joint *Joint::nextPreOrder(const Joint *joint , const Joint *root , bool skipChildren)
+{
+    if (!skipChildren && !joint->m_children.empty())
+    {
+        return joint->m_children.front();
+    }
+
+    while (joint != root && joint->m_parent)
     {
-        if (counter == index)
+        const Joint* parent = joint->m_parent;
+        size_t next = joint->m_indexInParent + 1;
+        if (next < parent->m_children.size())
         {
-            return i;
+            return parent->m_children[next];
         }
-        ++counter;
+        joint = parent;
     }
     return nullptr;
 }
 
+Joint *Joint::firstPostOrder(Joint *root)
+{
+    if (!root)
+    {
+        return nullptr;
+    }
+    while (!root->m_children.empty())
+    {
+        root = root->m_children.front();
+    }
+    return root;
+}
+
+Joint *Joint::nextPostOrder(const Joint *joint , const Joint *root)
+{
+    if (joint == root || !joint->m_parent)
+    {
+        return nullptr;
+    }
+
+    Joint* parent = joint->m_parent;
+    size_t next = joint->m_indexInParent + 1;
+    if (next < parent->m_children.size())
+    {
+        return firstPostOrder(parent->m_children[next]);
+    }
+    return parent;
+}
+
+const std::vector<Joint *> &Joint::channelJoints() const
+{
+    if (!m_channelJointsValid)
+    {
+        //! clear() keeps the capacity , rebuilding after an edit does not allocate again
+        m_channelJoints.clear();
+        if (!m_isEndSite)
+        {
+            const Joint* joint = this;
+            while (joint)
+            {
+                //! End Sites have no channels and nothing below them is written
+                if (!joint->m_isEndSite)
+                {
+                    m_channelJoints.push_back(const_cast<Joint*>(joint));
+                }
+                joint = nextPreOrder(joint , this , joint->m_isEndSite);
+            }
+        }
+        m_channelJointsValid = true;
+    }
+    return m_channelJoints;
+}
+
+void Joint::hierarchyChanged()
+{
+    for (Joint* i = this; i; i = i->m_parent)
+    {
+        i->m_channelJointsValid = false;
+        ++i->m_revision;
+    }
+}
+
+void Joint::touch()
+{
+    for (Joint* i = this; i; i = i->m_parent)
+    {
+        ++i->m_revision;
+    }
+}
+
+void Joint::setJointName(const std::string &name)
+{
+    if (m_jointName == name)
+        return;
+    m_jointName = name;
+    touch();
+}
+
+void Joint::setPositionAxisOrder(AxisOrder order)
+{
+    if (m_positonOrder == order)
+        return;
+    m_positonOrder = order;
+    touch();
+}
+
+void Joint::setRotationAxisOrder(AxisOrder order)
+{
+    if (m_rotationOrder == order)
+        return;
+    m_rotationOrder = order;
+    touch();
+}
+
+void Joint::setOffset(float x , float y , float z)
+{
+    if (m_x == x && m_y == y && m_z == z)
+        return;
+    m_x = x , m_y = y , m_z = z;
+    touch();
+}
+
+void Joint::updateDepth()
+{
+    m_depth = m_parent ? m_parent->m_depth + 1 : 0;
+    for (Joint* i = nextPreOrder(this , this); i; i = nextPreOrder(i , this))
+    {
+        i->m_depth = i->m_parent->m_depth + 1;
+    }
+}
+
 size_t Joint::frameCount() const
 {
-    if (m_positonOrder == AxisOrder::Invalid)
+    return frameData().frameCount();
+}
+
+void Joint::pushData(float data)
+{
+    if (m_motion)
     {
-        return m_frameData.size() / 3;
+        unbindMotion();
     }
-    else
+    m_frameData.push_back(data);
+}
+
+ConstFrameDataView Joint::frameData() const
+{
+    size_t channels = channelCount();
+    if (m_motion)
     {
-        return m_frameData.size() / 6;
+        return ConstFrameDataView(m_motion->data() + m_channelOffset , m_motion->frameCount() , channels , m_motion->channelCount());
     }
+    return ConstFrameDataView(m_frameData.data() , m_frameData.size() / channels , channels , channels);
 }
 
-int Joint::calcDepth() const
+FrameDataView Joint::frameData()
 {
-    if (m_parent == nullptr)
+    size_t channels = channelCount();
+    if (m_motion)
     {
-        return 0;
+        return FrameDataView(m_motion->data() + m_channelOffset , m_motion->frameCount() , channels , m_motion->channelCount());
     }
-    else
+    return FrameDataView(m_frameData.data() , m_frameData.size() / channels , channels , channels);
+}
+
+void Joint::setFrameData(const std::vector<float> &data)
+{
+    m_motion.reset();
+    m_channelOffset = 0;
+    m_frameData = data;
+}
+
+void Joint::unbindMotion()
+{
+    m_frameData = frameData().toVector();
+    m_motion.reset();
+    m_channelOffset = 0;
+}
+
+int Joint::calcDepth() const
+{
+    int depth = 0;
+    for (const Joint* i = m_parent; i; i = i->m_parent)
     {
-        return m_parent->calcDepth() + 1;
+        ++depth;
     }
+    return depth;
 }
 
-static const char* jointNames_3DMaxBiped[] = {
+static constexpr const char* jointNames_3DMaxBiped[] = {
     "Hips" ,
     "LeftHip" ,
     "LeftUpLeg" ,
@@ -240,7 +419,7 @@ static const char* jointNames_3DMaxBiped[] = {
     "Invalid"
 };
 
-static const char* jointNames_BioVision[] = {
+static constexpr const char* jointNames_BioVision[] = {
   "Hips" ,
   "LeftUpLeg" ,
   "LeftLeg" ,
@@ -326,64 +505,109 @@ const std::string BVH::jointTypeToName_BioVision(JointType_BioVision type)
     return jointNames_BioVision[static_cast<int>(type)];
 }
 
+//! The name tables are looked up through a perfect hash: the top NameSlotBits bits of nameHash()
+//! select a slot which holds the index of the only name that can be there , all built at compile time.
+static const int NameSlotBits = 9;
+static const size_t NameSlotCount = size_t(1) << NameSlotBits;
+
+constexpr uint32_t nameSlot(uint32_t hash)
+{
+    return hash >> (32 - NameSlotBits);
+}
+
+template <size_t N>
+constexpr int nameInSlot(const char* const (&names)[N] , uint32_t slot , size_t i = 0)
+{
+    return i == N ? -1 : nameSlot(literalNameHash(names[i])) == slot ? static_cast<int>(i) : nameInSlot(names , slot , i + 1);
+}
+
+template <size_t N>
+constexpr bool slotIsUnique(const char* const (&names)[N] , size_t i , size_t j)
+{
+    return j == N || (nameSlot(literalNameHash(names[i])) != nameSlot(literalNameHash(names[j])) && slotIsUnique(names , i , j + 1));
+}
+
+template <size_t N>
+constexpr bool isPerfectHash(const char* const (&names)[N] , size_t i = 0)
+{
+    return i == N || (slotIsUnique(names , i , i + 1) && isPerfectHash(names , i + 1));
+}
+
+static_assert(isPerfectHash(jointNames_3DMaxBiped) , "Choose another NameHashSeed , two 3DMaxBiped names share a slot");
+static_assert(isPerfectHash(jointNames_BioVision) , "Choose another NameHashSeed , two BioVision names share a slot");
+
+template <size_t... I>
+struct IndexSequence {};
+
+template <size_t N , size_t... I>
+struct MakeIndexSequence : MakeIndexSequence<N - 1 , N - 1 , I...> {};
+
+template <size_t... I>
+struct MakeIndexSequence<0 , I...> {
+    typedef IndexSequence<I...> type;
+};
+
+struct NameSlots {
+    int8_t index[NameSlotCount];
+};
+
+template <size_t N , size_t... I>
+constexpr NameSlots makeNameSlots(const char* const (&names)[N] , IndexSequence<I...>)
+{
+    return NameSlots { { static_cast<int8_t>(nameInSlot(names , static_cast<uint32_t>(I)))... } };
+}
+
+static constexpr NameSlots nameSlots_3DMaxBiped = makeNameSlots(jointNames_3DMaxBiped , MakeIndexSequence<NameSlotCount>::type());
+static constexpr NameSlots nameSlots_BioVision = makeNameSlots(jointNames_BioVision , MakeIndexSequence<NameSlotCount>::type());
+
+//!
+//! \brief findName The index of \a name in a name table , -1 if it is not there.
+//!
+static int findName(const std::string& name , const NameSlots& slots , const char* const* names)
+{
+    int index = slots.index[nameSlot(nameHash(name))];
+    if (index < 0)
+        return -1;
+    const char* candidate = names[index];
+    return std::strlen(candidate) == name.size() && std::memcmp(candidate , name.data() , name.size()) == 0 ? index : -1;
+}
+
 JointType_3DMaxBiped BVH::jointTypeFromName_3DMaxBiped(const std::string &name)
 {
-    for(unsigned i = 0; i < sizeof(jointNames_3DMaxBiped) / sizeof(char*); ++i)
-    {
-        if (jointNames_3DMaxBiped[i] == name)
-        {
-            return static_cast<JointType_3DMaxBiped>(i);
-        }
-    }
-    return JointType_3DMaxBiped::Invalid;
+    int index = findName(name , nameSlots_3DMaxBiped , jointNames_3DMaxBiped);
+    return index < 0 ? JointType_3DMaxBiped::Invalid : static_cast<JointType_3DMaxBiped>(index);
 }
 
 
 JointType_BioVision BVH::jointTypeFromName_BioVision(const std::string &name)
 {
-    unsigned count = sizeof(jointNames_BioVision) / sizeof(char*);
-    for(unsigned i = 0; i < count; ++i)
-    {
-        if (jointNames_BioVision[i] == name)
-        {
-            return static_cast<JointType_BioVision>(i);
-        }
-    }
-    return JointType_BioVision::Invalid;
+    int index = findName(name , nameSlots_BioVision , jointNames_BioVision);
+    return index < 0 ? JointType_BioVision::Invalid : static_cast<JointType_BioVision>(index);
 }
 
-static bool readHIERARCHY(std::istream &is)
+static bool readHIERARCHY(BvhTokenizer &tk)
 {
-    is.seekg(0);
-    string line;
-    stringstream ss;
-    string word;
-    while(std::getline(is , line))
+    tk.seek(tk.begin());
+    TextRange word;
+    while(tk.nextLine())
     {
-        if (line.empty()) continue;
-        ss.str(line);
-        while(ss >> word)
+        while(tk.nextWord(word))
         {
             if (word == "HIERARCHY")
             {
                 return true;
             }
         }
-        ss.clear();
     }
     return false;
 }
 
-static bool readRootHip(std::istream &is)
+static bool readRootHip(BvhTokenizer &tk)
 {
-    string line;
-    stringstream ss;
-    string word;
-    while(std::getline(is , line))
+    TextRange word;
+    while(tk.nextLine())
     {
-        if (line.empty()) continue;
-        ss.str(line);
-        while(ss >> word)
+        while(tk.nextWord(word))
         {
             if (word == "ROOT")
             {
@@ -399,16 +623,12 @@ static bool readRootHip(std::istream &is)
     return false;
 }
 
-static bool readOpenBrace(istream& is)
+static bool readOpenBrace(BvhTokenizer& tk)
 {
-    string line;
-    string word;
-    stringstream ss;
-    while(std::getline(is , line))
+    TextRange word;
+    while(tk.nextLine())
     {
-        if (line.empty()) continue;
-        ss.str(line);
-        while(ss >> word)
+        while(tk.nextWord(word))
         {
             if (word == "{")
             {
@@ -420,16 +640,12 @@ static bool readOpenBrace(istream& is)
     return false;
 }
 
-static bool readCloseBrace(istream& is)
+static bool readCloseBrace(BvhTokenizer& tk)
 {
-    string line;
-    string word;
-    stringstream ss;
-    while(std::getline(is , line))
+    TextRange word;
+    while(tk.nextLine())
     {
-        if (line.empty()) continue;
-        ss.str(line);
-        while(ss >> word)
+        while(tk.nextWord(word))
         {
             if (word == "}")
             {
@@ -441,18 +657,14 @@ static bool readCloseBrace(istream& is)
     return false;
 }
 
-static bool readOffset(float &v0 , float &v1 , float &v2 , istream& is)
+static bool readOffset(float &v0 , float &v1 , float &v2 , BvhTokenizer& tk)
 {
-    string line;
-    string word;
-    stringstream ss;
-    while(std::getline(is , line))
+    TextRange word;
+    while(tk.nextLine())
     {
-        if (line.empty()) continue;
-        ss.str(line);
-        if (ss >> word && word == "OFFSET")
+        if (tk.nextWord(word) && word == "OFFSET")
         {
-            if (ss >> v0 >> v1 >> v2)
+            if (tk.nextFloat(v0) && tk.nextFloat(v1) && tk.nextFloat(v2))
             {
                 return true;
             }
@@ -462,32 +674,27 @@ static bool readOffset(float &v0 , float &v1 , float &v2 , istream& is)
     return false;
 }
 
-static std::vector<AxisOrder> readChannels(istream& is)
+static std::vector<AxisOrder> readChannels(BvhTokenizer& tk)
 {
-    string line;
-    string word;
-    stringstream ss;
+    TextRange word;
     std::vector<AxisOrder> ret;
     int channelsCount = 0;
-    string word0 , word1 , word2;
-    while(std::getline(is , line))
+    TextRange word0 , word1 , word2;
+    while(tk.nextLine())
     {
-        if (line.empty()) continue;
-        ss.str(line);
-
-        if (!(ss >> word && word == "CHANNELS"))
+        if (!(tk.nextWord(word) && word == "CHANNELS"))
         {
             return std::vector<AxisOrder>();
         }
 
-        if (!(ss >> channelsCount))
+        if (!tk.nextInt(channelsCount))
         {
             return std::vector<AxisOrder>();
         }
 
         if (channelsCount == 3)
         {
-            if (ss >> word0 >> word1 >> word2)
+            if (tk.nextWord(word0) && tk.nextWord(word1) && tk.nextWord(word2))
             {
                 if (word0 == "Xrotation")
                 {
@@ -532,7 +739,7 @@ static std::vector<AxisOrder> readChannels(istream& is)
         }
         else if (channelsCount == 6)
         {
-            if (ss >> word0 >> word1 >> word2)
+            if (tk.nextWord(word0) && tk.nextWord(word1) && tk.nextWord(word2))
             {
                 if (word0 == "Xposition")
                 {
@@ -585,7 +792,7 @@ static std::vector<AxisOrder> readChannels(istream& is)
                 }
             }
 
-            if (ss >> word0 >> word1 >> word2)
+            if (tk.nextWord(word0) && tk.nextWord(word1) && tk.nextWord(word2))
             {
                 if (word0 == "Xrotation")
                 {
@@ -633,21 +840,17 @@ static std::vector<AxisOrder> readChannels(istream& is)
     return ret;
 }
 
-static bool readJointOrEndSite(string& type , string& name , istream& is)
+static bool readJointOrEndSite(TextRange& type , TextRange& name , BvhTokenizer& tk)
 {
-    string line;
-    stringstream ss;
-    while(std::getline(is , line))
+    while(tk.nextLine())
     {
-        if (line.empty()) continue;
-        ss.str(line);
-        if (ss >> type)
+        if (tk.nextWord(type))
         {
             if (type == "}")
             {
                 return true;
             }
-            else if ((type == "JOINT" || type == "End") && ss >> name)
+            else if ((type == "JOINT" || type == "End") && tk.nextWord(name))
             {
                 return true;
             }
@@ -657,24 +860,24 @@ static bool readJointOrEndSite(string& type , string& name , istream& is)
     return false;
 }
 
-static Joint* readJoint(std::istream &is , Joint* parent = 0)
+static Joint* readJoint(BvhTokenizer &tk , Joint* parent = 0)
 {
-    auto g = is.tellg();
-    if (!readOpenBrace(is))
+    const char* g = tk.position();
+    if (!readOpenBrace(tk))
     {
-        is.seekg(g);
+        tk.seek(g);
         return nullptr;
     }
     float v0 , v1 , v2;
-    if (!readOffset(v0 , v1 , v2 , is))
+    if (!readOffset(v0 , v1 , v2 , tk))
     {
-        is.seekg(g);
+        tk.seek(g);
         return nullptr;
     }
-    std::vector<AxisOrder> channels = readChannels(is);
+    std::vector<AxisOrder> channels = readChannels(tk);
     if (channels.empty())
     {
-        is.seekg(g);
+        tk.seek(g);
         return nullptr;
     }
     Joint* j = new Joint(parent);
@@ -691,46 +894,46 @@ static Joint* readJoint(std::istream &is , Joint* parent = 0)
     j->setOffset(v0 , v1 , v2);
     for (;;)
     {
-        string type , name;
-        if (!readJointOrEndSite(type , name , is))
+        TextRange type , name;
+        if (!readJointOrEndSite(type , name , tk))
         {
             delete j;
-            is.seekg(g);
+            tk.seek(g);
             return nullptr;
         }
         if (type == "JOINT")
         {
-            Joint* jChild = readJoint(is , j);
+            Joint* jChild = readJoint(tk , j);
             if (jChild != nullptr)
             {
-                jChild->setJointName(name);
+                jChild->setJointName(name.toString());
                 j->apendChild(jChild);
             }
             else
             {
                 delete j;
-                is.seekg(g);
+                tk.seek(g);
                 return nullptr;
             }
         }
         else if (type == "End")
         {
-            if (!readOpenBrace(is))
+            if (!readOpenBrace(tk))
             {
                 delete j;
-                is.seekg(g);
+                tk.seek(g);
                 return nullptr;
             }
-            if (!readOffset(v0 , v1 , v2 , is))
+            if (!readOffset(v0 , v1 , v2 , tk))
             {
                 delete j;
-                is.seekg(g);
+                tk.seek(g);
                 return nullptr;
             }
-            if (!readCloseBrace(is))
+            if (!readCloseBrace(tk))
             {
                 delete j;
-                is.seekg(g);
+                tk.seek(g);
                 return nullptr;
             }
             Joint* jChild = new Joint(j);
@@ -746,122 +949,116 @@ static Joint* readJoint(std::istream &is , Joint* parent = 0)
     return nullptr;
 }
 
-bool writeToOStream(const Joint* joint , std::ostream &os)
+static void appendIndent(std::string& text , int depth)
 {
-    for (int i = 0; i < joint->depth(); ++i)
+    for (int i = 0; i < depth; ++i)
     {
-        os << "    ";
+        text += "    ";
+    }
+}
+
+static const char* positionChannelNames(AxisOrder order)
+{
+    switch (order) {
+    case AxisOrder::XYZ:
+        return "Xposition Yposition Zposition ";
+    case AxisOrder::XZY:
+        return "Xposition Zposition Yposition ";
+    case AxisOrder::YXZ:
+        return "Yposition Xposition Zposition ";
+    case AxisOrder::YZX:
+        return "Yposition Zposition Xposition ";
+    case AxisOrder::ZXY:
+        return "Zposition Xposition Yposition ";
+    case AxisOrder::ZYX:
+        return "Zposition Yposition Xposition ";
+    default:
+        return "";
     }
-    os << "{" << endl;
-    for (int i = 0; i <= joint->depth(); ++i)
+}
+
+static const char* rotationChannelNames(AxisOrder order)
+{
+    switch(order)
     {
-        os << "    ";
+    case AxisOrder::XYZ:
+        return "Xrotation Yrotation Zrotation\n";
+    case AxisOrder::XZY:
+        return "Xrotation Zrotation Yrotation\n";
+    case AxisOrder::YXZ:
+        return "Yrotation Xrotation Zrotation\n";
+    case AxisOrder::YZX:
+        return "Yrotation Zrotation Xrotation\n";
+    case AxisOrder::ZXY:
+        return "Zrotation Xrotation Yrotation\n";
+    case AxisOrder::ZYX:
+        return "Zrotation Yrotation Xrotation\n";
+    default:
+        return "";
     }
-    os << "OFFSET " << fixed << setprecision(8) << joint->x() << ' ' << fixed << setprecision(8) << joint->y() << ' ' << fixed << setprecision(10) << joint->z() << endl;
+}
+
+//!
+//! \brief writeJoint Append the text of a joint and its children.
+//! \param depth The depth of the joint , passed down instead of walking up the parents
+//!
+static void writeJoint(const Joint* joint , int depth , std::string& text)
+{
+    appendIndent(text , depth);
+    text += "{\n";
+    appendIndent(text , depth + 1);
+    text += "OFFSET ";
+    appendFixed(text , joint->x() , 8);
+    text += ' ';
+    appendFixed(text , joint->y() , 8);
+    text += ' ';
+    appendFixed(text , joint->z() , 10);
+    text += '\n';
     if (joint->isEndSite())
     {
-        for (int i = 0; i < joint->depth(); ++i)
-        {
-            os << "    ";
-        }
-        os << '}' << endl;
+        appendIndent(text , depth);
+        text += "}\n";
     }
     else
     {
-        for (int i = 0; i <= joint->depth(); ++i)
-        {
-            os << "    ";
-        }
-        os << "CHANNELS ";
+        appendIndent(text , depth + 1);
+        text += "CHANNELS ";
         if (joint->positionAxisOrder() == AxisOrder::Invalid)
         {
-            os << 3 << " ";
+            text += "3 ";
         }
         else
         {
-            os << 6 << " ";
-            switch (joint->positionAxisOrder()) {
-            case AxisOrder::XYZ:
-                os << "Xposition Yposition Zposition ";
-                break;
-            case AxisOrder::XZY:
-                os << "Xposition Zposition Yposition ";
-                break;
-            case AxisOrder::YXZ:
-                os << "Yposition Xposition Zposition ";
-                break;
-            case AxisOrder::YZX:
-                os << "Yposition Zposition Xposition ";
-                break;
-            case AxisOrder::ZXY:
-                os << "Zposition Xposition Yposition ";
-                break;
-            case AxisOrder::ZYX:
-                os << "Zposition Yposition Xposition ";
-                break;
-            default:
-                break;
-            }
-        }
-        switch(joint->rotationAxisOrder())
-        {
-        case AxisOrder::XYZ:
-            os << "Xrotation Yrotation Zrotation" << endl;
-            break;
-        case AxisOrder::XZY:
-            os << "Xrotation Zrotation Yrotation" << endl;
-            break;
-        case AxisOrder::YXZ:
-            os << "Yrotation Xrotation Zrotation" << endl;
-            break;
-        case AxisOrder::YZX:
-            os << "Yrotation Zrotation Xrotation" << endl;
-            break;
-        case AxisOrder::ZXY:
-            os << "Zrotation Xrotation Yrotation" << endl;
-            break;
-        case AxisOrder::ZYX:
-            os << "Zrotation Yrotation Xrotation" << endl;
-            break;
-        default:
-            break;
+            text += "6 ";
+            text += positionChannelNames(joint->positionAxisOrder());
         }
+        text += rotationChannelNames(joint->rotationAxisOrder());
         for (auto i : joint->children())
         {
-            for (int j = 0; j <= joint->depth(); ++j)
-            {
-                os << "    ";
-            }
+            appendIndent(text , depth + 1);
             if (i->isEndSite())
             {
-                os << "End Site" << endl;
+                text += "End Site\n";
             }
             else
             {
-                os << "JOINT " << i->jointName() << endl;
+                text += "JOINT ";
+                text += i->jointName();
+                text += '\n';
             }
-            writeToOStream(i , os);
-        }
-        for (int i = 0; i < joint->depth(); ++i)
-        {
-            os << "    ";
+            writeJoint(i , depth + 1 , text);
         }
-        os << '}' << endl;
+        appendIndent(text , depth);
+        text += "}\n";
     }
-    return os.good();
 }
 
-static bool readMotion(std::istream& is)
+static bool readMotion(BvhTokenizer& tk)
 {
-    string line;
-    stringstream ss;
-    string word;
-    while(std::getline(is , line))
+    TextRange word;
+    while(tk.nextLine())
     {
-        if (line.empty()) continue;
-        ss.str(line);
-
-        if (ss >> word && word == "MOTION")
+        if (tk.nextWord(word) && word == "MOTION")
             return true;
 
         else
@@ -871,25 +1068,20 @@ static bool readMotion(std::istream& is)
     return false;
 }
 
-static bool readFrameCount(int& frameCount , std::istream& is)
+static bool readFrameCount(int& frameCount , BvhTokenizer& tk)
 {
-    string line;
-    stringstream ss;
-    string word;
-    while(std::getline(is , line))
+    TextRange word;
+    while(tk.nextLine())
     {
-        if (line.empty()) continue;
-        ss.str(line);
-
-        if (ss >> word)
+        if (tk.nextWord(word))
         {
             if (word == "Frames")
             {
-                if (ss >> word)
+                if (tk.nextWord(word))
                 {
                     if (word == ":")
                     {
-                        if (ss >> frameCount)
+                        if (tk.nextInt(frameCount))
                             return true;
                     }
                 }
@@ -897,7 +1089,7 @@ static bool readFrameCount(int& frameCount , std::istream& is)
             }
             else if (word == "Frames:")
             {
-                if (ss >> frameCount)
+                if (tk.nextInt(frameCount))
                     return true;
             }
         }
@@ -907,32 +1099,27 @@ static bool readFrameCount(int& frameCount , std::istream& is)
     return false;
 }
 
-static bool readFrameInterval(float& interval , std::istream& is)
+static bool readFrameInterval(float& interval , BvhTokenizer& tk)
 {
-    string line;
-    stringstream ss;
-    string word;
-    while(std::getline(is , line))
+    TextRange word;
+    while(tk.nextLine())
     {
-        if (line.empty()) continue;
-        ss.str(line);
-
-        if (ss >> word)
+        if (tk.nextWord(word))
         {
             if (word == "Frame")
             {
-                if (ss >> word)
+                if (tk.nextWord(word))
                 {
                     if (word == "Time:")
                     {
-                        if (ss >> interval)
+                        if (tk.nextFloat(interval))
                             return true;
                     }
                     else if (word == "Time")
                     {
-                        if (ss >> word && word == ":")
+                        if (tk.nextWord(word) && word == ":")
                         {
-                            if (ss >> interval)
+                            if (tk.nextFloat(interval))
                                 return true;
                         }
                     }
@@ -947,22 +1134,20 @@ static bool readFrameInterval(float& interval , std::istream& is)
 }
 
 //! Todo 如果返回非空，接下来该去读取时间可帧
-static Joint* fromIStream(std::istream &is)
+static Joint* fromTokenizer(BvhTokenizer &tk)
 {
-    auto g = is.tellg();
-    if(!readHIERARCHY(is))
+    const char* g = tk.position();
+    if(!readHIERARCHY(tk))
     {
-        is.seekg(g);
-        is.clear();
+        tk.seek(g);
         return nullptr;
     }
-    if (!readRootHip(is))
+    if (!readRootHip(tk))
     {
-        is.seekg(g);
-        is.clear();
+        tk.seek(g);
         return nullptr;
     }
-    Joint* j = readJoint(is);
+    Joint* j = readJoint(tk);
     if (j != nullptr)
     {
         j->setJointName("Hips");
@@ -970,36 +1155,182 @@ static Joint* fromIStream(std::istream &is)
     return j;
 }
 
-static bool toOStream(const Joint* joint , std::ostream &os)
+Joint* BVH::readBvhHeader(BvhTokenizer &tk , int &frameCount , float &frameInterval)
 {
-    if (!(os << "HIERARCHY" << endl))
-        return false;
+    Joint* j = fromTokenizer(tk);
+    if (!j)
+        return nullptr;
 
-    if (!(os << "ROOT Hips" << endl))
-        return false;
+    if (!readMotion(tk) || !readFrameCount(frameCount , tk) || !readFrameInterval(frameInterval , tk))
+    {
+        delete j;
+        return nullptr;
+    }
+    return j;
+}
 
-    if (writeToOStream(joint , os))
-        return true;
+static void writeHierarchy(const Joint* joint , std::string& text)
+{
+    text += "HIERARCHY\n";
+    text += "ROOT Hips\n";
+    writeJoint(joint , 0 , text);
+}
 
-    return false;
+//!
+//! \brief writeFrames Append the lines of frames [first , last).
+//!
+static void writeFrames(const MotionStore& motion , const ChannelLayout& layout , size_t first , size_t last ,
+                        int precision , std::string& text)
+{
+    std::vector<float> row(layout.channelCount());
+    char buffer[FixedFloatMaxLength];
+    for (size_t i = first; i < last; ++i)
+    {
+        layout.gather(motion.row(i) , row.data());
+        for (float value : row)
+        {
+            size_t size = formatFixed(value , precision , buffer);
+            buffer[size] = ' ';
+            text.append(buffer , size + 1);
+        }
+        text += '\n';
+    }
 }
 
-static std::vector<Joint*> sequenceJoint(Joint* j)
+std::vector<Joint*> BVH::sequenceJoint(Joint* j)
 {
-    std::vector<Joint*> ret;
+    if (!j)
+        return std::vector<Joint*>();
+    return j->channelJoints();
+}
 
-    if (!j || j->isEndSite())
-        return ret;
+//!
+//! \brief isBlankLine Whether [first , last) contains only whitespace.
+//!
+static bool isBlankLine(const char* first , const char* last)
+{
+    for (; first < last; ++first)
+    {
+        if (!BvhTokenizer::isSpace(*first))
+            return false;
+    }
+    return true;
+}
 
-    ret.push_back(j);
+//!
+//! \brief readFramesParallel Parse the frame lines in [begin , end) on the thread pool.
+//! \remarks The text is split into chunks at line boundaries. A first pass counts the frame lines
+//!          of every chunk so that each chunk knows the index of its first frame, the second pass
+//!          parses every chunk straight into its rows of the motion store. As in the serial
+//!          reader the frames end at the first incomplete line.
+//!
+static void readFramesParallel(const char* begin , const char* end , const ChannelLayout& layout ,
+                               MotionStore& motion , const ParseOptions& options , unsigned threadCount)
+{
+    ThreadPool& pool = ThreadPool::globalInstance();
+
+    //! A few chunks per thread so that uneven lines even out
+    size_t chunkCount = static_cast<size_t>(threadCount) * 4;
+    size_t chunkSize = static_cast<size_t>(end - begin) / chunkCount + 1;
+    std::vector<const char*> bounds;
+    bounds.push_back(begin);
+    for (size_t i = 1; i < chunkCount; ++i)
+    {
+        const char* p = begin + i * chunkSize;
+        if (p <= bounds.back())
+            continue;
+        if (p >= end)
+            break;
+        const char* newline = static_cast<const char*>(std::memchr(p , '\n' , end - p));
+        if (!newline || newline + 1 >= end)
+            break;
+        bounds.push_back(newline + 1);
+    }
+    bounds.push_back(end);
+    chunkCount = bounds.size() - 1;
+
+    std::vector<size_t> lineCounts(chunkCount , 0);
+    pool.parallelFor(chunkCount , [&](size_t chunk) {
+        const char* p = bounds[chunk];
+        const char* last = bounds[chunk + 1];
+        size_t lines = 0;
+        while (p < last)
+        {
+            const char* newline = static_cast<const char*>(std::memchr(p , '\n' , last - p));
+            const char* lineEnd = newline ? newline : last;
+            if (!isBlankLine(p , lineEnd))
+                ++lines;
+            p = lineEnd + 1;
+        }
+        lineCounts[chunk] = lines;
+    } , threadCount);
 
-    auto children = j->children();
-    for(auto i : children)
+    std::vector<size_t> firstFrames(chunkCount , 0);
+    size_t totalLines = 0;
+    for (size_t i = 0; i < chunkCount; ++i)
     {
-        auto retTmp = sequenceJoint(i);
-        ret.insert(ret.end() , retTmp.begin() , retTmp.end());
+        firstFrames[i] = totalLines;
+        totalLines += lineCounts[i];
+    }
+
+    const size_t channelCount = motion.channelCount();
+    motion.resize(totalLines);
+    std::atomic<size_t> frameCount(totalLines);
+    pool.parallelFor(chunkCount , [&](size_t chunk) {
+        BvhTokenizer tk(bounds[chunk] , bounds[chunk + 1]);
+        std::vector<float> row(channelCount);
+        size_t frame = firstFrames[chunk];
+        while (tk.nextLine())
+        {
+            if (tk.nextFloats(row.data() , channelCount , options.exactFloats) != channelCount)
+            {
+                size_t current = frameCount;
+                while (frame < current && !frameCount.compare_exchange_weak(current , frame))
+                {
+                }
+                return;
+            }
+            layout.scatter(row.data() , motion.row(frame));
+            ++frame;
+        }
+    } , threadCount);
+
+    motion.resize(frameCount);
+}
+
+//!
+//! \brief readFrames Parse the frame lines in [begin , end) into \a motion.
+//! \param declaredFrameCount The value of the "Frames:" line , only used to reserve memory
+//!
+static void readFrames(const char* begin , const char* end , const ChannelLayout& layout ,
+                       MotionStore& motion , const ParseOptions& options , int declaredFrameCount)
+{
+    unsigned threadCount = options.threadCount != 0 ? options.threadCount : ThreadPool::hardwareThreads();
+    if (threadCount > 1 && static_cast<size_t>(end - begin) >= options.parallelThreshold)
+    {
+        readFramesParallel(begin , end , layout , motion , options , threadCount);
+        return;
+    }
+
+    //! 读取帧数据，将数据与每一个节点绑定
+    BvhTokenizer in(begin , end);
+    const size_t channelCount = layout.channelCount();
+    //! A frame takes at least a digit and a separator per channel , a wrong "Frames:" line reserves no more
+    size_t reserved = declaredFrameCount > 0 ? static_cast<size_t>(declaredFrameCount) : 0;
+    if (channelCount != 0)
+        reserved = std::min(reserved , static_cast<size_t>(end - begin) / (2 * channelCount) + 1);
+    motion.reserve(reserved);
+    std::vector<float> row(channelCount);
+    while(in.nextLine())
+    {
+        //! 数据不完整的行表示帧数据的结束
+        if (in.nextFloats(row.data() , channelCount , options.exactFloats) != channelCount)
+            break;
+
+        size_t frame = motion.frameCount();
+        motion.resize(frame + 1);
+        layout.scatter(row.data() , motion.row(frame));
     }
-    return ret;
 }
 
 BvhDocument::BvhDocument()
@@ -1012,7 +1343,16 @@ BvhDocument::BvhDocument()
 BvhDocument::BvhDocument(BvhDocument &&rhs)
     : m_rootJoint(rhs.m_rootJoint)
     , m_frameInterval(rhs.m_frameInterval)
+    , m_motion(rhs.m_motion)
+    , m_rotations(rhs.m_rotations)
+    , m_nameIndex(rhs.m_nameIndex)
+    , m_skeleton(rhs.m_skeleton)
+    , m_skeletonRoot(rhs.m_skeletonRoot)
+    , m_skeletonRevision(rhs.m_skeletonRevision)
 {
+    //! Hand nothing out , a document without joints would build them in unloadRootJoint()
+    rhs.m_rootJoint = 0;
+    rhs.m_skeleton.reset();
     rhs.unloadRootJoint();
 }
 
@@ -1023,16 +1363,61 @@ BvhDocument::~BvhDocument()
 
     m_rootJoint = 0;
     m_frameInterval = 0.0;
+    m_motion.reset();
 }
 
 Joint *BvhDocument::unloadRootJoint()
 {
-    auto ret = m_rootJoint;
+    auto ret = rootJoint();
     m_rootJoint = 0;
     m_frameInterval = 0.0;
+    m_motion.reset();
+    m_rotations.reset();
+    m_nameIndex.reset();
+    m_skeleton.reset();
     return ret;
 }
 
+Joint *BvhDocument::rootJoint() const
+{
+    if (!m_rootJoint && m_skeleton)
+    {
+        //! ParseOptions::sharedSkeleton , the store was built for the same hierarchy so the tree fits its rows
+        m_rootJoint = m_skeleton->createJoints();
+        m_skeletonRoot = m_rootJoint;
+        m_skeletonRevision = m_rootJoint->revision();
+        if (m_motion)
+            m_motion->bind(m_rootJoint->channelJoints());
+    }
+    return m_rootJoint;
+}
+
+void BvhDocument::adoptHierarchy(Joint *root , bool sharedSkeleton)
+{
+    m_skeleton = SkeletonRegistry::globalInstance().intern(root);
+    if (sharedSkeleton)
+    {
+        //! The joints only point at the store , the store does not need them
+        delete root;
+        return;
+    }
+    m_rootJoint = root;
+    m_skeletonRoot = root;
+    m_skeletonRevision = root->revision();
+}
+
+std::shared_ptr<MotionStore> BvhDocument::currentMotion() const
+{
+    if (!m_rootJoint)
+        return m_motion;
+
+    //! The joints may have been edited since the store was built
+    const std::vector<Joint*>& jointSequence = m_rootJoint->channelJoints();
+    if (!m_motion || !m_motion->isBoundTo(jointSequence))
+        return MotionStore::copyOf(jointSequence);
+    return m_motion;
+}
+
 void BvhDocument::loadRootJoint(Joint *joint)
 {
     if (m_rootJoint == joint)
@@ -1042,345 +1427,269 @@ void BvhDocument::loadRootJoint(Joint *joint)
         delete m_rootJoint;
 
     m_rootJoint = joint;
+    m_motion.reset();
+    m_nameIndex.reset();
+    m_skeleton.reset();
+    packMotion();
 }
 
-bool BvhDocument::toFile(const string &filename) const
+Span<const float> BvhDocument::pose(size_t frame) const
 {
-    if (!m_rootJoint)
-        return false;
+    if (!m_motion || frame >= m_motion->frameCount())
+        return Span<const float>();
+    return Span<const float>(m_motion->row(frame) , m_motion->channelCount());
+}
 
-    std::ofstream out(filename);
+Span<float> BvhDocument::pose(size_t frame)
+{
+    if (!m_motion || frame >= m_motion->frameCount())
+        return Span<float>();
+    return Span<float>(m_motion->row(frame) , m_motion->channelCount());
+}
 
-    if (!toOStream(m_rootJoint , out))
-        return false;
+StridedSpan<const float> BvhDocument::channelColumn(size_t channel) const
+{
+    if (!m_motion || channel >= m_motion->channelCount())
+        return StridedSpan<const float>();
+    return StridedSpan<const float>(m_motion->data() + channel , m_motion->frameCount() , m_motion->channelCount());
+}
 
+StridedSpan<const float> BvhDocument::channelColumn(const Joint *joint , size_t channel) const
+{
+    if (!m_motion || joint->motionStore() != m_motion.get() || channel >= joint->channelCount())
+        return StridedSpan<const float>();
+    return channelColumn(joint->channelOffset() + channel);
+}
 
-    if (!(out << "MOTION" << endl << endl))
-        return false;
+namespace BVH {
+
+//!
+//! \brief The JointNameIndex class The joints of a hierarchy by name , see BvhDocument::findJoint().
+//!
+class JointNameIndex {
+public:
+    struct Entry {
+        Joint* joint;
+        int channelOffset;
+    };
+
+    explicit JointNameIndex(Joint* root)
+        : m_root(root)
+        , m_revision(root ? root->revision() : 0)
+    {
+        if (!root)
+            return;
 
-    size_t frameCount = m_rootJoint->frameCount();
+        int column = 0;
+        for (Joint* joint : root->preOrder())
+        {
+            //! Joints at or below an End Site have no channels
+            bool hasChannels = true;
+            for (const Joint* i = joint; i && hasChannels; i = i == root ? nullptr : i->parent())
+            {
+                hasChannels = !i->isEndSite();
+            }
 
-    if (out << "Frames: ")
-    {
-        if (!(out << frameCount << endl))
-            return false;
+            Entry entry = { joint , hasChannels ? column : -1 };
+            if (hasChannels)
+                column += static_cast<int>(joint->channelCount());
+            //! emplace keeps the first joint of a name
+            m_entries.emplace(joint->jointName() , entry);
+        }
     }
-    else
+
+    bool isBuiltFrom(const Joint* root) const
     {
-        return false;
+        return root == m_root && (!root || root->revision() == m_revision);
     }
 
-    out << "Frame Time: " << fixed << setprecision(8) << m_frameInterval << endl;
-
-    std::vector<Joint*> jointSequence = sequenceJoint(m_rootJoint);
-
-    for(unsigned int i = 0; i < frameCount; ++i)
+    const Entry* find(const std::string& name) const
     {
-        for(Joint* j : jointSequence)
-        {
-            if (j->positionAxisOrder() != AxisOrder::Invalid)
-            {
-                size_t index = 6 * i;
-                float px = j->frameData()[index + 0];
-                float py = j->frameData()[index + 1];
-                float pz = j->frameData()[index + 2];
-                float rx = j->frameData()[index + 3];
-                float ry = j->frameData()[index + 4];
-                float rz = j->frameData()[index + 5];
-
-                switch(j->positionAxisOrder())
-                {
-                case AxisOrder::XYZ:
-                    out << px << ' ' << py << ' ' << pz << ' ';
-                    break;
-                case AxisOrder::XZY:
-                    out << px << ' ' << pz << ' ' << py << ' ';
-                    break;
-                case AxisOrder::YXZ:
-                    out << py << ' ' << px << ' ' << pz << ' ';
-                    break;
-                case AxisOrder::YZX:
-                    out << py << ' ' << pz << ' ' << px << ' ';
-                    break;
-                case AxisOrder::ZXY:
-                    out << pz << ' ' << px << ' ' << py << ' ';
-                    break;
-                case AxisOrder::ZYX:
-                    out << pz << ' ' << py << ' ' << px << ' ';
-                    break;
-                default:
-                    break;
-                }
+        auto found = m_entries.find(name);
+        return found == m_entries.end() ? nullptr : &found->second;
+    }
 
+private:
+    const Joint* m_root;
+    uint64_t m_revision;
+    std::unordered_map<std::string , Entry , NameHasher> m_entries;
+};
 
-                switch(j->rotationAxisOrder())
-                {
-                case AxisOrder::XYZ:
-                    out << rx << ' ' << ry << ' ' << rz << ' ';
-                    break;
-                case AxisOrder::XZY:
-                    out << rx << ' ' << rz << ' ' << ry << ' ';
-                    break;
-                case AxisOrder::YXZ:
-                    out << ry << ' ' << rx << ' ' << rz << ' ';
-                    break;
-                case AxisOrder::YZX:
-                    out << ry << ' ' << rz << ' ' << rx << ' ';
-                    break;
-                case AxisOrder::ZXY:
-                    out << rz << ' ' << rx << ' ' << ry << ' ';
-                    break;
-                case AxisOrder::ZYX:
-                    out << rz << ' ' << ry << ' ' << rx << ' ';
-                    break;
-                default:
-                    break;
-                }
-            }
-            else
-            {
-                size_t index = 3 * i;
-                float rx = j->frameData()[index + 0];
-                float ry = j->frameData()[index + 1];
-                float rz = j->frameData()[index + 2];
-                switch(j->rotationAxisOrder())
-                {
-                case AxisOrder::XYZ:
-                    out << rx << ' ' << ry << ' ' << rz << ' ';
-                    break;
-                case AxisOrder::XZY:
-                    out << rx << ' ' << rz << ' ' << ry << ' ';
-                    break;
-                case AxisOrder::YXZ:
-                    out << ry << ' ' << rx << ' ' << rz << ' ';
-                    break;
-                case AxisOrder::YZX:
-                    out << ry << ' ' << rz << ' ' << rx << ' ';
-                    break;
-                case AxisOrder::ZXY:
-                    out << rz << ' ' << rx << ' ' << ry << ' ';
-                    break;
-                case AxisOrder::ZYX:
-                    out << rz << ' ' << ry << ' ' << rx << ' ';
-                    break;
-                default:
-                    break;
-                }
-            }
+}
 
-        }
-        out << endl;
-    }
+const RotationCache &BvhDocument::rotations() const
+{
+    //! Built from the store or , for edited joints , from a copy which only lives during the build
+    const Joint* root = rootJoint();
+    if (!m_rotations || !m_rotations->isBuiltFrom(m_motion , root))
+        m_rotations = std::make_shared<RotationCache>(m_motion , root);
+    return *m_rotations;
+}
 
-    return out.good();
+Joint *BvhDocument::findJoint(const string &name) const
+{
+    Joint* root = rootJoint();
+    if (!m_nameIndex || !m_nameIndex->isBuiltFrom(root))
+        m_nameIndex = std::make_shared<JointNameIndex>(root);
+    const JointNameIndex::Entry* entry = m_nameIndex->find(name);
+    return entry ? entry->joint : nullptr;
 }
 
-BvhDocument BvhDocument::fromFile(const string &filename)
+int BvhDocument::channelOffsetOf(const string &name) const
 {
-    std::ifstream in(filename);
-    Joint* j = fromIStream(in);
+    Joint* root = rootJoint();
+    if (!m_nameIndex || !m_nameIndex->isBuiltFrom(root))
+        m_nameIndex = std::make_shared<JointNameIndex>(root);
+    const JointNameIndex::Entry* entry = m_nameIndex->find(name);
+    return entry ? entry->channelOffset : -1;
+}
 
-    if (!j)
+std::shared_ptr<const Skeleton> BvhDocument::skeleton() const
+{
+    if (!m_rootJoint)
+        return m_skeleton;
+
+    if (!m_skeleton || m_skeletonRoot != m_rootJoint || m_skeletonRevision != m_rootJoint->revision())
     {
-        return BvhDocument();
+        m_skeleton = SkeletonRegistry::globalInstance().intern(m_rootJoint);
+        m_skeletonRoot = m_rootJoint;
+        m_skeletonRevision = m_rootJoint->revision();
     }
+    return m_skeleton;
+}
 
-    if (!readMotion(in))
+void BvhDocument::packMotion()
+{
+    if (!rootJoint())
     {
-        delete j;
-        return BvhDocument();
+        m_motion.reset();
+        return;
     }
 
-    int framesCount = 0;
-    float frameInterval = 0.0;
-
-    if (!readFrameCount(framesCount , in))
+    const std::vector<Joint*>& jointSequence = m_rootJoint->channelJoints();
+    MotionStore* current = jointSequence.empty() ? nullptr : jointSequence.front()->motionStore();
+    if (current && current->isBoundTo(jointSequence))
     {
-
-        delete j;
-        return BvhDocument();
+        //! The joints are still laid out as in their store , e.g. after unloadRootJoint()
+        m_motion = current->shared_from_this();
+        return;
     }
+    m_motion = MotionStore::pack(jointSequence);
+}
 
-    if (!readFrameInterval(frameInterval , in))
+bool BvhDocument::toFile(const string &filename , const WriteOptions &options) const
+{
+    //! A document which keeps only the skeleton writes a tree which lives during the call
+    std::unique_ptr<Joint> temporary;
+    const Joint* root = m_rootJoint;
+    if (!root && m_skeleton)
     {
-        delete j;
-        return BvhDocument();
+        temporary.reset(m_skeleton->createJoints());
+        root = temporary.get();
     }
+    if (!root)
+        return false;
 
-    std::vector<Joint*> jointSequence = sequenceJoint(j);
-    //! 读取帧数据，将数据与每一个节点绑定
-    string line;
-    stringstream ss;
-    while(std::getline(in , line))
-    {
-        if (line.empty())
-            continue;
+    TextFileWriter out;
+    if (!out.open(filename))
+        return false;
 
-        ss.str(line);
-        for(Joint* i : jointSequence)
+    ChannelLayout layout(root->channelJoints());
+    std::shared_ptr<MotionStore> motion = currentMotion();
+
+    size_t frameCount = motion->frameCount();
+
+    std::string& text = out.buffer();
+    writeHierarchy(root , text);
+    text += "MOTION\n\n";
+    text += "Frames: ";
+    text += std::to_string(frameCount);
+    text += '\n';
+    text += "Frame Time: ";
+    appendFixed(text , m_frameInterval , 8);
+    text += '\n';
+    out.flushIfFull();
+
+    //! Frames are formatted in blocks , in parallel a wave of blocks is formatted before it is written
+    const size_t blockFrames = 1024;
+    const size_t blockCount = (frameCount + blockFrames - 1) / blockFrames;
+    unsigned threadCount = options.threadCount != 0 ? options.threadCount : ThreadPool::hardwareThreads();
+    if (threadCount > 1 && blockCount > 1)
+    {
+        const size_t waveBlocks = static_cast<size_t>(threadCount) * 2;
+        std::vector<std::string> blocks(waveBlocks);
+        for (size_t first = 0; first < blockCount; first += waveBlocks)
         {
-            if (i->positionAxisOrder() != AxisOrder::Invalid)
+            size_t count = std::min(waveBlocks , blockCount - first);
+            ThreadPool::globalInstance().parallelFor(count , [&](size_t index) {
+                size_t block = first + index;
+                blocks[index].clear();
+                writeFrames(*motion , layout , block * blockFrames , std::min(frameCount , (block + 1) * blockFrames) ,
+                            options.precision , blocks[index]);
+            } , threadCount);
+            for (size_t i = 0; i < count; ++i)
             {
-                //! 读取六个数据
-                float p0 , p1 , p2;
-                ss >> p0 >> p1 >> p2;
-                switch(i->positionAxisOrder())
-                {
-                case AxisOrder::XYZ:
-                    i->pushData(p0);
-                    i->pushData(p1);
-                    i->pushData(p2);
-                    break;
-                case AxisOrder::XZY:
-                    i->pushData(p0);
-                    i->pushData(p2);
-                    i->pushData(p1);
-                    break;
-                case AxisOrder::YXZ:
-                    i->pushData(p1);
-                    i->pushData(p0);
-                    i->pushData(p2);
-                    break;
-                case AxisOrder::YZX:
-                    i->pushData(p2);
-                    i->pushData(p0);
-                    i->pushData(p1);
-                    break;
-                case AxisOrder::ZXY:
-                    i->pushData(p1);
-                    i->pushData(p2);
-                    i->pushData(p0);
-                    break;
-                case AxisOrder::ZYX:
-                    i->pushData(p2);
-                    i->pushData(p1);
-                    i->pushData(p0);
-                    break;
-                default:
-                    break;
-                }
-            }
-            float r0 , r1 , r2;
-            ss >> r0 >> r1 >> r2;
-            switch(i->rotationAxisOrder())
-            {
-            case AxisOrder::XYZ:
-                i->pushData(r0);
-                i->pushData(r1);
-                i->pushData(r2);
-                break;
-            case AxisOrder::XZY:
-                i->pushData(r0);
-                i->pushData(r2);
-                i->pushData(r1);
-                break;
-            case AxisOrder::YXZ:
-                i->pushData(r1);
-                i->pushData(r0);
-                i->pushData(r2);
-                break;
-            case AxisOrder::YZX:
-                i->pushData(r2);
-                i->pushData(r0);
-                i->pushData(r1);
-                break;
-            case AxisOrder::ZXY:
-                i->pushData(r1);
-                i->pushData(r2);
-                i->pushData(r0);
-                break;
-            case AxisOrder::ZYX:
-                i->pushData(r2);
-                i->pushData(r1);
-                i->pushData(r0);
-                break;
-            default:
-                break;
+                out.write(blocks[i]);
             }
         }
-
-        ss.clear();
+    }
+    else
+    {
+        for (size_t first = 0; first < frameCount; first += blockFrames)
+        {
+            writeFrames(*motion , layout , first , std::min(frameCount , first + blockFrames) , options.precision , text);
+            out.flushIfFull();
+        }
     }
 
-    BvhDocument doc;
-    doc.m_rootJoint = j;
-    doc.m_frameInterval = frameInterval;
-
-    return doc;
-}
-
-static Joint* CopyLeftEndJoint(const Joint* src)
-{
-    Joint* j = new Joint;
-    j->setAsEndSite(true);
-    j->setOffset(src->x() , src->y() , src->z());
-    j->setJointName(src->jointName());
-    j->setPositionAxisOrder(src->positionAxisOrder());
-    j->setRotationAxisOrder(src->rotationAxisOrder());
-    j->frameData() = src->frameData();
-    return j;
-}
-
-static Joint* CopyRightEndJoint(const Joint* src)
-{
-    Joint* j = new Joint;
-    j->setAsEndSite(true);
-    j->setOffset(src->x() , src->y() , src->z());
-    j->setJointName(src->jointName());
-    j->setPositionAxisOrder(src->positionAxisOrder());
-    j->setRotationAxisOrder(src->rotationAxisOrder());
-    j->frameData() = src->frameData();
-    return j;
+    return out.close();
 }
 
-Joint *BVH::SubstractJoints(const Joint *src)
+BvhDocument BvhDocument::fromFile(const string &filename , const ParseOptions &options)
 {
-    if (src->jointName() == "LeftFinger1Nub")
-    {
-        return CopyLeftEndJoint(src);
-    }
-    else if (src->jointName() == "LeftFinger2Nub")
+    if (options.cache)
     {
-        return CopyLeftEndJoint(src);
+        return options.cache->load(filename , options);
     }
-    else if (src->jointName() == "LeftFinger3Nub")
-    {
-        return CopyLeftEndJoint(src);
-    }
-    else if (src->jointName() == "LeftFinger4Nub")
-    {
-        return CopyLeftEndJoint(src);
-    }
-    else if (src->jointName() == "RightFinger1Nub")
-    {
-        return CopyRightEndJoint(src);
-    }
-    else if (src->jointName() == "RightFinger2Nub")
+
+    std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+    if (!file->open(filename))
     {
-        return CopyRightEndJoint(src);
+        return BvhDocument();
     }
-    else if (src->jointName() == "RightFinger3Nub")
+
+    BvhTokenizer in(file->begin() , file->end());
+    int framesCount = 0;
+    float frameInterval = 0.0;
+    Joint* j = readBvhHeader(in , framesCount , frameInterval);
+
+    if (!j)
     {
-        return CopyRightEndJoint(src);
+        return BvhDocument();
     }
-    else if (src->jointName() == "RightFinger4Nub")
+
+    const std::vector<Joint*>& jointSequence = j->channelJoints();
+    std::shared_ptr<MotionStore> motion = MotionStore::create(jointSequence);
+    ChannelLayout layout(jointSequence);
+
+    const char* first = in.position();
+    if (options.lazyMotion)
     {
-        return CopyRightEndJoint(src);
+        //! The loader keeps the file mapped until the frames are decoded
+        ParseOptions frameOptions = options;
+        motion->setLoader([file , first , layout , frameOptions , framesCount](MotionStore& frames) {
+            readFrames(first , file->end() , layout , frames , frameOptions , framesCount);
+        });
     }
     else
     {
-        Joint* j = new Joint;
-        j->setAsEndSite(src->isEndSite());
-        j->setOffset(src->x() , src->y() , src->z());
-        j->setJointName(src->jointName());
-        j->setPositionAxisOrder(src->positionAxisOrder());
-        j->setRotationAxisOrder(src->rotationAxisOrder());
-        j->frameData() = src->frameData();
-        for(const Joint* child : src->children())
-        {
-            Joint*jChild = SubstractJoints(child);
-            j->apendChild(jChild);
-        }
-        return j;
+        readFrames(first , file->end() , layout , *motion , options , framesCount);
     }
+
+    BvhDocument doc;
+    doc.m_frameInterval = frameInterval;
+    doc.m_motion = motion;
+    doc.adoptHierarchy(j , options.sharedSkeleton);
+
+    return doc;
 }
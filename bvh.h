@@ -8,6 +8,9 @@
 #include <iostream>
 #include <vector>
 #include <map>
+#include <memory>
+#include <cstdint>
+#include "motiondata.h"
 
 namespace BVH {
 
@@ -195,6 +198,51 @@ const std::string jointTypeToName_BioVision(JointType_BioVision type);
 JointType_3DMaxBiped jointTypeFromName_3DMaxBiped(const std::string& name);
 JointType_BioVision jointTypeFromName_BioVision(const std::string& name);
 
+class Joint;
+
+//!
+//! \brief The JointIterator class Walks the subtree of a joint in pre-order or post-order.
+//! \remarks The iterator only follows the parent and child links of the joints , so it needs
+//!          no stack and never allocates. The hierarchy must not change while iterating.
+//!
+template <bool PostOrder>
+class JointIterator {
+public:
+    JointIterator() {}
+    JointIterator(Joint* joint , const Joint* root) : m_joint(joint) , m_root(root) {}
+
+    Joint* operator * () const { return m_joint; }
+    Joint* operator -> () const { return m_joint; }
+    JointIterator& operator ++ ();
+
+    //!
+    //! \brief skipChildren Continue a pre-order walk after the subtree of the current joint.
+    //!
+    JointIterator& skipChildren();
+
+    bool operator == (const JointIterator& other) const { return m_joint == other.m_joint; }
+    bool operator != (const JointIterator& other) const { return m_joint != other.m_joint; }
+
+private:
+    Joint* m_joint = nullptr;
+    const Joint* m_root = nullptr;
+};
+
+typedef JointIterator<false> PreOrderIterator;
+typedef JointIterator<true> PostOrderIterator;
+
+template <typename Iterator>
+class JointRange {
+public:
+    JointRange(Iterator first , Iterator last) : m_begin(first) , m_end(last) {}
+    Iterator begin() const { return m_begin; }
+    Iterator end() const { return m_end; }
+
+private:
+    Iterator m_begin;
+    Iterator m_end;
+};
+
 class Joint {
 public:
 
@@ -213,13 +261,13 @@ public:
     //! \brief jointName 获取节点的名称
     //! \return 节点的名称
     //!
-    std::string jointName() const { return m_jointName; }
-    void setJointName(const std::string& name) { m_jointName = name; }
+    const std::string& jointName() const { return m_jointName; }
+    void setJointName(const std::string& name);
 
-    void setX(float x) { m_x = x; }
-    void setY(float y) { m_y = y; }
-    void setZ(float z) { m_z = z; }
-    void setOffset(float x , float y , float z) { m_x = x , m_y = y , m_z = z; }
+    void setX(float x) { setOffset(x , m_y , m_z); }
+    void setY(float y) { setOffset(m_x , y , m_z); }
+    void setZ(float z) { setOffset(m_x , m_y , z); }
+    void setOffset(float x , float y , float z);
     float x() const { return m_x; }
     float y() const { return m_y; }
     float z() const { return m_z; }
@@ -234,7 +282,7 @@ public:
     //! \brief setEndSite 设置EndSite
     //! \param isEndSite 是否是为EndSite
     //! \remarks 该属性将影响序列化
-    void setAsEndSite(bool isEndSite = true) { m_isEndSite = isEndSite; }
+    void setAsEndSite(bool isEndSite = true);
 
     //!
     //! \brief apendChild 添加一个子节点
@@ -260,6 +308,7 @@ public:
     //! \param child 孩子节点的指针
     //! \param bRecursive 是否递归搜索
     //! \return 如果指定的额节点被找到则返回true，否则返回false。
+    //! \remarks The recursive search walks up from \a child , it costs O(depth).
     //!
     bool isChildInTree(Joint* child , bool bRecursive = true) const;
 
@@ -273,15 +322,17 @@ public:
     //!
     //! \brief children 返回孩子节点的列表
     //! \return 孩子节点的列表
-    //! \remarks 可以利用返回的列表修改孩子节点的属性
+    //! \remarks 可以利用返回的列表修改孩子节点的属性. Add and remove children only through
+    //!          apendChild() and removeChild() , the cached depth and traversal data depend on it.
     const std::vector<Joint*>& children() const { return m_children; }
     std::vector<Joint*>& children() { return m_children; }
 
     //!
     //! \brief depth 返回节点的深度
     //! \return 节点的深读
-    //! \remarks 如果一个节点没有父节点则其深度为0
-    int depth() const { return calcDepth(); }
+    //! \remarks 如果一个节点没有父节点则其深度为0. The depth is cached and updated when the
+    //!          joint is moved.
+    int depth() const { return m_depth; }
 
     //!
     //! \brief parent 获取节点的父节点
@@ -296,6 +347,46 @@ public:
     //!
     Joint* childAt(int index) const;
 
+    //!
+    //! \brief preOrder The joint and its descendants , parents before children.
+    //!
+    JointRange<PreOrderIterator> preOrder();
+
+    //!
+    //! \brief postOrder The joint and its descendants , children before parents.
+    //!
+    JointRange<PostOrderIterator> postOrder();
+
+    //!
+    //! \brief nextPreOrder The joint after \a joint in a pre-order walk of the subtree of \a root.
+    //! \param skipChildren Continue after the subtree of \a joint
+    //! \return nullptr at the end of the walk
+    //!
+    static Joint* nextPreOrder(const Joint* joint , const Joint* root , bool skipChildren = false);
+
+    //!
+    //! \brief firstPostOrder The first joint of a post-order walk of the subtree of \a root.
+    //!
+    static Joint* firstPostOrder(Joint* root);
+
+    //!
+    //! \brief nextPostOrder The joint after \a joint in a post-order walk of the subtree of \a root.
+    //!
+    static Joint* nextPostOrder(const Joint* joint , const Joint* root);
+
+    //!
+    //! \brief channelJoints The joints of this subtree which have channels , in frame order.
+    //! \remarks The list is built on the first call after the hierarchy changed and cached until
+    //!          the next change , so the first call must not race with other threads.
+    //!
+    const std::vector<Joint*>& channelJoints() const;
+
+    //!
+    //! \brief revision Changes whenever a joint of this subtree is added , removed , renamed ,
+    //!        gets a new offset or gains , loses or reorders channels.
+    //!
+    uint64_t revision() const { return m_revision; }
+
     //!
     //! \brief childrenCount 获取拥有的子节点的数量
     //! \return 子节点的数量
@@ -305,15 +396,46 @@ public:
 
     AxisOrder rotationAxisOrder() const { return m_rotationOrder; }
 
-    void setPositionAxisOrder(AxisOrder order) { m_positonOrder = order; }
-    void setRotationAxisOrder(AxisOrder order) { m_rotationOrder = order; }
+    void setPositionAxisOrder(AxisOrder order);
+    void setRotationAxisOrder(AxisOrder order);
+
+    //!
+    //! \brief channelCount The number of channels , 6 with position channels and 3 without.
+    //!
+    size_t channelCount() const { return m_positonOrder == AxisOrder::Invalid ? 3 : 6; }
+
+    //!
+    //! \brief pushData Append one value to the motion of the joint.
+    //! \remarks If the joint is bound to the motion store of a document its values are copied
+    //!          out of the store first , call BvhDocument::packMotion() to bind it again.
+    //!
+    void pushData(float data);
 
-    void pushData(float data) { m_frameData.push_back(data); }
-    const std::vector<float>& frameData() const { return m_frameData; }
-    std::vector<float>& frameData() { return m_frameData; }
+    //!
+    //! \brief frameData The motion values of the joint.
+    //! \remarks The values live in the MotionStore of the document when the joint is bound to one
+    //!          and in the joint otherwise , the view hides the difference.
+    //!
+    ConstFrameDataView frameData() const;
+    FrameDataView frameData();
+
+    //!
+    //! \brief setFrameData Replace the motion values , the joint is unbound from its store.
+    //!
+    void setFrameData(const std::vector<float>& data);
 
     size_t frameCount() const;
 
+    //!
+    //! \brief motionStore The store holding the motion values , nullptr if the joint holds them itself.
+    //!
+    MotionStore* motionStore() const { return m_motion.get(); }
+
+    //!
+    //! \brief channelOffset The first column of the joint in the rows of motionStore().
+    //!
+    size_t channelOffset() const { return m_channelOffset; }
+
 protected:
 
     //!
@@ -323,6 +445,24 @@ protected:
     //!
     int calcDepth() const;
 private:
+    friend class MotionStore;
+
+    void unbindMotion();
+
+    //!
+    //! \brief hierarchyChanged Drop the cached channel joints of this joint and its ancestors.
+    //!
+    void hierarchyChanged();
+
+    //!
+    //! \brief touch Advance the revision of this joint and its ancestors.
+    //!
+    void touch();
+
+    //!
+    //! \brief updateDepth Recompute the cached depth of this subtree after it was moved.
+    //!
+    void updateDepth();
 
     Joint(const Joint& other) = delete;
     Joint& operator = (const Joint& other) = delete;
@@ -354,11 +494,142 @@ private:
     //!
     std::vector<Joint*> m_children;
 
+    //!
+    //! \brief m_depth 节点的深度
+    //!
+    int m_depth = 0;
+
+    //!
+    //! \brief m_indexInParent The index of the joint in the children of its parent
+    //!
+    size_t m_indexInParent = 0;
+
+    mutable std::vector<Joint*> m_channelJoints;
+    mutable bool m_channelJointsValid = false;
+    uint64_t m_revision = 0;
+
+    //!
+    //! \brief m_frameData The motion values while the joint is not bound to a store
+    //!
     std::vector<float> m_frameData;
+
+    std::shared_ptr<MotionStore> m_motion;
+    size_t m_channelOffset = 0;
 };
 
+template <bool PostOrder>
+JointIterator<PostOrder>& JointIterator<PostOrder>::operator ++ ()
+{
+    m_joint = PostOrder ? Joint::nextPostOrder(m_joint , m_root) : Joint::nextPreOrder(m_joint , m_root);
+    return *this;
+}
+
+template <bool PostOrder>
+JointIterator<PostOrder>& JointIterator<PostOrder>::skipChildren()
+{
+    m_joint = Joint::nextPreOrder(m_joint , m_root , true);
+    return *this;
+}
+
+inline JointRange<PreOrderIterator> Joint::preOrder()
+{
+    return JointRange<PreOrderIterator>(PreOrderIterator(this , this) , PreOrderIterator(nullptr , this));
+}
+
+inline JointRange<PostOrderIterator> Joint::postOrder()
+{
+    return JointRange<PostOrderIterator>(PostOrderIterator(firstPostOrder(this) , this) , PostOrderIterator(nullptr , this));
+}
+
+//!
+//! \brief SubstractJoints Copy the hierarchy with the finger Nub joints collapsed into End Sites.
+//! \remarks The new joints share the MotionStore of \a src if no Nub has channels , otherwise their
+//!          store copies the kept columns on its first access , as pruneDocument() in prune.h does.
+//!          Joints which are not bound to one store are copied into one first.
+//!
 Joint* SubstractJoints(const Joint* src);
 
+//!
+//! \brief sequenceJoint The joints which have channels , in the order their values appear in a frame.
+//! \param j The root of the hierarchy
+//! \remarks Returns a copy of Joint::channelJoints().
+//!
+std::vector<Joint*> sequenceJoint(Joint* j);
+
+class BvhTokenizer;
+class RotationCache;
+class JointNameIndex;
+class ParseCache;
+class Skeleton;
+
+//!
+//! \brief readBvhHeader Read the HIERARCHY and the MOTION header up to the "Frame Time" line.
+//! \param frameCount The value of the "Frames:" line
+//! \param frameInterval The value of the "Frame Time:" line
+//! \return The root joint , or nullptr if the header is malformed
+//! \remarks On success the tokenizer is positioned at the first frame line.
+//!
+Joint* readBvhHeader(BvhTokenizer& tk , int& frameCount , float& frameInterval);
+
+//!
+//! \brief The ParseOptions struct Options which control how a bvh file is parsed.
+//!
+struct ParseOptions {
+    //!
+    //! \brief exactFloats Convert every motion value to the nearest float.
+    //! \remarks The default scanner is exact for the usual fixed point values found in bvh files
+    //!          and may be one ulp off for values with many significant digits or large exponents.
+    //!
+    bool exactFloats = false;
+
+    //!
+    //! \brief threadCount The number of threads which parse the MOTION block.
+    //! \remarks 1 parses on the calling thread, 0 uses every hardware thread.
+    //!
+    unsigned threadCount = 1;
+
+    //!
+    //! \brief parallelThreshold MOTION blocks smaller than this many bytes are always parsed serially.
+    //!
+    size_t parallelThreshold = 1 << 20;
+
+    //!
+    //! \brief lazyMotion Read only the HIERARCHY and the MOTION header when the file is opened.
+    //! \remarks The frames are decoded on the first access to the motion , e.g. frameData() ,
+    //!          frameCount() or motion(). The file stays mapped until then.
+    //!
+    bool lazyMotion = false;
+
+    //!
+    //! \brief sharedSkeleton Keep no Joint tree , only the interned skeleton and the motion.
+    //! \remarks For documents which are only read: skeleton() , motion() , pose() , toFile() and
+    //!          toBinaryFile() work without joints. rootJoint() , findJoint() and rotations() build the
+    //!          tree from the skeleton on their first call and bind it to the motion. Skeletons are
+    //!          shared by value , so an offset of -0 may be written as 0.
+    //!
+    bool sharedSkeleton = false;
+
+    //!
+    //! \brief cache Look the file up in this cache first , nullptr parses the text every time.
+    //!
+    ParseCache* cache = nullptr;
+};
+
+//!
+//! \brief The WriteOptions struct Options which control how a bvh file is written.
+//!
+struct WriteOptions {
+    //!
+    //! \brief precision The number of decimals of every motion value.
+    //! \remarks The default of 8 writes the same text as earlier versions byte for byte.
+    //!
+    int precision = 8;
+
+    //!
+    //! \brief threadCount The number of threads which format frames , 0 uses every hardware thread.
+    //!
+    unsigned threadCount = 1;
+};
 
 
 class BvhDocument {
@@ -379,7 +650,13 @@ public:
     //! 销毁一个对象
     ~BvhDocument();
 
-    bool isEmpty() const { return m_rootJoint == nullptr; }
+    bool isEmpty() const { return m_rootJoint == nullptr && !m_skeleton; }
+
+    //!
+    //! \brief hasJoints Whether the Joint tree exists , false for a document opened with
+    //!        ParseOptions::sharedSkeleton until the tree is first needed.
+    //!
+    bool hasJoints() const { return m_rootJoint != nullptr; }
 
     //!
     //! \brief unloadRootJoint 将拥有的RootJoint卸载
@@ -396,34 +673,170 @@ public:
     //!
     //! \brief rootJoint 获取根节点的指针
     //! \return 根节点的指针
+    //! \remarks Without a tree it is built from skeleton() here , the first call must not race
+    //!          with other threads.
     //!
-    Joint* rootJoint() const { return m_rootJoint; }
+    Joint* rootJoint() const;
 
     //!
     //! \brief writeToFile 将节点信息和帧信息写到文件中去
     //! \param filename 创建的文件的名称
     //! \return 如果创建并且写入并且写入成功则返回真，负责返回假
     //!
-    bool toFile(const std::string& filename) const;
+    bool toFile(const std::string& filename , const WriteOptions& options = WriteOptions()) const;
+
+    //!
+    //! \brief toBinaryFile Write the document in the binary .bvhb format.
+    //! \remarks The file holds the flattened hierarchy followed by the motion matrix exactly as it is
+    //!          laid out in the MotionStore , aligned to 64 bytes so that it can be mapped directly.
+    //!
+    bool toBinaryFile(const std::string& filename) const;
 
     void  setFrameInterval(float interval) { m_frameInterval = interval; }
     float frameInterval() const { return m_frameInterval; }
+
+    //!
+    //! \brief frameCount The number of frames in the motion store.
+    //!
+    size_t frameCount() const { return m_motion ? m_motion->frameCount() : 0; }
+
+    //!
+    //! \brief channelCount The number of values in one frame.
+    //!
+    size_t channelCount() const { return m_motion ? m_motion->channelCount() : 0; }
+
+    //!
+    //! \brief isMotionLoaded Whether the frames are decoded , false until the first access to the
+    //!        motion of a document opened with ParseOptions::lazyMotion.
+    //!
+    bool isMotionLoaded() const { return !m_motion || m_motion->isLoaded(); }
+
+    //!
+    //! \brief motion The frame-major motion matrix shared by all joints of the document.
+    //!
+    const std::shared_ptr<MotionStore>& motion() const { return m_motion; }
+
+    //!
+    //! \brief currentMotion The motion in the layout of the joints: motion() while the joints are
+    //!        bound to it , otherwise a copy of their current values.
+    //!
+    std::shared_ptr<MotionStore> currentMotion() const;
+
+    //!
+    //! \brief pose The values of all channels in frame \a frame.
+    //!
+    Span<const float> pose(size_t frame) const;
+    Span<float> pose(size_t frame);
+
+    //!
+    //! \brief channelColumn The values of channel \a channel over all frames.
+    //!
+    StridedSpan<const float> channelColumn(size_t channel) const;
+
+    //!
+    //! \brief channelColumn The values of the \a channel-th channel of \a joint over all frames.
+    //! \param channel 0 - 2 are the position x , y , z (for joints with position channels) ,
+    //!                the following three the rotation x , y , z
+    //!
+    StridedSpan<const float> channelColumn(const Joint* joint , size_t channel) const;
+
+    //!
+    //! \brief packMotion Rebuild the motion store from the joints of the hierarchy.
+    //! \remarks Call this after joints were added , removed or their channels changed.
+    //!
+    void packMotion();
+
+    //!
+    //! \brief rotations The rotation channels of every joint as quaternions.
+    //! \remarks Built on the first call and kept until the motion store , its frame count or the
+    //!          hierarchy changes , the reference stays valid until a later call rebuilds it. Call
+    //!          invalidateRotations() after editing rotation values in place. The first call must
+    //!          not race with other threads.
+    //!
+    const RotationCache& rotations() const;
+    void invalidateRotations() { m_rotations.reset(); }
+
+    //!
+    //! \brief findJoint The first joint named \a name in pre-order , nullptr if there is none.
+    //! \remarks The lookup uses a hash index which is rebuilt only after the hierarchy changed ,
+    //!          see Joint::revision(). The first call after a change must not race with other threads.
+    //!
+    Joint* findJoint(const std::string& name) const;
+
+    //!
+    //! \brief channelOffsetOf The first column of the joint named \a name in a frame , -1 if the
+    //!        joint does not exist or has no channels.
+    //!
+    int channelOffsetOf(const std::string& name) const;
+
+    //!
+    //! \brief skeleton The hierarchy , shared through SkeletonRegistry::globalInstance().
+    //! \remarks Documents with identical hierarchies return the same object. fromFile() and
+    //!          fromBinaryFile() look it up , later it is looked up again only after the hierarchy
+    //!          changed , see Joint::revision(). The first call after a change must not race with
+    //!          other threads.
+    //!
+    std::shared_ptr<const Skeleton> skeleton() const;
+
+    //!
+    //! \brief hasSameSkeleton Whether both documents have identical hierarchies , a pointer compare
+    //!        once their skeletons were looked up.
+    //!
+    bool hasSameSkeleton(const BvhDocument& other) const { return !isEmpty() && skeleton() == other.skeleton(); }
 private:
     BvhDocument(const BvhDocument& other) = delete;
     BvhDocument& operator = (const BvhDocument& other) = delete;
 
     //!
-    //! \brief m_rootJoint 根节点
+    //! \brief adoptHierarchy Own \a root and look its skeleton up , with \a sharedSkeleton only the
+    //!        skeleton is kept and \a root is deleted.
+    //!
+    void adoptHierarchy(Joint* root , bool sharedSkeleton);
+
+    //!
+    //! \brief m_rootJoint 根节点 , built by rootJoint() for a document which keeps only the skeleton
     //!
-    Joint* m_rootJoint;
+    mutable Joint* m_rootJoint;
 
     //!
     //! \brief m_frameInterval 一帧持续的时间
     //!
     float m_frameInterval;
 
+    //!
+    //! \brief m_motion 所有节点的帧数据
+    //!
+    std::shared_ptr<MotionStore> m_motion;
+
+    //!
+    //! \brief m_rotations The quaternions of m_motion , built by rotations()
+    //!
+    mutable std::shared_ptr<RotationCache> m_rotations;
+
+    //!
+    //! \brief m_nameIndex The joints by name , built by findJoint()
+    //!
+    mutable std::shared_ptr<JointNameIndex> m_nameIndex;
+
+    //!
+    //! \brief m_skeleton The interned hierarchy of the root joint in the revision m_skeletonRevision ,
+    //!        the whole hierarchy if there is no root joint
+    //!
+    mutable std::shared_ptr<const Skeleton> m_skeleton;
+    mutable const Joint* m_skeletonRoot = nullptr;
+    mutable uint64_t m_skeletonRevision = 0;
+
 public:
-    static BvhDocument fromFile(const std::string& filename);
+    static BvhDocument fromFile(const std::string& filename , const ParseOptions& options = ParseOptions());
+
+    //!
+    //! \brief fromBinaryFile Open a file written by toBinaryFile().
+    //! \remarks Only the hierarchy is read , the motion matrix is used straight from a copy-on-write
+    //!          mapping of the file and its pages are read when they are first touched.
+    //!          An empty document is returned if the file is not a valid .bvhb file. Of \a options
+    //!          only ParseOptions::sharedSkeleton is used.
+    //!
+    static BvhDocument fromBinaryFile(const std::string& filename , const ParseOptions& options = ParseOptions());
 };
 
 }
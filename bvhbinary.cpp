@@ -0,0 +1,153 @@
+﻿#include "bvh.h"
+#include "jointrecords.h"
+#include "mappedfile.h"
+#include "skeleton.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+using namespace BVH;
+
+//!
+//! Layout of a .bvhb file , all values in the byte order of the host which wrote it. The
+//! header holds ByteOrderMark , a file of the other byte order is rejected by fromBinaryFile():
+//!
+//!     BinaryHeader
+//!     BinaryJoint[jointCount]     every joint including End Sites in pre-order
+//!     char[namesSize]             the joint names , not null terminated
+//!     padding up to motionOffset  a multiple of 64
+//!     float[frameCount][channelCount]
+//!
+//! The motion rows use the layout of MotionStore: position x , y , z (if present) and
+//! rotation x , y , z of every joint with channels , in the order of sequenceJoint().
+//!
+
+static const char BinaryMagic[4] = { 'B' , 'V' , 'H' , 'B' };
+static const uint32_t BinaryVersion = 1;
+static const uint32_t ByteOrderMark = 0x01020304;
+
+struct BinaryHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t jointCount;
+    uint32_t channelCount;
+    float frameInterval;
+    uint64_t frameCount;
+    uint64_t namesOffset;
+    uint64_t namesSize;
+    uint64_t motionOffset;
+};
+
+static_assert(sizeof(BinaryHeader) == 56 , "unexpected padding in BinaryHeader");
+
+static uint64_t alignTo64(uint64_t value)
+{
+    return (value + 63) / 64 * 64;
+}
+
+bool BvhDocument::toBinaryFile(const std::string &filename) const
+{
+    //! The own joints keep the sign of zero offsets , the interned skeleton may stem from an equal hierarchy
+    std::shared_ptr<const Skeleton> skeleton = m_rootJoint ? std::make_shared<const Skeleton>(m_rootJoint) : m_skeleton;
+    if (!skeleton)
+        return false;
+
+    std::shared_ptr<MotionStore> motion = currentMotion();
+
+    std::vector<BinaryJoint> records;
+    std::string names;
+    toJointRecords(*skeleton , records , names);
+
+    BinaryHeader header;
+    std::memset(&header , 0 , sizeof(header));
+    std::memcpy(header.magic , BinaryMagic , sizeof(BinaryMagic));
+    header.version = BinaryVersion;
+    header.byteOrder = ByteOrderMark;
+    header.jointCount = static_cast<uint32_t>(skeleton->jointCount());
+    header.channelCount = static_cast<uint32_t>(motion->channelCount());
+    header.frameInterval = m_frameInterval;
+    //! Frames without channels hold no values , fromBinaryFile() rejects a count for them
+    header.frameCount = motion->channelCount() != 0 ? motion->frameCount() : 0;
+    header.namesOffset = sizeof(BinaryHeader) + records.size() * sizeof(BinaryJoint);
+    header.namesSize = names.size();
+    header.motionOffset = alignTo64(header.namesOffset + header.namesSize);
+
+    std::FILE* file = std::fopen(filename.c_str() , "wb");
+    if (!file)
+        return false;
+
+    bool ok = std::fwrite(&header , sizeof(header) , 1 , file) == 1;
+    ok = ok && (records.empty() || std::fwrite(records.data() , sizeof(BinaryJoint) , records.size() , file) == records.size());
+    ok = ok && (names.empty() || std::fwrite(names.data() , 1 , names.size() , file) == names.size());
+
+    const char padding[64] = { 0 };
+    size_t paddingSize = static_cast<size_t>(header.motionOffset - header.namesOffset - header.namesSize);
+    ok = ok && (paddingSize == 0 || std::fwrite(padding , 1 , paddingSize , file) == paddingSize);
+
+    size_t valueCount = motion->frameCount() * motion->channelCount();
+    ok = ok && (valueCount == 0 || std::fwrite(motion->data() , sizeof(float) , valueCount , file) == valueCount);
+
+    if (std::fclose(file) != 0)
+        ok = false;
+    return ok;
+}
+
+BvhDocument BvhDocument::fromBinaryFile(const std::string &filename , const ParseOptions &options)
+{
+    std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+    if (!file->open(filename , MappedFile::CopyOnWrite))
+        return BvhDocument();
+
+    BinaryHeader header;
+    if (file->size() < sizeof(header))
+        return BvhDocument();
+    std::memcpy(&header , file->data() , sizeof(header));
+
+    if (std::memcmp(header.magic , BinaryMagic , sizeof(BinaryMagic)) != 0 ||
+        header.version != BinaryVersion || header.byteOrder != ByteOrderMark || header.jointCount == 0)
+        return BvhDocument();
+
+    const uint64_t recordsEnd = sizeof(BinaryHeader) + uint64_t(header.jointCount) * sizeof(BinaryJoint);
+    if (header.namesOffset != recordsEnd || header.motionOffset < header.namesOffset ||
+        header.namesSize > header.motionOffset - header.namesOffset ||
+        header.motionOffset % 64 != 0 || header.motionOffset > file->size())
+        return BvhDocument();
+
+    //! Frames without channels take no bytes , so their count can not be checked against the file
+    if (header.channelCount == 0 ? header.frameCount != 0 :
+        header.frameCount > (file->size() - header.motionOffset) / (uint64_t(header.channelCount) * sizeof(float)))
+        return BvhDocument();
+    const uint64_t motionSize = header.frameCount * header.channelCount * sizeof(float);
+
+    Joint* root = fromJointRecords(file->data() + sizeof(BinaryHeader) , header.jointCount ,
+                                   file->data() + header.namesOffset , header.namesSize);
+    if (!root)
+        return BvhDocument();
+
+    const std::vector<Joint*>& jointSequence = root->channelJoints();
+    size_t channelCount = 0;
+    for (const Joint* joint : jointSequence)
+    {
+        channelCount += joint->channelCount();
+    }
+    if (channelCount != header.channelCount)
+    {
+        delete root;
+        return BvhDocument();
+    }
+
+    BvhDocument doc;
+    doc.m_frameInterval = header.frameInterval;
+    if (motionSize == 0)
+    {
+        doc.m_motion = MotionStore::create(jointSequence , header.frameCount);
+    }
+    else
+    {
+        float* data = reinterpret_cast<float*>(file->writableData() + header.motionOffset);
+        doc.m_motion = MotionStore::wrap(jointSequence , data , header.frameCount , file);
+    }
+    doc.adoptHierarchy(root , options.sharedSkeleton);
+    return doc;
+}
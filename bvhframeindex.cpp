@@ -0,0 +1,143 @@
+﻿#include "bvhframeindex.h"
+#include "bvhtokenizer.h"
+#include "channellayout.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace BVH;
+
+BvhFrameIndex::BvhFrameIndex()
+{
+
+}
+
+BvhFrameIndex::~BvhFrameIndex()
+{
+    close();
+}
+
+bool BvhFrameIndex::open(const std::string &filename , size_t stride)
+{
+    close();
+    if (!m_file.open(filename , MappedFile::RandomAccess))
+        return false;
+
+    BvhTokenizer tk(m_file.begin() , m_file.end());
+    int declaredFrameCount = 0;
+    Joint* root = readBvhHeader(tk , declaredFrameCount , m_frameInterval);
+    if (!root)
+    {
+        close();
+        return false;
+    }
+    m_skeleton = Skeleton(root);
+    delete root;
+
+    m_headerSize = static_cast<size_t>(tk.position() - m_file.begin());
+    m_stride = stride > 0 ? stride : 1;
+    if (declaredFrameCount > 0)
+        m_offsets.reserve(static_cast<size_t>(declaredFrameCount) / m_stride + 1);
+
+    //! Every line with a word is a frame line , load() checks their numbers
+    size_t frameCount = 0;
+    BvhTokenizer in(m_file.begin() + m_headerSize , m_file.end());
+    const char* lineStart = in.position();
+    while (in.nextLine())
+    {
+        if (frameCount % m_stride == 0)
+            m_offsets.push_back(static_cast<uint64_t>(lineStart - m_file.begin()));
+        ++frameCount;
+        lineStart = in.position();
+    }
+    m_frameCount.store(frameCount , std::memory_order_relaxed);
+    return true;
+}
+
+void BvhFrameIndex::close()
+{
+    m_file.close();
+    m_skeleton = Skeleton();
+    m_headerSize = 0;
+    m_stride = DefaultStride;
+    m_frameCount.store(0 , std::memory_order_relaxed);
+    m_frameInterval = 0.0f;
+    m_offsets.clear();
+}
+
+size_t BvhFrameIndex::frameAt(double seconds) const
+{
+    const size_t frameCount = this->frameCount();
+    if (frameCount == 0 || !(seconds > 0.0) || !(m_frameInterval > 0.0f))
+        return 0;
+
+    //! A small tolerance so that a time written from frame * interval maps back to that frame
+    double frame = std::floor(seconds / m_frameInterval + 1e-6);
+    if (frame >= static_cast<double>(frameCount - 1))
+        return frameCount - 1;
+    return static_cast<size_t>(frame);
+}
+
+BvhDocument BvhFrameIndex::load(size_t first , size_t last , const ParseOptions &options) const
+{
+    if (!isOpen())
+        return BvhDocument();
+
+    Joint* root = m_skeleton.createJoints();
+    if (!root)
+        return BvhDocument();
+
+    if (last > frameCount())
+        last = frameCount();
+    if (first > last)
+        first = last;
+
+    const std::vector<Joint*>& jointSequence = root->channelJoints();
+    std::shared_ptr<MotionStore> motion = MotionStore::create(jointSequence , last - first);
+    ChannelLayout layout(jointSequence);
+    const size_t channelCount = layout.channelCount();
+
+    size_t frames = 0;
+    if (first < last)
+    {
+        BvhTokenizer in(m_file.begin() + m_offsets[first / m_stride] , m_file.end());
+        for (size_t skip = first % m_stride; skip > 0 && in.nextLine(); --skip)
+        {
+        }
+
+        std::vector<float> row(channelCount);
+        while (frames < last - first && in.nextLine())
+        {
+            //! 数据不完整的行表示帧数据的结束
+            if (in.nextFloats(row.data() , channelCount , options.exactFloats) != channelCount)
+                break;
+            layout.scatter(row.data() , motion->row(frames));
+            ++frames;
+        }
+
+        //! The lines before last exist , so only a malformed line ends the loop early
+        if (frames < last - first)
+        {
+            size_t count = m_frameCount.load(std::memory_order_relaxed);
+            while (first + frames < count && !m_frameCount.compare_exchange_weak(count , first + frames))
+            {
+            }
+        }
+    }
+    motion->resize(frames);
+
+    BvhDocument doc;
+    doc.loadRootJoint(root);
+    doc.setFrameInterval(m_frameInterval);
+    return doc;
+}
+
+BvhDocument BvhFrameIndex::loadTime(double begin , double end , const ParseOptions &options) const
+{
+    if (!(m_frameInterval > 0.0f))
+        return load(0 , frameCount() , options);
+
+    size_t first = frameAt(begin);
+    double frames = std::ceil(end / m_frameInterval - 1e-6);
+    size_t last = frames > static_cast<double>(first) ? static_cast<size_t>(std::min(frames , static_cast<double>(frameCount()))) : first;
+    return load(first , last , options);
+}
@@ -0,0 +1,86 @@
+﻿#ifndef BVHFRAMEINDEX_H
+#define BVHFRAMEINDEX_H
+
+#include <cstddef>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "bvh.h"
+#include "mappedfile.h"
+#include "skeleton.h"
+
+namespace BVH {
+
+//!
+//! \brief The BvhFrameIndex class Random access to the frames of a text bvh file.
+//! \remarks open() maps the file , reads the header and records the byte offset of every
+//!          stride()-th frame line in one newline scan , no number is converted. load() then
+//!          parses only the frames of the requested range and builds the hierarchy from a
+//!          Skeleton kept by open() , it costs time proportional to the range and not to the file.
+//!          The file stays mapped while the index is open.
+//!
+class BvhFrameIndex {
+public:
+    static const size_t DefaultStride = 256;
+
+    BvhFrameIndex();
+    ~BvhFrameIndex();
+
+    //!
+    //! \brief open Map a bvh file and index its frame lines.
+    //! \param stride The number of frame lines between two recorded offsets
+    //! \return false if the file cannot be read or the header is malformed
+    //!
+    bool open(const std::string& filename , size_t stride = DefaultStride);
+    void close();
+    bool isOpen() const { return m_file.isOpen() && m_headerSize > 0; }
+
+    //!
+    //! \brief frameCount The number of frame lines after the header.
+    //! \remarks As in BvhDocument::fromFile() a line with fewer numbers than channels ends the
+    //!          frames. open() does not convert the lines , so the count drops to the frames before
+    //!          such a line once load() reaches it. A range after it which is loaded earlier is
+    //!          still returned.
+    //!
+    size_t frameCount() const { return m_frameCount.load(std::memory_order_relaxed); }
+    float frameInterval() const { return m_frameInterval; }
+    size_t stride() const { return m_stride; }
+
+    //!
+    //! \brief offsets The byte offset of the frame lines 0 , stride() , 2 * stride() ...
+    //!
+    const std::vector<uint64_t>& offsets() const { return m_offsets; }
+
+    //!
+    //! \brief frameAt The frame shown at \a seconds , clamped to the frames of the file.
+    //!
+    size_t frameAt(double seconds) const;
+
+    //!
+    //! \brief load Build the hierarchy and parse the frames [first , last).
+    //! \return An empty document if the index is not open , the range is clamped to frameCount()
+    //!
+    BvhDocument load(size_t first , size_t last , const ParseOptions& options = ParseOptions()) const;
+
+    //!
+    //! \brief loadTime Build the hierarchy and parse the frames shown in [begin , end) seconds.
+    //!
+    BvhDocument loadTime(double begin , double end , const ParseOptions& options = ParseOptions()) const;
+
+private:
+    BvhFrameIndex(const BvhFrameIndex& other) = delete;
+    BvhFrameIndex& operator = (const BvhFrameIndex& other) = delete;
+
+    MappedFile m_file;
+    Skeleton m_skeleton;        //!< The hierarchy of the header , parsed once by open()
+    size_t m_headerSize = 0;    //!< The offset of the first frame line
+    size_t m_stride = DefaultStride;
+    mutable std::atomic<size_t> m_frameCount{0};   //!< Lowered by load() at a malformed line
+    float m_frameInterval = 0.0f;
+    std::vector<uint64_t> m_offsets;
+};
+
+}
+
+#endif // BVHFRAMEINDEX_H
@@ -8,6 +8,10 @@ TEMPLATE = app
 # Enable C++2011 features
 CONFIG += c++11
 
+# The motion parser and the batch tools use std::thread
+CONFIG += thread
+unix: LIBS += -pthread
+
 # Target dir
 DESTDIR = $$PWD/bin
 
@@ -61,9 +65,52 @@ CONFIG(debug,debug|release){
 }
 
 HEADERS += \
-    bvh.h
+    archive.h \
+    bvh.h \
+    bvhframeindex.h \
+    bvhstreamreader.h \
+    bvhtokenizer.h \
+    channellayout.h \
+    floatscanner.h \
+    forwardkinematics.h \
+    jointrecords.h \
+    keyframes.h \
+    mappedfile.h \
+    motiondata.h \
+    namehash.h \
+    parsecache.h \
+    prune.h \
+    quantize.h \
+    resample.h \
+    retarget.h \
+    rotationkernels.h \
+    skeleton.h \
+    skeletonregistry.h \
+    textwriter.h \
+    threadpool.h
 
 SOURCES += \
+    archive.cpp \
     bvh.cpp \
+    bvhbinary.cpp \
+    bvhframeindex.cpp \
+    bvhstreamreader.cpp \
+    channellayout.cpp \
+    floatscanner.cpp \
+    forwardkinematics.cpp \
+    jointrecords.cpp \
+    keyframes.cpp \
+    mappedfile.cpp \
+    motiondata.cpp \
+    parsecache.cpp \
+    prune.cpp \
+    quantize.cpp \
+    resample.cpp \
+    retarget.cpp \
+    rotationkernels.cpp \
+    skeleton.cpp \
+    skeletonregistry.cpp \
+    textwriter.cpp \
+    threadpool.cpp \
     main.cpp
 
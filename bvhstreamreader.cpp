@@ -0,0 +1,159 @@
+﻿#include "bvhstreamreader.h"
+#include "bvhtokenizer.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace BVH;
+
+BvhStreamReader::BvhStreamReader()
+{
+
+}
+
+BvhStreamReader::~BvhStreamReader()
+{
+    close();
+}
+
+bool BvhStreamReader::open(const std::string &filename , const ParseOptions &options)
+{
+    close();
+    m_file = std::fopen(filename.c_str() , "rb");
+    if (!m_file)
+        return false;
+    m_buffer.resize(BufferSize);
+
+    //! Read until the buffer holds the whole "Frame Time" line , the header of a bvh file is
+    //! small but has no size limit , so the buffer grows until it fits.
+    static const char frameTime[] = "Frame Time";
+    const size_t keySize = sizeof(frameTime) - 1;
+    size_t searchFrom = 0;
+    for (;;)
+    {
+        const char* text = m_buffer.data();
+        const char* end = text + m_size;
+        const char* key = std::search(text + searchFrom , end , frameTime , frameTime + keySize);
+        if (key != end && (std::memchr(key , '\n' , end - key) || m_eof))
+            break;
+        searchFrom = m_size > keySize ? m_size - keySize : 0;
+        if (!fill())
+        {
+            //! A file without frames may end in the "Frame Time" line
+            if (key != end)
+                break;
+            close();
+            return false;
+        }
+    }
+
+    BvhTokenizer tk(m_buffer.data() , m_buffer.data() + m_size);
+    m_rootJoint = readBvhHeader(tk , m_declaredFrameCount , m_frameInterval);
+    if (!m_rootJoint)
+    {
+        close();
+        return false;
+    }
+
+    m_layout = ChannelLayout(m_rootJoint->channelJoints());
+    m_line.resize(m_layout.channelCount());
+    m_position = static_cast<size_t>(tk.position() - m_buffer.data());
+    m_exactFloats = options.exactFloats;
+    m_finished = false;
+    return true;
+}
+
+void BvhStreamReader::close()
+{
+    if (m_file)
+        std::fclose(m_file);
+    m_file = nullptr;
+    m_eof = false;
+    m_finished = true;
+
+    m_buffer.clear();
+    m_buffer.shrink_to_fit();
+    m_position = m_size = 0;
+
+    delete m_rootJoint;
+    m_rootJoint = nullptr;
+    m_layout = ChannelLayout();
+    m_line.clear();
+    m_declaredFrameCount = 0;
+    m_frameInterval = 0.0f;
+    m_framesRead = 0;
+}
+
+bool BvhStreamReader::fill()
+{
+    if (!m_file || m_eof)
+        return false;
+
+    if (m_position > 0)
+    {
+        std::memmove(m_buffer.data() , m_buffer.data() + m_position , m_size - m_position);
+        m_size -= m_position;
+        m_position = 0;
+    }
+
+    //! Only a line longer than the buffer makes it grow
+    if (m_size == m_buffer.size())
+        m_buffer.resize(m_buffer.size() * 2);
+
+    size_t n = std::fread(m_buffer.data() + m_size , 1 , m_buffer.size() - m_size , m_file);
+    m_size += n;
+    if (n == 0)
+        m_eof = true;
+    return n > 0;
+}
+
+bool BvhStreamReader::readFrame(float *frame)
+{
+    if (m_finished)
+        return false;
+
+    const size_t channelCount = m_line.size();
+    for (;;)
+    {
+        const char* first = m_buffer.data() + m_position;
+        const char* end = m_buffer.data() + m_size;
+        const char* newline = static_cast<const char*>(std::memchr(first , '\n' , end - first));
+        if (!newline && !m_eof)
+        {
+            fill();
+            continue;
+        }
+        if (first == end)
+        {
+            m_finished = true;
+            return false;
+        }
+
+        const char* lineEnd = newline ? newline : end;
+        m_position = static_cast<size_t>(lineEnd - m_buffer.data()) + (newline ? 1 : 0);
+
+        BvhTokenizer tk(first , lineEnd);
+        if (!tk.nextLine())
+            continue;
+
+        //! 数据不完整的行表示帧数据的结束
+        if (tk.nextFloats(m_line.data() , channelCount , m_exactFloats) != channelCount)
+        {
+            m_finished = true;
+            return false;
+        }
+        m_layout.scatter(m_line.data() , frame);
+        ++m_framesRead;
+        return true;
+    }
+}
+
+size_t BvhStreamReader::readFrames(float *frames , size_t maxFrames)
+{
+    const size_t channelCount = m_line.size();
+    size_t n = 0;
+    while (n < maxFrames && readFrame(frames + n * channelCount))
+    {
+        ++n;
+    }
+    return n;
+}
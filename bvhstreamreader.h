@@ -0,0 +1,105 @@
+﻿#ifndef BVHSTREAMREADER_H
+#define BVHSTREAMREADER_H
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "bvh.h"
+#include "channellayout.h"
+
+namespace BVH {
+
+//!
+//! \brief The BvhStreamReader class Reads the frames of a bvh file one by one with bounded memory.
+//! \remarks open() parses the HIERARCHY and the MOTION header , then readFrame() / readFrames()
+//!          decode the following frame lines into a buffer of the caller. Only a window of the
+//!          file is kept in memory , so captures of any length are read at constant memory.
+//!          The frames are returned in the order of a MotionStore row , see layout().
+//!
+class BvhStreamReader {
+public:
+    static const size_t BufferSize = 1 << 20;
+
+    BvhStreamReader();
+    ~BvhStreamReader();
+
+    //!
+    //! \brief open Open a bvh file and read its header.
+    //! \param options Only exactFloats is used , the frames are always parsed on the calling thread
+    //! \return false if the file cannot be read or the header is malformed
+    //!
+    bool open(const std::string& filename , const ParseOptions& options = ParseOptions());
+    void close();
+    bool isOpen() const { return m_file != nullptr; }
+
+    //!
+    //! \brief rootJoint The hierarchy of the file , owned by the reader.
+    //! \remarks The joints carry no frame data.
+    //!
+    const Joint* rootJoint() const { return m_rootJoint; }
+
+    //!
+    //! \brief layout The mapping between a frame line and a returned frame.
+    //!
+    const ChannelLayout& layout() const { return m_layout; }
+    size_t channelCount() const { return m_layout.channelCount(); }
+
+    //!
+    //! \brief declaredFrameCount The value of the "Frames:" line , the file may hold fewer frames.
+    //!
+    int declaredFrameCount() const { return m_declaredFrameCount; }
+    float frameInterval() const { return m_frameInterval; }
+
+    //!
+    //! \brief framesRead The number of frames returned so far.
+    //!
+    size_t framesRead() const { return m_framesRead; }
+
+    //!
+    //! \brief atEnd Whether the last frame was read , or the frames ended at a malformed line.
+    //!
+    bool atEnd() const { return m_finished; }
+
+    //!
+    //! \brief readFrame Read the next frame into \a frame , which holds channelCount() values.
+    //! \return false at the end of the frames
+    //!
+    bool readFrame(float* frame);
+
+    //!
+    //! \brief readFrames Read up to \a maxFrames frames into \a frames , one row of channelCount() values each.
+    //! \return The number of frames read , less than \a maxFrames only at the end of the frames
+    //!
+    size_t readFrames(float* frames , size_t maxFrames);
+
+private:
+    BvhStreamReader(const BvhStreamReader& other) = delete;
+    BvhStreamReader& operator = (const BvhStreamReader& other) = delete;
+
+    //!
+    //! \brief fill Move the unread text to the front of the buffer and read more of the file.
+    //! \return false if nothing more could be read
+    //!
+    bool fill();
+
+    std::FILE* m_file = nullptr;
+    bool m_eof = false;
+    bool m_finished = true;
+    bool m_exactFloats = false;
+
+    std::vector<char> m_buffer;
+    size_t m_position = 0;          //!< The first unread character
+    size_t m_size = 0;              //!< The end of the text in the buffer
+
+    Joint* m_rootJoint = nullptr;
+    ChannelLayout m_layout;
+    std::vector<float> m_line;
+    int m_declaredFrameCount = 0;
+    float m_frameInterval = 0.0f;
+    size_t m_framesRead = 0;
+};
+
+}
+
+#endif // BVHSTREAMREADER_H
@@ -0,0 +1,176 @@
+﻿#ifndef BVHTOKENIZER_H
+#define BVHTOKENIZER_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include "floatscanner.h"
+
+namespace BVH {
+
+//!
+//! \brief The TextRange struct A non-owning view of characters inside a text buffer.
+//!
+struct TextRange {
+    const char* first = nullptr;
+    const char* last = nullptr;
+
+    size_t size() const { return static_cast<size_t>(last - first); }
+    bool empty() const { return first == last; }
+    std::string toString() const { return std::string(first , last); }
+
+    bool operator == (const char* text) const
+    {
+        size_t n = std::strlen(text);
+        return n == size() && std::memcmp(first , text , n) == 0;
+    }
+    bool operator != (const char* text) const { return !(*this == text); }
+};
+
+//!
+//! \brief The BvhTokenizer class Splits a text buffer into lines and whitespace separated words.
+//! \remarks The tokenizer never copies the buffer, all returned words point into it.
+//!          It mirrors the getline + stringstream idiom: nextLine() selects the next
+//!          non-blank line, then nextWord()/nextFloat()/nextInt() consume that line.
+//!
+class BvhTokenizer {
+public:
+    BvhTokenizer(const char* begin , const char* end)
+        : m_begin(begin) , m_end(end) , m_cursor(begin)
+    {
+
+    }
+
+    static bool isSpace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+    }
+
+    //!
+    //! \brief nextLine Select the next line which contains at least one word.
+    //! \return false if the end of the buffer was reached
+    //!
+    bool nextLine()
+    {
+        while (m_cursor < m_end)
+        {
+            const char* lineEnd = static_cast<const char*>(std::memchr(m_cursor , '\n' , m_end - m_cursor));
+            const char* next = lineEnd ? lineEnd + 1 : m_end;
+            if (!lineEnd)
+                lineEnd = m_end;
+
+            const char* p = m_cursor;
+            while (p < lineEnd && isSpace(*p))
+                ++p;
+
+            m_cursor = next;
+            if (p < lineEnd)
+            {
+                m_word = p;
+                m_lineEnd = lineEnd;
+                return true;
+            }
+        }
+        m_word = m_lineEnd = m_end;
+        return false;
+    }
+
+    //!
+    //! \brief nextWord Read the next word of the current line.
+    //! \return false if the current line has no more words
+    //!
+    bool nextWord(TextRange& word)
+    {
+        const char* p = m_word;
+        while (p < m_lineEnd && isSpace(*p))
+            ++p;
+        if (p == m_lineEnd)
+        {
+            m_word = p;
+            return false;
+        }
+        word.first = p;
+        while (p < m_lineEnd && !isSpace(*p))
+            ++p;
+        word.last = p;
+        m_word = p;
+        return true;
+    }
+
+    bool nextFloat(float& value)
+    {
+        TextRange word;
+        return nextWord(word) && toFloat(word , value);
+    }
+
+    //!
+    //! \brief nextFloats Read up to \a count numbers of the current line into \a out.
+    //! \param exact See scanFloat()
+    //! \return The number of values read
+    //!
+    size_t nextFloats(float* out , size_t count , bool exact)
+    {
+        return scanFloatRow(m_word , m_lineEnd , out , count , exact);
+    }
+
+    bool nextInt(int& value)
+    {
+        TextRange word;
+        if (!nextWord(word))
+            return false;
+        char buffer[32];
+        if (word.size() >= sizeof(buffer))
+            return false;
+        std::memcpy(buffer , word.first , word.size());
+        buffer[word.size()] = '\0';
+        char* parsedEnd = nullptr;
+        long v = std::strtol(buffer , &parsedEnd , 10);
+        if (parsedEnd != buffer + word.size())
+            return false;
+        value = static_cast<int>(v);
+        return true;
+    }
+
+    static bool toFloat(const TextRange& word , float& value)
+    {
+        const char* p = word.first;
+        return scanFloat(p , word.last , value , true) && p == word.last;
+    }
+
+    //!
+    //! \brief position The start of the first line which has not been selected yet.
+    //!
+    const char* position() const { return m_cursor; }
+
+    //!
+    //! \brief seek Continue reading at the given position, the current line is dropped.
+    //!
+    void seek(const char* position)
+    {
+        m_cursor = position;
+        m_word = m_lineEnd = position;
+    }
+
+    const char* begin() const { return m_begin; }
+    const char* end() const { return m_end; }
+
+private:
+    const char* m_begin;
+    const char* m_end;
+
+    //!
+    //! \brief m_cursor The start of the next line
+    //!
+    const char* m_cursor;
+
+    //!
+    //! \brief m_word The read position inside the current line
+    //!
+    const char* m_word = nullptr;
+    const char* m_lineEnd = nullptr;
+};
+
+}
+
+#endif // BVHTOKENIZER_H
@@ -0,0 +1,72 @@
+﻿#include "channellayout.h"
+
+using namespace BVH;
+
+int ChannelLayout::axisPosition(AxisOrder order , int axis)
+{
+    //! For every order the position of x , y and z in the triple
+    static const int positions[6][3] = {
+        { 0 , 1 , 2 } ,   // XYZ
+        { 0 , 2 , 1 } ,   // XZY
+        { 1 , 0 , 2 } ,   // YXZ
+        { 2 , 0 , 1 } ,   // YZX
+        { 1 , 2 , 0 } ,   // ZXY
+        { 2 , 1 , 0 }     // ZYX
+    };
+
+    switch (order)
+    {
+    case AxisOrder::XZY:
+        return positions[1][axis];
+    case AxisOrder::YXZ:
+        return positions[2][axis];
+    case AxisOrder::YZX:
+        return positions[3][axis];
+    case AxisOrder::ZXY:
+        return positions[4][axis];
+    case AxisOrder::ZYX:
+        return positions[5][axis];
+    default:
+        return positions[0][axis];
+    }
+}
+
+ChannelLayout::ChannelLayout()
+{
+
+}
+
+ChannelLayout::ChannelLayout(const std::vector<Joint *> &joints)
+{
+    size_t column = 0;
+    m_joints.reserve(joints.size());
+    for (const Joint* joint : joints)
+    {
+        JointChannels channels;
+        channels.joint = joint;
+        channels.column = column;
+        channels.channelCount = joint->channelCount();
+        channels.positionOrder = joint->positionAxisOrder();
+        channels.rotationOrder = joint->rotationAxisOrder();
+        m_joints.push_back(channels);
+        column += channels.channelCount;
+    }
+
+    m_storeColumns.resize(column);
+    for (const JointChannels& channels : m_joints)
+    {
+        size_t rotation = channels.column;
+        if (channels.channelCount == 6)
+        {
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                m_storeColumns[channels.column + axisPosition(channels.positionOrder , axis)] = static_cast<uint32_t>(channels.column + axis);
+            }
+            rotation += 3;
+        }
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            m_storeColumns[rotation + axisPosition(channels.rotationOrder , axis)] = static_cast<uint32_t>(rotation + axis);
+        }
+    }
+}
@@ -0,0 +1,86 @@
+﻿#ifndef CHANNELLAYOUT_H
+#define CHANNELLAYOUT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "bvh.h"
+
+namespace BVH {
+
+//!
+//! \brief The ChannelLayout class The compiled mapping between a frame line and a motion store row.
+//! \remarks A frame line lists the channels of every joint in the axis order of the file , a row of
+//!          the MotionStore always keeps position x , y , z and rotation x , y , z. The hierarchy is
+//!          compiled once into one target column per file column , so reading and writing a frame
+//!          are branch free gather / scatter loops instead of a switch per joint and value.
+//!
+class ChannelLayout {
+public:
+
+    //!
+    //! \brief The JointChannels struct The channels of one joint.
+    //!
+    struct JointChannels {
+        const Joint* joint = nullptr;
+        size_t column = 0;          //!< The first column of the joint , in the file and in the store
+        size_t channelCount = 0;    //!< 3 or 6
+        AxisOrder positionOrder = AxisOrder::Invalid;
+        AxisOrder rotationOrder = AxisOrder::Invalid;
+    };
+
+    ChannelLayout();
+
+    //!
+    //! \brief ChannelLayout Compile the layout of the joints which have channels.
+    //! \param joints The joints in file order
+    //!
+    explicit ChannelLayout(const std::vector<Joint*>& joints);
+
+    size_t channelCount() const { return m_storeColumns.size(); }
+    const std::vector<JointChannels>& joints() const { return m_joints; }
+
+    //!
+    //! \brief storeColumns The store column of every file column.
+    //!
+    const std::vector<uint32_t>& storeColumns() const { return m_storeColumns; }
+
+    //!
+    //! \brief scatter Reorder a frame line in file order into a store row.
+    //!
+    void scatter(const float* fileRow , float* storeRow) const
+    {
+        const uint32_t* columns = m_storeColumns.data();
+        const size_t count = m_storeColumns.size();
+        for (size_t i = 0; i < count; ++i)
+        {
+            storeRow[columns[i]] = fileRow[i];
+        }
+    }
+
+    //!
+    //! \brief gather Reorder a store row into the order of a frame line.
+    //!
+    void gather(const float* storeRow , float* fileRow) const
+    {
+        const uint32_t* columns = m_storeColumns.data();
+        const size_t count = m_storeColumns.size();
+        for (size_t i = 0; i < count; ++i)
+        {
+            fileRow[i] = storeRow[columns[i]];
+        }
+    }
+
+    //!
+    //! \brief axisPosition The position of axis \a axis (0 = x , 1 = y , 2 = z) in a triple of \a order.
+    //!
+    static int axisPosition(AxisOrder order , int axis);
+
+private:
+    std::vector<JointChannels> m_joints;
+    std::vector<uint32_t> m_storeColumns;
+};
+
+}
+
+#endif // CHANNELLAYOUT_H
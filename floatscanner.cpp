@@ -0,0 +1,70 @@
+﻿#include "floatscanner.h"
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+
+#include <locale.h>
+#ifdef __APPLE__
+#include <xlocale.h>
+#endif
+
+const double BVH::powersOfTen[23] = {
+    1e0 , 1e1 , 1e2 , 1e3 , 1e4 , 1e5 , 1e6 , 1e7 , 1e8 , 1e9 , 1e10 , 1e11 ,
+    1e12 , 1e13 , 1e14 , 1e15 , 1e16 , 1e17 , 1e18 , 1e19 , 1e20 , 1e21 , 1e22
+};
+
+//!
+//! \brief cLocale The "C" locale , its decimal point is always '.' whatever setlocale() chose.
+//!
+#ifdef _WIN32
+static _locale_t cLocale()
+{
+    static const _locale_t locale = _create_locale(LC_NUMERIC , "C");
+    return locale;
+}
+#else
+static locale_t cLocale()
+{
+    static const locale_t locale = newlocale(LC_NUMERIC_MASK , "C" , static_cast<locale_t>(0));
+    return locale;
+}
+#endif
+
+bool BVH::scanFloatSlow(const char *first , const char *last , float &value)
+{
+    //! The text is not null terminated, so the token is copied
+    size_t size = static_cast<size_t>(last - first);
+    char buffer[64];
+    std::string longToken;
+    char* text = buffer;
+    if (size >= sizeof(buffer))
+    {
+        longToken.assign(first , last);
+        text = &longToken[0];
+    }
+    else
+    {
+        std::memcpy(buffer , first , size);
+        buffer[size] = '\0';
+    }
+    if (size == 0)
+        return false;
+
+    char* parsedEnd = nullptr;
+#ifdef _WIN32
+    value = _strtof_l(text , &parsedEnd , cLocale());
+#else
+    value = strtof_l(text , &parsedEnd , cLocale());
+#endif
+    return parsedEnd == text + size;
+}
+
+bool BVH::isMidpoint(double value , float rounded)
+{
+    double r = rounded;
+    if (value == r || std::isinf(rounded))
+        return false;
+    float neighbour = std::nextafter(rounded , value > r ? HUGE_VALF : -HUGE_VALF);
+    return value == (r + static_cast<double>(neighbour)) * 0.5;
+}
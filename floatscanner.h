@@ -0,0 +1,199 @@
+﻿#ifndef FLOATSCANNER_H
+#define FLOATSCANNER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+namespace BVH {
+
+//!
+//! \brief powersOfTen Exact powers of ten 1e0 ... 1e22 as doubles.
+//!
+extern const double powersOfTen[23];
+
+//!
+//! \brief scanFloatSlow Convert a token with strtof in the "C" locale.
+//! \remarks Used for tokens the fast path can not convert exactly, such as "inf", "nan",
+//!          or values with more than 19 significant digits.
+//!
+bool scanFloatSlow(const char* first , const char* last , float& value);
+
+//!
+//! \brief isMidpoint Whether a double lies exactly halfway between the float \a rounded and its neighbour.
+//!
+bool isMidpoint(double value , float rounded);
+
+inline bool isFloatSeparator(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f' || c == '\n';
+}
+
+//!
+//! \brief scanFloat Parse one decimal token starting at \a p, locale independent.
+//! \param p The first character of the token, advanced past the token on success
+//! \param end The end of the text, the token ends at whitespace or at \a end
+//! \param value The parsed value
+//! \param exact If true the result is always the nearest float (the same value strtof gives),
+//!              otherwise values outside the exact fast path may be off by one ulp.
+//! \return false if the token is not a number
+//!
+inline bool scanFloat(const char*& p , const char* end , float& value , bool exact)
+{
+    const char* s = p;
+    bool negative = false;
+    if (s < end && (*s == '-' || *s == '+'))
+    {
+        negative = *s == '-';
+        ++s;
+    }
+
+    uint64_t mantissa = 0;
+    int significantDigits = 0;
+    int exponent = 0;
+    bool truncated = false;
+    bool hasDigits = false;
+
+    while (s < end && static_cast<unsigned>(*s - '0') < 10)
+    {
+        hasDigits = true;
+        if (significantDigits < 19)
+        {
+            mantissa = mantissa * 10 + static_cast<unsigned>(*s - '0');
+            if (mantissa)
+                ++significantDigits;
+        }
+        else
+        {
+            truncated = truncated || *s != '0';
+            ++exponent;
+        }
+        ++s;
+    }
+
+    if (s < end && *s == '.')
+    {
+        ++s;
+        while (s < end && static_cast<unsigned>(*s - '0') < 10)
+        {
+            hasDigits = true;
+            if (significantDigits < 19)
+            {
+                mantissa = mantissa * 10 + static_cast<unsigned>(*s - '0');
+                if (mantissa)
+                    ++significantDigits;
+                --exponent;
+            }
+            else
+            {
+                truncated = truncated || *s != '0';
+            }
+            ++s;
+        }
+    }
+
+    if (hasDigits && s < end && (*s == 'e' || *s == 'E'))
+    {
+        const char* e = s + 1;
+        bool negativeExponent = false;
+        if (e < end && (*e == '-' || *e == '+'))
+        {
+            negativeExponent = *e == '-';
+            ++e;
+        }
+        if (e < end && static_cast<unsigned>(*e - '0') < 10)
+        {
+            int explicitExponent = 0;
+            while (e < end && static_cast<unsigned>(*e - '0') < 10)
+            {
+                if (explicitExponent < 10000)
+                    explicitExponent = explicitExponent * 10 + (*e - '0');
+                ++e;
+            }
+            exponent += negativeExponent ? -explicitExponent : explicitExponent;
+            s = e;
+        }
+    }
+
+    const char* tokenEnd = s;
+    while (tokenEnd < end && !isFloatSeparator(*tokenEnd))
+        ++tokenEnd;
+
+    if (!hasDigits || tokenEnd != s || truncated)
+    {
+        if (!scanFloatSlow(p , tokenEnd , value))
+            return false;
+        p = tokenEnd;
+        return true;
+    }
+
+    double d;
+    if (mantissa <= (uint64_t(1) << 53) && exponent >= -22 && exponent <= 22)
+    {
+        //! Both operands are exact, so the quotient or product is the correctly rounded double
+        d = static_cast<double>(mantissa);
+        d = exponent < 0 ? d / powersOfTen[-exponent] : d * powersOfTen[exponent];
+        float f = static_cast<float>(d);
+        //! A float midpoint has at least 28 trailing zero bits in the double mantissa
+        uint64_t bits;
+        std::memcpy(&bits , &d , sizeof(bits));
+        if (exact && (bits & 0xFFFFFFF) == 0 && isMidpoint(d , f))
+        {
+            if (!scanFloatSlow(p , tokenEnd , value))
+                return false;
+            p = tokenEnd;
+            return true;
+        }
+        value = negative ? -f : f;
+        p = tokenEnd;
+        return true;
+    }
+
+    if (exact || mantissa == 0 || exponent < -64 || exponent > 64)
+    {
+        if (!scanFloatSlow(p , tokenEnd , value))
+            return false;
+        p = tokenEnd;
+        return true;
+    }
+
+    d = static_cast<double>(mantissa);
+    while (exponent > 22)
+    {
+        d *= powersOfTen[22];
+        exponent -= 22;
+    }
+    while (exponent < -22)
+    {
+        d /= powersOfTen[22];
+        exponent += 22;
+    }
+    d = exponent < 0 ? d / powersOfTen[-exponent] : d * powersOfTen[exponent];
+    float f = static_cast<float>(d);
+    value = negative ? -f : f;
+    p = tokenEnd;
+    return true;
+}
+
+//!
+//! \brief scanFloatRow Parse up to \a count whitespace separated floats from [p , end).
+//! \return The number of values written to \a out
+//! \remarks Parsing stops at the first token which is not a number, \a p points to it.
+//!
+inline size_t scanFloatRow(const char*& p , const char* end , float* out , size_t count , bool exact)
+{
+    size_t n = 0;
+    while (n < count)
+    {
+        while (p < end && isFloatSeparator(*p))
+            ++p;
+        if (p == end || !scanFloat(p , end , out[n] , exact))
+            break;
+        ++n;
+    }
+    return n;
+}
+
+}
+
+#endif // FLOATSCANNER_H
@@ -0,0 +1,290 @@
+﻿#include "forwardkinematics.h"
+#include "rotationkernels.h"
+#include "threadpool.h"
+#include <algorithm>
+#include <chrono>
+
+using namespace BVH;
+
+static const size_t Lanes = ForwardKinematics::BatchSize;
+
+ForwardKinematics::ForwardKinematics()
+{
+
+}
+
+ForwardKinematics::ForwardKinematics(const Skeleton &skeleton)
+    : m_skeleton(skeleton)
+{
+    const size_t n = skeleton.jointCount();
+    m_joints.resize(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        JointData& joint = m_joints[i];
+        joint.parent = skeleton.parent(i);
+        joint.offset[0] = skeleton.x(i);
+        joint.offset[1] = skeleton.y(i);
+        joint.offset[2] = skeleton.z(i);
+
+        int column = skeleton.channelOffset(i);
+        if (column < 0)
+            continue;
+        if (skeleton.jointChannelCount(i) == 6)
+        {
+            joint.positionColumn = column;
+            column += 3;
+        }
+        joint.rotationColumn = column;
+        joint.rotationOrder = skeleton.rotationAxisOrder(i);
+    }
+}
+
+ForwardKinematics::ForwardKinematics(const BvhDocument &document)
+    : ForwardKinematics(document.isEmpty() ? Skeleton() : *document.skeleton())
+{
+
+}
+
+void ForwardKinematics::computeBatch(const float *rows , size_t rowStride , size_t count , float *workspace) const
+{
+    float* globalRotations = rotations(workspace);
+    float* globalTranslations = translations(workspace);
+    float* local = globalTranslations + m_joints.size() * 3 * Lanes;
+    float* angles = local + 9 * Lanes;
+    float* localTranslation = angles + 3 * Lanes;
+
+    const float* laneRows[Lanes];
+    for (size_t l = 0; l < Lanes; ++l)
+    {
+        laneRows[l] = rows + std::min(l , count - 1) * rowStride;
+    }
+
+    for (size_t j = 0; j < m_joints.size(); ++j)
+    {
+        const JointData& joint = m_joints[j];
+        float* rotation = globalRotations + j * 9 * Lanes;
+        float* translation = globalTranslations + j * 3 * Lanes;
+
+        for (int k = 0; k < 3; ++k)
+        {
+            for (size_t l = 0; l < Lanes; ++l)
+                localTranslation[k * Lanes + l] = joint.offset[k];
+        }
+        if (joint.positionColumn >= 0)
+        {
+            for (int k = 0; k < 3; ++k)
+            {
+                for (size_t l = 0; l < Lanes; ++l)
+                    localTranslation[k * Lanes + l] += laneRows[l][joint.positionColumn + k];
+            }
+        }
+
+        const bool hasRotation = joint.rotationColumn >= 0;
+        if (hasRotation)
+        {
+            for (int k = 0; k < 3; ++k)
+            {
+                for (size_t l = 0; l < Lanes; ++l)
+                    angles[k * Lanes + l] = laneRows[l][joint.rotationColumn + k];
+            }
+            eulerToMatrices(joint.rotationOrder , angles , angles + Lanes , angles + 2 * Lanes , Lanes ,
+                            joint.parent >= 0 ? local : rotation , Lanes);
+        }
+
+        if (joint.parent < 0)
+        {
+            if (!hasRotation)
+            {
+                for (int e = 0; e < 9; ++e)
+                {
+                    for (size_t l = 0; l < Lanes; ++l)
+                        rotation[e * Lanes + l] = e % 4 == 0 ? 1.0f : 0.0f;
+                }
+            }
+            std::copy(localTranslation , localTranslation + 3 * Lanes , translation);
+            continue;
+        }
+
+        const float* parentRotation = globalRotations + joint.parent * 9 * Lanes;
+        const float* parentTranslation = globalTranslations + joint.parent * 3 * Lanes;
+
+        //! t = Rp * local translation + tp
+        for (int i = 0; i < 3; ++i)
+        {
+            const float* p = parentRotation + i * 3 * Lanes;
+            for (size_t l = 0; l < Lanes; ++l)
+            {
+                translation[i * Lanes + l] = p[l] * localTranslation[l]
+                        + p[Lanes + l] * localTranslation[Lanes + l]
+                        + p[2 * Lanes + l] * localTranslation[2 * Lanes + l]
+                        + parentTranslation[i * Lanes + l];
+            }
+        }
+
+        //! R = Rp * local rotation
+        if (!hasRotation)
+        {
+            std::copy(parentRotation , parentRotation + 9 * Lanes , rotation);
+            continue;
+        }
+        for (int i = 0; i < 3; ++i)
+        {
+            const float* p = parentRotation + i * 3 * Lanes;
+            for (int k = 0; k < 3; ++k)
+            {
+                for (size_t l = 0; l < Lanes; ++l)
+                {
+                    rotation[(i * 3 + k) * Lanes + l] = p[l] * local[k * Lanes + l]
+                            + p[Lanes + l] * local[(3 + k) * Lanes + l]
+                            + p[2 * Lanes + l] * local[(6 + k) * Lanes + l];
+                }
+            }
+        }
+    }
+}
+
+void ForwardKinematics::computePositions(const float *rows , size_t rowStride , size_t frameCount , float *positions ,
+                                         std::vector<float> &workspace) const
+{
+    if (workspace.size() < workspaceSize())
+        workspace.resize(workspaceSize());
+
+    const size_t jointCount = m_joints.size();
+    const float* globalTranslations = translations(workspace.data());
+    for (size_t first = 0; first < frameCount; first += Lanes)
+    {
+        const size_t count = std::min(Lanes , frameCount - first);
+        computeBatch(rows + first * rowStride , rowStride , count , workspace.data());
+        for (size_t l = 0; l < count; ++l)
+        {
+            float* out = positions + (first + l) * jointCount * 3;
+            for (size_t j = 0; j < jointCount; ++j)
+            {
+                const float* translation = globalTranslations + j * 3 * Lanes + l;
+                out[j * 3] = translation[0];
+                out[j * 3 + 1] = translation[Lanes];
+                out[j * 3 + 2] = translation[2 * Lanes];
+            }
+        }
+    }
+}
+
+void ForwardKinematics::computeTransforms(const float *rows , size_t rowStride , size_t frameCount , float *transforms ,
+                                          std::vector<float> &workspace) const
+{
+    if (workspace.size() < workspaceSize())
+        workspace.resize(workspaceSize());
+
+    const size_t jointCount = m_joints.size();
+    const float* globalRotations = rotations(workspace.data());
+    const float* globalTranslations = translations(workspace.data());
+    for (size_t first = 0; first < frameCount; first += Lanes)
+    {
+        const size_t count = std::min(Lanes , frameCount - first);
+        computeBatch(rows + first * rowStride , rowStride , count , workspace.data());
+        for (size_t l = 0; l < count; ++l)
+        {
+            float* out = transforms + (first + l) * jointCount * TransformSize;
+            for (size_t j = 0; j < jointCount; ++j , out += TransformSize)
+            {
+                const float* rotation = globalRotations + j * 9 * Lanes + l;
+                const float* translation = globalTranslations + j * 3 * Lanes + l;
+                for (int i = 0; i < 3; ++i)
+                {
+                    out[i * 4] = rotation[(i * 3) * Lanes];
+                    out[i * 4 + 1] = rotation[(i * 3 + 1) * Lanes];
+                    out[i * 4 + 2] = rotation[(i * 3 + 2) * Lanes];
+                    out[i * 4 + 3] = translation[i * Lanes];
+                }
+                out[12] = 0.0f;
+                out[13] = 0.0f;
+                out[14] = 0.0f;
+                out[15] = 1.0f;
+            }
+        }
+    }
+}
+
+void ForwardKinematics::computePositions(const BvhDocument &document , size_t first , size_t last , float *positions) const
+{
+    if (first >= last)
+        return;
+    const std::shared_ptr<MotionStore> motion = motionOf(document);
+    if (!motion)
+        return;
+    last = std::min(last , motion->frameCount());
+    if (first >= last)
+        return;
+
+    std::vector<float> workspace;
+    computePositions(motion->row(first) , motion->channelCount() , last - first , positions , workspace);
+}
+
+void ForwardKinematics::computeTransforms(const BvhDocument &document , size_t first , size_t last , float *transforms) const
+{
+    if (first >= last)
+        return;
+    const std::shared_ptr<MotionStore> motion = motionOf(document);
+    if (!motion)
+        return;
+    last = std::min(last , motion->frameCount());
+    if (first >= last)
+        return;
+
+    std::vector<float> workspace;
+    computeTransforms(motion->row(first) , motion->channelCount() , last - first , transforms , workspace);
+}
+
+ForwardKinematics::ClipStatistics ForwardKinematics::computeClipPositions(const BvhDocument &document , float *positions ,
+                                                                          unsigned threadCount) const
+{
+    return computeClip(document , positions , false , threadCount);
+}
+
+ForwardKinematics::ClipStatistics ForwardKinematics::computeClipTransforms(const BvhDocument &document , float *transforms ,
+                                                                           unsigned threadCount) const
+{
+    return computeClip(document , transforms , true , threadCount);
+}
+
+ForwardKinematics::ClipStatistics ForwardKinematics::computeClip(const BvhDocument &document , float *out , bool transforms ,
+                                                                 unsigned threadCount) const
+{
+    ClipStatistics statistics;
+    const std::shared_ptr<MotionStore> motion = motionOf(document);
+    if (!motion || motion->frameCount() == 0)
+        return statistics;
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    ThreadPool& pool = ThreadPool::globalInstance();
+    const unsigned slots = pool.concurrency(threadCount);
+    std::vector<std::vector<float>> workspaces(slots , std::vector<float>(workspaceSize()));
+
+    const float* rows = motion->data();
+    const size_t rowStride = motion->channelCount();
+    const size_t frameSize = m_joints.size() * (transforms ? TransformSize : 3);
+    statistics.frameCount = motion->frameCount();
+    pool.parallelForRange(statistics.frameCount , ClipGrain , [&](size_t first , size_t last , size_t slot) {
+        if (transforms)
+            computeTransforms(rows + first * rowStride , rowStride , last - first , out + first * frameSize , workspaces[slot]);
+        else
+            computePositions(rows + first * rowStride , rowStride , last - first , out + first * frameSize , workspaces[slot]);
+    } , slots);
+
+    statistics.threadCount = static_cast<unsigned>(std::min<size_t>(slots , (statistics.frameCount + ClipGrain - 1) / ClipGrain));
+    statistics.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return statistics;
+}
+
+std::shared_ptr<MotionStore> ForwardKinematics::motionOf(const BvhDocument &document) const
+{
+    if (document.isEmpty())
+        return nullptr;
+
+    //! The joints may have been edited since the store was built , the rows of a copy may be shorter
+    std::shared_ptr<MotionStore> motion = document.currentMotion();
+    if (motion->channelCount() != channelCount())
+        return nullptr;
+    return motion;
+}
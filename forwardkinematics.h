@@ -0,0 +1,137 @@
+﻿#ifndef FORWARDKINEMATICS_H
+#define FORWARDKINEMATICS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "bvh.h"
+#include "skeleton.h"
+
+namespace BVH {
+
+//!
+//! \brief The ForwardKinematics class World space positions and transforms of every joint.
+//! \remarks The skeleton is compiled once into flat per joint arrays , then frames are processed
+//!          in batches of BatchSize frames. Every value of a batch is stored lane by lane (SoA) so
+//!          that the inner loops run over the frames of the batch and vectorize.
+//!
+//!          The local transform of a joint is the translation OFFSET + position channels followed
+//!          by the rotation channels , composed in the order they appear in the file: a joint with
+//!          "Zrotation Xrotation Yrotation" rotates by Rz * Rx * Ry. Angles are in degrees.
+//!          End Sites have no rotation. The joints are in the order of Skeleton , End Sites included.
+//!
+class ForwardKinematics {
+public:
+    static const size_t BatchSize = 8;
+
+    //!
+    //! \brief TransformSize A transform is a row major 4x4 matrix , the translation is the last column.
+    //!
+    static const size_t TransformSize = 16;
+
+    ForwardKinematics();
+    explicit ForwardKinematics(const Skeleton& skeleton);
+    explicit ForwardKinematics(const BvhDocument& document);
+
+    const Skeleton& skeleton() const { return m_skeleton; }
+    size_t jointCount() const { return m_joints.size(); }
+    size_t channelCount() const { return m_skeleton.channelCount(); }
+
+    //!
+    //! \brief workspaceSize The number of floats a call needs as scratch memory.
+    //!
+    size_t workspaceSize() const { return (m_joints.size() * 12 + 15) * BatchSize; }
+
+    //!
+    //! \brief computePositions The world position of every joint in \a frameCount frames.
+    //! \param rows The frames , MotionStore rows of channelCount() values
+    //! \param rowStride The distance between two rows , in floats
+    //! \param positions frameCount * jointCount() * 3 values
+    //! \param workspace Scratch memory , resized to workspaceSize() when it is smaller
+    //!
+    void computePositions(const float* rows , size_t rowStride , size_t frameCount , float* positions ,
+                          std::vector<float>& workspace) const;
+
+    //!
+    //! \brief computeTransforms The world transform of every joint in \a frameCount frames.
+    //! \param transforms frameCount * jointCount() * TransformSize values
+    //!
+    void computeTransforms(const float* rows , size_t rowStride , size_t frameCount , float* transforms ,
+                           std::vector<float>& workspace) const;
+
+    //!
+    //! \brief computePositions The world positions in the frames [first , last) of \a document.
+    //! \remarks A store which is not bound to the joints any more is copied first. Nothing is
+    //!          written if the channels of \a document differ from channelCount().
+    //!
+    void computePositions(const BvhDocument& document , size_t first , size_t last , float* positions) const;
+    void computeTransforms(const BvhDocument& document , size_t first , size_t last , float* transforms) const;
+
+    //!
+    //! \brief The ClipStatistics struct The throughput of a whole clip computation.
+    //!
+    struct ClipStatistics {
+        size_t frameCount = 0;
+        unsigned threadCount = 0;
+        double seconds = 0.0;
+
+        double framesPerSecond() const { return seconds > 0.0 ? frameCount / seconds : 0.0; }
+        double framesPerSecondPerThread() const { return threadCount ? framesPerSecond() / threadCount : 0.0; }
+    };
+
+    //!
+    //! \brief ClipGrain The number of frames a thread computes before it looks for more work.
+    //!
+    static const size_t ClipGrain = 64;
+
+    //!
+    //! \brief computeClipPositions The world positions in every frame of \a document , in parallel.
+    //! \param positions document.frameCount() * jointCount() * 3 values
+    //! \param threadCount The number of threads including the caller , 0 uses every hardware thread
+    //! \remarks The frames are split with ThreadPool::parallelForRange() on the global pool. Every
+    //!          thread has one workspace , nothing is allocated per frame. The motion is checked
+    //!          like in computePositions() , the statistics count no frames if it does not fit.
+    //!
+    ClipStatistics computeClipPositions(const BvhDocument& document , float* positions , unsigned threadCount = 0) const;
+
+    //!
+    //! \brief computeClipTransforms The world transforms in every frame of \a document , in parallel.
+    //! \param transforms document.frameCount() * jointCount() * TransformSize values
+    //!
+    ClipStatistics computeClipTransforms(const BvhDocument& document , float* transforms , unsigned threadCount = 0) const;
+
+private:
+    //!
+    //! \brief The JointData struct The compiled data of one joint.
+    //!
+    struct JointData {
+        int32_t parent = -1;
+        int32_t positionColumn = -1;    //!< The column of the x position , -1 without position channels
+        int32_t rotationColumn = -1;    //!< The column of the x rotation , -1 without rotation channels
+        AxisOrder rotationOrder = AxisOrder::Invalid;
+        float offset[3] = { 0.0f , 0.0f , 0.0f };
+    };
+
+    //!
+    //! \brief computeBatch The global rotation and translation of every joint in up to BatchSize frames.
+    //! \remarks Lanes after \a count repeat the last frame.
+    //!
+    void computeBatch(const float* rows , size_t rowStride , size_t count , float* workspace) const;
+
+    ClipStatistics computeClip(const BvhDocument& document , float* out , bool transforms , unsigned threadCount) const;
+
+    //!
+    //! \brief motionOf The motion of \a document in rows of channelCount() values , nullptr if it has other channels.
+    //!
+    std::shared_ptr<MotionStore> motionOf(const BvhDocument& document) const;
+
+    float* rotations(float* workspace) const { return workspace; }
+    float* translations(float* workspace) const { return workspace + m_joints.size() * 9 * BatchSize; }
+
+    Skeleton m_skeleton;
+    std::vector<JointData> m_joints;
+};
+
+}
+
+#endif // FORWARDKINEMATICS_H
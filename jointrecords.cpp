@@ -0,0 +1,72 @@
+﻿#include "jointrecords.h"
+#include <cstring>
+
+using namespace BVH;
+
+static bool isValidOrder(uint8_t order , bool allowInvalid)
+{
+    switch (order)
+    {
+    case AxisOrder::XYZ:
+    case AxisOrder::XZY:
+    case AxisOrder::YXZ:
+    case AxisOrder::YZX:
+    case AxisOrder::ZXY:
+    case AxisOrder::ZYX:
+        return true;
+    case AxisOrder::Invalid:
+        return allowInvalid;
+    default:
+        return false;
+    }
+}
+
+void BVH::toJointRecords(const Skeleton &skeleton , std::vector<BinaryJoint> &records , std::string &names)
+{
+    records.resize(skeleton.jointCount());
+    names.clear();
+    for (size_t i = 0; i < skeleton.jointCount(); ++i)
+    {
+        BinaryJoint& record = records[i];
+        std::memset(&record , 0 , sizeof(record));
+        record.parent = skeleton.parent(i);
+        record.nameOffset = static_cast<uint32_t>(names.size());
+        record.nameSize = static_cast<uint32_t>(skeleton.nameSize(i));
+        record.isEndSite = skeleton.isEndSite(i) ? 1 : 0;
+        record.positionOrder = static_cast<uint8_t>(skeleton.positionAxisOrder(i));
+        record.rotationOrder = static_cast<uint8_t>(skeleton.rotationAxisOrder(i));
+        record.offset[0] = skeleton.x(i);
+        record.offset[1] = skeleton.y(i);
+        record.offset[2] = skeleton.z(i);
+        names.append(skeleton.nameData(i) , skeleton.nameSize(i));
+    }
+}
+
+Joint *BVH::fromJointRecords(const char *records , uint32_t count , const char *names , uint64_t namesSize)
+{
+    std::vector<Joint*> joints(count , nullptr);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        BinaryJoint record;
+        std::memcpy(&record , records + i * sizeof(BinaryJoint) , sizeof(record));
+
+        bool valid = (i == 0 ? record.parent == -1 : (record.parent >= 0 && static_cast<uint32_t>(record.parent) < i)) &&
+                     uint64_t(record.nameOffset) + record.nameSize <= namesSize &&
+                     isValidOrder(record.positionOrder , true) &&
+                     isValidOrder(record.rotationOrder , record.isEndSite != 0);
+        if (!valid)
+        {
+            delete joints[0];
+            return nullptr;
+        }
+
+        Joint* joint = new Joint(i == 0 ? nullptr : joints[record.parent]);
+        joint->setJointName(std::string(names + record.nameOffset , record.nameSize));
+        joint->setAsEndSite(record.isEndSite != 0);
+        joint->setPositionAxisOrder(static_cast<AxisOrder>(record.positionOrder));
+        joint->setRotationAxisOrder(static_cast<AxisOrder>(record.rotationOrder));
+        joint->setOffset(record.offset[0] , record.offset[1] , record.offset[2]);
+        joints[i] = joint;
+    }
+    return count == 0 ? nullptr : joints[0];
+}
@@ -0,0 +1,44 @@
+﻿#ifndef JOINTRECORDS_H
+#define JOINTRECORDS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "bvh.h"
+#include "skeleton.h"
+
+namespace BVH {
+
+//!
+//! \brief The BinaryJoint struct One joint of a hierarchy stored in a binary file , all values in
+//!        the byte order of the file , see its ByteOrderMark. The names of all joints follow the
+//!        records in one block of characters.
+//!
+struct BinaryJoint {
+    int32_t parent;
+    uint32_t nameOffset;
+    uint32_t nameSize;
+    uint8_t isEndSite;
+    uint8_t positionOrder;
+    uint8_t rotationOrder;
+    uint8_t reserved;
+    float offset[3];
+};
+
+static_assert(sizeof(BinaryJoint) == 28 , "unexpected padding in BinaryJoint");
+
+//!
+//! \brief toJointRecords The records of every joint of \a skeleton in pre-order and their names.
+//!
+void toJointRecords(const Skeleton& skeleton , std::vector<BinaryJoint>& records , std::string& names);
+
+//!
+//! \brief fromJointRecords Build the hierarchy stored by toJointRecords().
+//! \param records \a count records , they need not be aligned
+//! \return The root joint , owned by the caller , or nullptr if a record is invalid
+//!
+Joint* fromJointRecords(const char* records , uint32_t count , const char* names , uint64_t namesSize);
+
+}
+
+#endif // JOINTRECORDS_H
@@ -0,0 +1,307 @@
+﻿#include "keyframes.h"
+#include "threadpool.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace BVH;
+
+//! toDocument() decodes blocks of this many frames , so the rows being written stay in the cache
+static const size_t DecodeBlockFrames = 256;
+
+namespace {
+
+//!
+//! \brief The ChannelFit struct The keys of one channel while the channels are fitted in parallel.
+//!
+struct ChannelFit {
+    std::vector<uint32_t> frames;
+    std::vector<float> values;
+    std::vector<float> tangents;
+    float maxError = 0.0f;
+};
+
+}
+
+//!
+//! \brief hermiteValue The cubic Hermite curve of a segment , \a offset frames after its first key.
+//! \param length The frames between the keys , the tangents are in values per frame
+//!
+static inline float hermiteValue(float va , float ta , float vb , float tb , float length , float offset)
+{
+    const float t = offset / length;
+    const float t2 = t * t;
+    const float t3 = t2 * t;
+    return (2.0f * t3 - 3.0f * t2 + 1.0f) * va + (t3 - 2.0f * t2 + t) * length * ta +
+           (3.0f * t2 - 2.0f * t3) * vb + (t3 - t2) * length * tb;
+}
+
+//!
+//! \brief decodeKeys Evaluate the curve through \a keyCount keys in the frames [first , last).
+//! \param tangents nullptr for linear curves
+//! \remarks Frames after the last key repeat its value.
+//!
+static void decodeKeys(const uint32_t* frames , const float* values , const float* tangents , size_t keyCount ,
+                       size_t first , size_t last , float* out , size_t stride)
+{
+    if (keyCount == 0)
+        return;
+
+    size_t k = static_cast<size_t>(std::upper_bound(frames , frames + keyCount , first) - frames);
+    k = k == 0 ? 0 : k - 1;
+    size_t f = first;
+    for (; f < last && k + 1 < keyCount; ++k)
+    {
+        const size_t a = frames[k];
+        const size_t end = std::min<size_t>(last , frames[k + 1]);
+        const float length = static_cast<float>(frames[k + 1] - a);
+        const float va = values[k];
+        const float vb = values[k + 1];
+        if (tangents)
+        {
+            const float ta = tangents[k];
+            const float tb = tangents[k + 1];
+            for (; f < end; ++f)
+                out[(f - first) * stride] = hermiteValue(va , ta , vb , tb , length , static_cast<float>(f - a));
+        }
+        else
+        {
+            const float slope = (vb - va) / length;
+            for (; f < end; ++f)
+                out[(f - first) * stride] = va + slope * static_cast<float>(f - a);
+        }
+    }
+    for (; f < last; ++f)
+        out[(f - first) * stride] = values[keyCount - 1];
+}
+
+//!
+//! \brief fitLinear Keep the last frame of a segment for which one slope fits every frame.
+//! \remarks Every frame i since the key a limits the slope of the segment to
+//!          [(v[i] - v[a] - tolerance) / (i - a) , (v[i] - v[a] + tolerance) / (i - a)]. A frame
+//!          can end the segment while its own slope lies in the intersection of the earlier limits.
+//!
+static void fitLinear(const float* v , size_t n , float tolerance , ChannelFit& fit)
+{
+    if (n == 0)
+        return;
+
+    const float infinity = std::numeric_limits<float>::infinity();
+    fit.frames.push_back(0);
+    size_t a = 0;
+    float low = -infinity;
+    float high = infinity;
+    for (size_t i = 1; i < n; ++i)
+    {
+        const float slope = (v[i] - v[a]) / static_cast<float>(i - a);
+        if (slope < low || slope > high)
+        {
+            a = i - 1;
+            fit.frames.push_back(static_cast<uint32_t>(a));
+            low = -infinity;
+            high = infinity;
+        }
+        const float distance = static_cast<float>(i - a);
+        low = std::max(low , (v[i] - v[a] - tolerance) / distance);
+        high = std::min(high , (v[i] - v[a] + tolerance) / distance);
+    }
+    if (n > 1)
+        fit.frames.push_back(static_cast<uint32_t>(n - 1));
+
+    for (uint32_t frame : fit.frames)
+        fit.values.push_back(v[frame]);
+}
+
+static float tangentAt(const float* v , size_t n , size_t i)
+{
+    if (n < 2)
+        return 0.0f;
+    if (i == 0)
+        return v[1] - v[0];
+    if (i == n - 1)
+        return v[n - 1] - v[n - 2];
+    return (v[i + 1] - v[i - 1]) * 0.5f;
+}
+
+static bool hermiteFits(const float* v , size_t n , size_t a , size_t b , float tolerance)
+{
+    const float ta = tangentAt(v , n , a);
+    const float tb = tangentAt(v , n , b);
+    const float length = static_cast<float>(b - a);
+    for (size_t i = a + 1; i < b; ++i)
+    {
+        if (std::fabs(hermiteValue(v[a] , ta , v[b] , tb , length , static_cast<float>(i - a)) - v[i]) > tolerance)
+            return false;
+    }
+    return true;
+}
+
+//!
+//! \brief fitHermite Grow every segment by doubling its length while it fits , then bisect.
+//!
+static void fitHermite(const float* v , size_t n , float tolerance , ChannelFit& fit)
+{
+    if (n == 0)
+        return;
+
+    fit.frames.push_back(0);
+    size_t a = 0;
+    while (a + 1 < n)
+    {
+        size_t good = a + 1;
+        size_t bad = 0;
+        for (size_t length = 2; ; length *= 2)
+        {
+            const size_t b = std::min(a + length , n - 1);
+            if (!hermiteFits(v , n , a , b , tolerance))
+            {
+                bad = b;
+                break;
+            }
+            good = b;
+            if (b == n - 1)
+                break;
+        }
+        while (bad > good + 1)
+        {
+            const size_t middle = good + (bad - good) / 2;
+            if (hermiteFits(v , n , a , middle , tolerance))
+                good = middle;
+            else
+                bad = middle;
+        }
+        fit.frames.push_back(static_cast<uint32_t>(good));
+        a = good;
+    }
+
+    for (uint32_t frame : fit.frames)
+    {
+        fit.values.push_back(v[frame]);
+        fit.tangents.push_back(tangentAt(v , n , frame));
+    }
+}
+
+KeyframeCurves::KeyframeCurves()
+{
+
+}
+
+KeyframeCurves KeyframeCurves::fit(const BvhDocument &document , const KeyframeOptions &options)
+{
+    KeyframeCurves curves;
+    if (document.isEmpty())
+        return curves;
+
+    const std::shared_ptr<const Skeleton> skeleton = document.skeleton();
+    std::shared_ptr<MotionStore> motion = document.currentMotion();
+
+    std::vector<float> tolerances;
+    for (size_t i = 0; i < skeleton->jointCount(); ++i)
+    {
+        const size_t channelCount = skeleton->jointChannelCount(i);
+        if (channelCount == 6)
+            tolerances.insert(tolerances.end() , 3 , options.positionTolerance);
+        if (channelCount != 0)
+            tolerances.insert(tolerances.end() , 3 , options.rotationTolerance);
+    }
+
+    curves.m_skeleton = *skeleton;
+    curves.m_interpolation = options.interpolation;
+    curves.m_frameInterval = document.frameInterval();
+    curves.m_frameCount = motion->frameCount();
+
+    const size_t frameCount = curves.m_frameCount;
+    const size_t channelCount = motion->channelCount();
+    const float* rows = motion->data();
+    std::vector<ChannelFit> fits(channelCount);
+    ThreadPool::globalInstance().parallelFor(channelCount , [&](size_t channel) {
+        std::vector<float> column(frameCount);
+        for (size_t f = 0; f < frameCount; ++f)
+            column[f] = rows[f * channelCount + channel];
+
+        ChannelFit& fit = fits[channel];
+        if (options.interpolation == KeyframeOptions::Hermite)
+            fitHermite(column.data() , frameCount , tolerances[channel] , fit);
+        else
+            fitLinear(column.data() , frameCount , tolerances[channel] , fit);
+
+        //! Measure the error of the decoder itself , which rounds differently than the fit
+        std::vector<float> decoded(frameCount);
+        decodeKeys(fit.frames.data() , fit.values.data() , fit.tangents.empty() ? nullptr : fit.tangents.data() ,
+                   fit.frames.size() , 0 , frameCount , decoded.data() , 1);
+        for (size_t f = 0; f < frameCount; ++f)
+            fit.maxError = std::max(fit.maxError , std::fabs(decoded[f] - column[f]));
+    } , options.threadCount);
+
+    curves.m_channelKeys.push_back(0);
+    for (const ChannelFit& fit : fits)
+    {
+        curves.m_keyFrames.insert(curves.m_keyFrames.end() , fit.frames.begin() , fit.frames.end());
+        curves.m_keyValues.insert(curves.m_keyValues.end() , fit.values.begin() , fit.values.end());
+        curves.m_keyTangents.insert(curves.m_keyTangents.end() , fit.tangents.begin() , fit.tangents.end());
+        curves.m_maxErrors.push_back(fit.maxError);
+        curves.m_channelKeys.push_back(static_cast<uint32_t>(curves.m_keyFrames.size()));
+    }
+    return curves;
+}
+
+float KeyframeCurves::maxError() const
+{
+    float error = 0.0f;
+    for (float e : m_maxErrors)
+        error = std::max(error , e);
+    return error;
+}
+
+size_t KeyframeCurves::memorySize() const
+{
+    return m_keyFrames.size() * sizeof(uint32_t) + m_keyValues.size() * sizeof(float) +
+           m_keyTangents.size() * sizeof(float) + m_channelKeys.size() * sizeof(uint32_t);
+}
+
+void KeyframeCurves::decodeChannel(size_t channel , size_t first , size_t last , float *values , size_t stride) const
+{
+    const size_t begin = m_channelKeys[channel];
+    const float* tangents = m_keyTangents.empty() ? nullptr : m_keyTangents.data() + begin;
+    decodeKeys(m_keyFrames.data() + begin , m_keyValues.data() + begin , tangents , m_channelKeys[channel + 1] - begin ,
+               first , last , values , stride);
+}
+
+float KeyframeCurves::value(size_t channel , size_t frame) const
+{
+    float result = 0.0f;
+    decodeChannel(channel , frame , frame + 1 , &result , 1);
+    return result;
+}
+
+void KeyframeCurves::decode(size_t first , size_t last , float *rows , size_t rowStride) const
+{
+    for (size_t channel = 0; channel < channelCount(); ++channel)
+    {
+        decodeChannel(channel , first , last , rows + channel , rowStride);
+    }
+}
+
+BvhDocument KeyframeCurves::toDocument(unsigned threadCount) const
+{
+    Joint* root = m_skeleton.createJoints();
+    if (!root)
+        return BvhDocument();
+
+    std::shared_ptr<MotionStore> frames = MotionStore::create(root->channelJoints() , m_frameCount);
+    float* rows = frames->data();
+    const size_t stride = frames->channelCount();
+    ThreadPool& pool = ThreadPool::globalInstance();
+    pool.parallelForRange(m_frameCount , DecodeBlockFrames , [&](size_t first , size_t last , size_t) {
+        for (size_t block = first; block < last; block += DecodeBlockFrames)
+        {
+            decode(block , std::min(last , block + DecodeBlockFrames) , rows + block * stride , stride);
+        }
+    } , pool.concurrency(threadCount));
+
+    //! The joints are bound to the new store , the document adopts it
+    BvhDocument doc;
+    doc.loadRootJoint(root);
+    doc.setFrameInterval(m_frameInterval);
+    return doc;
+}
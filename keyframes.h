@@ -0,0 +1,123 @@
+﻿#ifndef KEYFRAMES_H
+#define KEYFRAMES_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "bvh.h"
+#include "skeleton.h"
+
+namespace BVH {
+
+//!
+//! \brief The KeyframeOptions struct Options which control KeyframeCurves::fit().
+//!
+struct KeyframeOptions {
+    enum Interpolation {
+        Linear ,        //!< Straight lines between the keys , one value per key
+        Hermite         //!< Cubic Hermite curves , a value and a tangent per key
+    };
+
+    Interpolation interpolation = Linear;
+
+    //!
+    //! \brief rotationTolerance The largest error of a rotation channel , in degrees.
+    //!
+    float rotationTolerance = 0.01f;
+
+    //!
+    //! \brief positionTolerance The largest error of a position channel , in the units of the file.
+    //!
+    float positionTolerance = 0.001f;
+
+    //!
+    //! \brief threadCount The number of threads which fit channels , 0 uses every hardware thread.
+    //!
+    unsigned threadCount = 0;
+};
+
+//!
+//! \brief The KeyframeCurves class The motion of a document as sparse keyframes per channel.
+//! \remarks Every channel is reduced on its own to the fewest keys the greedy fit finds such that
+//!          the curve through them stays within the tolerance at every frame. The first and the
+//!          last frame are always keys and keys keep their exact values. Linear curves are fitted
+//!          in one pass by narrowing the range of slopes which keep every frame since the last key
+//!          in tolerance. Hermite curves use the central difference of the frames as tangents and
+//!          grow every segment by doubling and bisection.
+//!
+//!          The keys of all channels are stored as three flat arrays , the frame , the value and
+//!          for Hermite curves the tangent in values per frame.
+//!
+class KeyframeCurves {
+public:
+    KeyframeCurves();
+
+    //!
+    //! \brief fit Reduce the motion of \a document.
+    //! \return Empty curves if the document has no motion
+    //!
+    static KeyframeCurves fit(const BvhDocument& document , const KeyframeOptions& options = KeyframeOptions());
+
+    bool isEmpty() const { return m_channelKeys.size() < 2; }
+
+    const Skeleton& skeleton() const { return m_skeleton; }
+    KeyframeOptions::Interpolation interpolation() const { return m_interpolation; }
+    float frameInterval() const { return m_frameInterval; }
+    size_t frameCount() const { return m_frameCount; }
+    size_t channelCount() const { return m_channelKeys.empty() ? 0 : m_channelKeys.size() - 1; }
+
+    size_t keyCount() const { return m_keyFrames.size(); }
+    size_t keyCount(size_t channel) const { return m_channelKeys[channel + 1] - m_channelKeys[channel]; }
+
+    //!
+    //! \brief maxError The largest difference between a decoded value and the fitted one.
+    //!
+    float maxError() const;
+    float maxError(size_t channel) const { return m_maxErrors[channel]; }
+
+    //!
+    //! \brief memorySize The bytes of the keys , compare with denseSize().
+    //!
+    size_t memorySize() const;
+    size_t denseSize() const { return m_frameCount * channelCount() * sizeof(float); }
+
+    //!
+    //! \brief value The value of \a channel in \a frame.
+    //! \remarks Finds the segment with a binary search , use decode() for runs of frames.
+    //!
+    float value(size_t channel , size_t frame) const;
+
+    //!
+    //! \brief decode The frames [first , last).
+    //! \param rows (last - first) rows of channelCount() values , \a rowStride floats apart
+    //! \remarks Every channel locates its first segment once and then walks its keys.
+    //!
+    void decode(size_t first , size_t last , float* rows , size_t rowStride) const;
+
+    //!
+    //! \brief toDocument Decode every frame into a document with the hierarchy of skeleton().
+    //! \param threadCount The number of threads including the caller , 0 uses every hardware thread
+    //!
+    BvhDocument toDocument(unsigned threadCount = 0) const;
+
+private:
+    void decodeChannel(size_t channel , size_t first , size_t last , float* values , size_t stride) const;
+
+    Skeleton m_skeleton;
+    KeyframeOptions::Interpolation m_interpolation = KeyframeOptions::Linear;
+    float m_frameInterval = 0.0f;
+    size_t m_frameCount = 0;
+
+    //!
+    //! \brief m_channelKeys The keys of channel c are [m_channelKeys[c] , m_channelKeys[c + 1])
+    //!
+    std::vector<uint32_t> m_channelKeys;
+    std::vector<uint32_t> m_keyFrames;
+    std::vector<float> m_keyValues;
+    std::vector<float> m_keyTangents;
+    std::vector<float> m_maxErrors;
+};
+
+}
+
+#endif // KEYFRAMES_H
@@ -1,12 +1,673 @@
-﻿#include "bvh.h"
+﻿#include "archive.h"
+#include "bvh.h"
+#include "parsecache.h"
+#include "prune.h"
+#include "resample.h"
+#include "retarget.h"
+#include "skeleton.h"
+#include "threadpool.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#endif
+
 using namespace BVH;
+
+static const char Usage[] =
+    "usage: bvhparser [options] <file or directory>...\n"
+    "\n"
+    "Converts every bvh file , directories are searched recursively for *.bvh files.\n"
+    "The steps run in this order: load , prune , resample , retarget , write.\n"
+    "\n"
+    "  --list FILE          read more inputs from FILE , one per line\n"
+    "  -o , --output DIR    write into DIR instead of next to every input\n"
+    "  --suffix TEXT        append TEXT to the output names , default _new without --output\n"
+    "  --format FORMAT      text (.bvh) , binary (.bvhb) or archive (.bvha) , default text\n"
+    "  --precision VALUE    decimals of text output , or the rounding step of archives\n"
+    "  --prune-nubs         collapse the finger Nub joints into End Sites\n"
+    "  --drop NAMES         drop the joints with these comma separated names and their children\n"
+    "  --max-depth DEPTH    collapse the joints deeper than DEPTH into End Sites\n"
+    "  --fps RATE           resample to RATE frames per second\n"
+    "  --retarget FILE      transfer the motion onto the hierarchy of FILE\n"
+    "  -j , --jobs COUNT    convert COUNT files at once , default the hardware threads\n"
+    "  --cache DIR          keep parsed inputs in DIR , see ParseCache\n"
+    "  --cache-budget MB    the size of the cache , default unlimited\n"
+    "  -q , --quiet         print only the summary and the errors\n"
+    "  -h , --help          print this text\n";
+
+namespace {
+
+enum class OutputFormat {
+    Text ,
+    Binary ,
+    Archive
+};
+
+//!
+//! \brief The ConvertOptions struct The command line.
+//!
+struct ConvertOptions {
+    std::vector<std::string> inputs;
+    std::string outputDirectory;
+    std::string suffix;
+    bool hasSuffix = false;
+    OutputFormat format = OutputFormat::Text;
+    double precision = -1.0;            //!< -1 keeps the default of the format
+    bool pruneNubs = false;
+    std::vector<std::string> dropNames;
+    int maxDepth = -1;
+    double frameRate = 0.0;
+    std::string retargetFile;
+    unsigned jobs = 0;
+    std::string cacheDirectory;
+    uint64_t cacheBudget = 0;
+    bool quiet = false;
+};
+
+struct InputFile {
+    std::string path;
+    std::string subdirectory;           //!< The directory below the input directory , kept below --output
+    uint64_t size;
+};
+
+struct FileResult {
+    bool ok = false;
+    size_t frames = 0;
+    double loadSeconds = 0.0;
+    double seconds = 0.0;
+};
+
+//!
+//! \brief The RetargetPlans class One plan per distinct source skeleton , shared by all files.
+//! \remarks The skeletons are interned , so files of the same skeleton find their plan by pointer.
+//!
+class RetargetPlans {
+public:
+    explicit RetargetPlans(const BvhDocument& target) : m_target(target.rootJoint()) {}
+
+    bool isEmpty() const { return m_target.isEmpty(); }
+
+    std::shared_ptr<const RetargetPlan> planFor(const BvhDocument& source)
+    {
+        std::shared_ptr<const Skeleton> skeleton = source.skeleton();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::shared_ptr<const RetargetPlan>& plan = m_plans[skeleton];
+        if (!plan)
+            plan = std::make_shared<const RetargetPlan>(*skeleton , m_target);
+        return plan;
+    }
+
+private:
+    Skeleton m_target;
+    std::mutex m_mutex;
+    std::map<std::shared_ptr<const Skeleton> , std::shared_ptr<const RetargetPlan>> m_plans;
+};
+
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static bool fileStatus(const std::string& path , bool& isDirectory , uint64_t& size)
+{
+#ifdef _WIN32
+    struct _stat64 st;
+    if (_stat64(path.c_str() , &st) != 0)
+        return false;
+    isDirectory = (st.st_mode & _S_IFDIR) != 0;
+#else
+    struct stat st;
+    if (stat(path.c_str() , &st) != 0)
+        return false;
+    isDirectory = S_ISDIR(st.st_mode);
+#endif
+    size = static_cast<uint64_t>(st.st_size);
+    return true;
+}
+
+static bool makeDirectory(const std::string& path)
+{
+#ifdef _WIN32
+    _mkdir(path.c_str());
+#else
+    mkdir(path.c_str() , 0777);
+#endif
+    bool isDirectory = false;
+    uint64_t size = 0;
+    return fileStatus(path , isDirectory , size) && isDirectory;
+}
+
+static bool hasBvhExtension(const std::string& name)
+{
+    if (name.size() < 4)
+        return false;
+    std::string extension = name.substr(name.size() - 4);
+    std::transform(extension.begin() , extension.end() , extension.begin() , [](char c) { return static_cast<char>(std::tolower(static_cast<unsigned char>(c))); });
+    return extension == ".bvh";
+}
+
+//!
+//! \brief collectFiles Add the *.bvh files below \a directory to \a files.
+//! \param subdirectory The path of \a directory below the directory given on the command line
+//!
+static void collectFiles(const std::string& directory , const std::string& subdirectory , std::vector<InputFile>& files)
+{
+    std::vector<std::string> names;
+#ifdef _WIN32
+    WIN32_FIND_DATAA data;
+    HANDLE find = FindFirstFileA((directory + "/*").c_str() , &data);
+    if (find != INVALID_HANDLE_VALUE)
+    {
+        do
+        {
+            if (data.cFileName[0] != '.')
+                names.push_back(data.cFileName);
+        } while (FindNextFileA(find , &data));
+        FindClose(find);
+    }
+#else
+    if (DIR* dir = opendir(directory.c_str()))
+    {
+        while (dirent* entry = readdir(dir))
+        {
+            if (entry->d_name[0] != '.')
+                names.push_back(entry->d_name);
+        }
+        closedir(dir);
+    }
+#endif
+    std::sort(names.begin() , names.end());
+
+    for (const std::string& name : names)
+    {
+        const std::string path = directory + "/" + name;
+        bool isDirectory = false;
+        uint64_t size = 0;
+        if (!fileStatus(path , isDirectory , size))
+            continue;
+        if (isDirectory)
+            collectFiles(path , subdirectory.empty() ? name : subdirectory + "/" + name , files);
+        else if (hasBvhExtension(name))
+            files.push_back(InputFile { path , subdirectory , size });
+    }
+}
+
+static bool readList(const std::string& filename , std::vector<std::string>& inputs)
+{
+    std::ifstream in(filename);
+    if (!in)
+        return false;
+
+    std::string line;
+    while (std::getline(in , line))
+    {
+        while (!line.empty() && std::isspace(static_cast<unsigned char>(line.back())))
+            line.pop_back();
+        size_t first = 0;
+        while (first < line.size() && std::isspace(static_cast<unsigned char>(line[first])))
+            ++first;
+        if (first < line.size() && line[first] != '#')
+            inputs.push_back(line.substr(first));
+    }
+    return true;
+}
+
+static std::vector<std::string> splitNames(const std::string& text)
+{
+    std::vector<std::string> names;
+    size_t first = 0;
+    while (first <= text.size())
+    {
+        size_t last = text.find(',' , first);
+        if (last == std::string::npos)
+            last = text.size();
+        if (last > first)
+            names.push_back(text.substr(first , last - first));
+        first = last + 1;
+    }
+    return names;
+}
+
+static bool parseNumber(const char* text , double& value)
+{
+    char* end = nullptr;
+    value = std::strtod(text , &end);
+    return end != text && *end == '\0';
+}
+
+//!
+//! \brief parseInteger A decimal integer in [minimum , INT_MAX] , nothing may follow it.
+//!
+static bool parseInteger(const char* text , int minimum , int& value)
+{
+    char* end = nullptr;
+    errno = 0;
+    const long number = std::strtol(text , &end , 10);
+    if (end == text || *end != '\0' || errno == ERANGE || number < minimum || number > INT_MAX)
+        return false;
+    value = static_cast<int>(number);
+    return true;
+}
+
+//!
+//! \brief parseArguments Fill \a options from the command line.
+//! \return false with a message on stderr if an argument is not valid
+//!
+static bool parseArguments(int argc , char* argv[] , ConvertOptions& options , bool& showHelp)
+{
+    showHelp = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string argument = argv[i];
+        const bool hasValue = i + 1 < argc;
+        auto missingValue = [&argument]() {
+            std::fprintf(stderr , "bvhparser: %s needs a value\n" , argument.c_str());
+            return false;
+        };
+        double number = 0.0;
+
+        if (argument == "-h" || argument == "--help")
+        {
+            showHelp = true;
+        }
+        else if (argument == "-q" || argument == "--quiet")
+        {
+            options.quiet = true;
+        }
+        else if (argument == "--prune-nubs")
+        {
+            options.pruneNubs = true;
+        }
+        else if (argument == "--list")
+        {
+            if (!hasValue)
+                return missingValue();
+            if (!readList(argv[++i] , options.inputs))
+            {
+                std::fprintf(stderr , "bvhparser: can not read the list %s\n" , argv[i]);
+                return false;
+            }
+        }
+        else if (argument == "-o" || argument == "--output")
+        {
+            if (!hasValue)
+                return missingValue();
+            options.outputDirectory = argv[++i];
+        }
+        else if (argument == "--suffix")
+        {
+            if (!hasValue)
+                return missingValue();
+            options.suffix = argv[++i];
+            options.hasSuffix = true;
+        }
+        else if (argument == "--format")
+        {
+            if (!hasValue)
+                return missingValue();
+            const std::string format = argv[++i];
+            if (format == "text")
+                options.format = OutputFormat::Text;
+            else if (format == "binary")
+                options.format = OutputFormat::Binary;
+            else if (format == "archive")
+                options.format = OutputFormat::Archive;
+            else
+            {
+                std::fprintf(stderr , "bvhparser: unknown format %s\n" , format.c_str());
+                return false;
+            }
+        }
+        else if (argument == "--precision")
+        {
+            if (!hasValue)
+                return missingValue();
+            if (!parseNumber(argv[++i] , number) || number < 0.0)
+            {
+                std::fprintf(stderr , "bvhparser: invalid precision %s\n" , argv[i]);
+                return false;
+            }
+            options.precision = number;
+        }
+        else if (argument == "--drop")
+        {
+            if (!hasValue)
+                return missingValue();
+            const std::vector<std::string> names = splitNames(argv[++i]);
+            options.dropNames.insert(options.dropNames.end() , names.begin() , names.end());
+        }
+        else if (argument == "--max-depth")
+        {
+            if (!hasValue)
+                return missingValue();
+            if (!parseInteger(argv[++i] , 0 , options.maxDepth))
+            {
+                std::fprintf(stderr , "bvhparser: invalid depth %s\n" , argv[i]);
+                return false;
+            }
+        }
+        else if (argument == "--fps")
+        {
+            if (!hasValue)
+                return missingValue();
+            if (!parseNumber(argv[++i] , number) || number <= 0.0)
+            {
+                std::fprintf(stderr , "bvhparser: invalid frame rate %s\n" , argv[i]);
+                return false;
+            }
+            options.frameRate = number;
+        }
+        else if (argument == "--retarget")
+        {
+            if (!hasValue)
+                return missingValue();
+            options.retargetFile = argv[++i];
+        }
+        else if (argument == "-j" || argument == "--jobs")
+        {
+            if (!hasValue)
+                return missingValue();
+            int jobs = 0;
+            if (!parseInteger(argv[++i] , 1 , jobs))
+            {
+                std::fprintf(stderr , "bvhparser: invalid job count %s\n" , argv[i]);
+                return false;
+            }
+            options.jobs = static_cast<unsigned>(jobs);
+        }
+        else if (argument == "--cache")
+        {
+            if (!hasValue)
+                return missingValue();
+            options.cacheDirectory = argv[++i];
+        }
+        else if (argument == "--cache-budget")
+        {
+            if (!hasValue)
+                return missingValue();
+            if (!parseNumber(argv[++i] , number) || number < 0.0)
+            {
+                std::fprintf(stderr , "bvhparser: invalid cache budget %s\n" , argv[i]);
+                return false;
+            }
+            options.cacheBudget = static_cast<uint64_t>(number * 1024.0 * 1024.0);
+        }
+        else if (argument.size() > 1 && argument[0] == '-')
+        {
+            std::fprintf(stderr , "bvhparser: unknown option %s\n" , argument.c_str());
+            return false;
+        }
+        else
+        {
+            options.inputs.push_back(argument);
+        }
+    }
+    return true;
+}
+
+//!
+//! \brief outputPath The file \a input is written to.
+//!
+static std::string outputPath(const InputFile& file , const ConvertOptions& options)
+{
+    const std::string& input = file.path;
+    const size_t slash = input.find_last_of("/\\");
+    const std::string directory = slash == std::string::npos ? std::string(".") : input.substr(0 , slash);
+    std::string stem = slash == std::string::npos ? input : input.substr(slash + 1);
+    const size_t dot = stem.find_last_of('.');
+    if (dot != std::string::npos && dot != 0)
+        stem.resize(dot);
+
+    const char* extension = options.format == OutputFormat::Binary ? ".bvhb" :
+                            options.format == OutputFormat::Archive ? ".bvha" : ".bvh";
+    const std::string suffix = options.hasSuffix ? options.suffix :
+                               (options.outputDirectory.empty() ? std::string("_new") : std::string());
+    if (options.outputDirectory.empty())
+        return directory + "/" + stem + suffix + extension;
+    if (file.subdirectory.empty())
+        return options.outputDirectory + "/" + stem + suffix + extension;
+    return options.outputDirectory + "/" + file.subdirectory + "/" + stem + suffix + extension;
+}
+
+static bool writeDocument(const BvhDocument& doc , const std::string& path , const ConvertOptions& options)
+{
+    switch (options.format)
+    {
+    case OutputFormat::Binary:
+        return doc.toBinaryFile(path);
+    case OutputFormat::Archive:
+    {
+        ArchiveOptions archiveOptions;
+        if (options.precision > 0.0)
+            archiveOptions.precision = static_cast<float>(options.precision);
+        return MotionArchive::write(doc , path , archiveOptions);
+    }
+    default:
+    {
+        WriteOptions writeOptions;
+        writeOptions.threadCount = 0;
+        if (options.precision >= 0.0)
+            writeOptions.precision = static_cast<int>(options.precision);
+        return doc.toFile(path , writeOptions);
+    }
+    }
+}
+
+//!
+//! \brief convertFile Run the pipeline on one file.
+//! \remarks The steps may use the global pool , so a large file which is converted last is
+//!          helped by the threads which have run out of files.
+//!
+static FileResult convertFile(const InputFile& input , const ConvertOptions& options , const PruneRules* rules ,
+                              RetargetPlans* plans , ParseCache* cache , std::string& error)
+{
+    FileResult result;
+    const auto start = std::chrono::steady_clock::now();
+
+    ParseOptions parseOptions;
+    parseOptions.threadCount = 0;
+    parseOptions.cache = cache;
+    std::unique_ptr<BvhDocument> doc(new BvhDocument(BvhDocument::fromFile(input.path , parseOptions)));
+    result.loadSeconds = secondsSince(start);
+    if (doc->isEmpty())
+    {
+        error = "can not be parsed";
+        return result;
+    }
+
+    if (rules)
+    {
+        doc.reset(new BvhDocument(pruneDocument(*doc , *rules)));
+    }
+    if (options.frameRate > 0.0)
+    {
+        doc.reset(new BvhDocument(resampleDocument(*doc , static_cast<float>(1.0 / options.frameRate))));
+        if (doc->isEmpty())
+        {
+            error = "can not be resampled , its frame time is not positive";
+            return result;
+        }
+    }
+    if (plans)
+    {
+        std::shared_ptr<const RetargetPlan> plan = plans->planFor(*doc);
+        if (plan->mappedJointCount() == 0)
+        {
+            error = "has no joint in common with the retarget skeleton";
+            return result;
+        }
+        doc.reset(new BvhDocument(plan->apply(*doc)));
+    }
+
+    const std::string path = outputPath(input , options);
+    if (path == input.path)
+    {
+        error = "would be overwritten , use --suffix or --output";
+        return result;
+    }
+    if (!input.subdirectory.empty() && !options.outputDirectory.empty())
+    {
+        //! One level at a time , other threads may create the same directories
+        for (size_t slash = path.find('/' , options.outputDirectory.size() + 1); slash != std::string::npos; slash = path.find('/' , slash + 1))
+            makeDirectory(path.substr(0 , slash));
+    }
+    if (!writeDocument(*doc , path , options))
+    {
+        error = "can not be written to " + path;
+        return result;
+    }
+
+    result.ok = true;
+    result.frames = doc->frameCount();
+    result.seconds = secondsSince(start);
+    return result;
+}
+
 int main(int argc , char* argv[])
 {
-    BvhDocument doc = BvhDocument::fromFile("./bvh_0.bvh");
-    doc.toFile("./bvh_0_new.bvh");
-    Joint* s = SubstractJoints(doc.rootJoint());
-    BvhDocument dst;
-    dst.loadRootJoint(s);
-    dst.toFile("./bvh_0_new2.bvh");
-    return 0;
+    ConvertOptions options;
+    bool showHelp = false;
+    if (!parseArguments(argc , argv , options , showHelp))
+    {
+        std::fputs(Usage , stderr);
+        return 2;
+    }
+    if (showHelp || options.inputs.empty())
+    {
+        std::fputs(Usage , showHelp ? stdout : stderr);
+        return showHelp ? 0 : 2;
+    }
+
+    std::vector<InputFile> files;
+    for (const std::string& input : options.inputs)
+    {
+        bool isDirectory = false;
+        uint64_t size = 0;
+        if (!fileStatus(input , isDirectory , size))
+        {
+            std::fprintf(stderr , "bvhparser: %s does not exist\n" , input.c_str());
+            return 2;
+        }
+        if (isDirectory)
+            collectFiles(input , std::string() , files);
+        else
+            files.push_back(InputFile { input , std::string() , size });
+    }
+
+    if (!options.outputDirectory.empty() && !makeDirectory(options.outputDirectory))
+    {
+        std::fprintf(stderr , "bvhparser: can not create %s\n" , options.outputDirectory.c_str());
+        return 2;
+    }
+
+    std::unique_ptr<PruneRules> rules;
+    if (options.pruneNubs || !options.dropNames.empty() || options.maxDepth >= 0)
+    {
+        rules.reset(new PruneRules());
+        if (!options.dropNames.empty())
+            rules->drop(PruneRules::named(options.dropNames));
+        if (options.pruneNubs)
+        {
+            rules->collapse(PruneRules::fingerNubs());
+        }
+        if (options.maxDepth >= 0)
+            rules->collapse(PruneRules::deeperThan(options.maxDepth));
+    }
+
+    std::unique_ptr<RetargetPlans> plans;
+    if (!options.retargetFile.empty())
+    {
+        BvhDocument target = BvhDocument::fromFile(options.retargetFile);
+        if (target.isEmpty())
+        {
+            std::fprintf(stderr , "bvhparser: can not parse the retarget skeleton %s\n" , options.retargetFile.c_str());
+            return 2;
+        }
+        plans.reset(new RetargetPlans(target));
+    }
+
+    std::unique_ptr<ParseCache> cache;
+    if (!options.cacheDirectory.empty())
+        cache.reset(new ParseCache(options.cacheDirectory , options.cacheBudget));
+
+    //! Largest first , so the longest files do not start last and keep one thread busy at the end
+    std::stable_sort(files.begin() , files.end() , [](const InputFile& a , const InputFile& b) { return a.size > b.size; });
+
+    const unsigned jobs = options.jobs != 0 ? options.jobs : ThreadPool::hardwareThreads();
+    std::mutex printMutex;
+    std::atomic<size_t> failed(0);
+    std::atomic<size_t> frames(0);
+    std::atomic<uint64_t> bytes(0);
+    const auto start = std::chrono::steady_clock::now();
+    auto convert = [&](size_t i) {
+        const InputFile& input = files[i];
+        std::string error;
+        const FileResult result = convertFile(input , options , rules.get() , plans.get() , cache.get() , error);
+
+        std::lock_guard<std::mutex> lock(printMutex);
+        if (!result.ok)
+        {
+            failed.fetch_add(1);
+            std::fprintf(stderr , "bvhparser: %s %s\n" , input.path.c_str() , error.c_str());
+            return;
+        }
+        frames.fetch_add(result.frames);
+        bytes.fetch_add(input.size);
+        if (!options.quiet)
+        {
+            const double megabytes = input.size / (1024.0 * 1024.0);
+            std::printf("%s: %.2f MB , %zu frames , load %.3f s , total %.3f s , %.1f MB/s\n" ,
+                        input.path.c_str() , megabytes , result.frames , result.loadSeconds , result.seconds ,
+                        result.seconds > 0.0 ? megabytes / result.seconds : 0.0);
+        }
+    };
+    if (jobs > 1)
+    {
+        //! The calling thread is one of the jobs
+        ThreadPool pool(jobs - 1);
+        pool.parallelFor(files.size() , convert , jobs);
+    }
+    else
+    {
+        for (size_t i = 0; i < files.size(); ++i)
+            convert(i);
+    }
+    const double seconds = secondsSince(start);
+
+    const double megabytes = bytes.load() / (1024.0 * 1024.0);
+    std::printf("%zu files , %zu failed , %.2f MB , %zu frames in %.3f s with %u jobs: %.1f MB/s , %.0f frames/s\n" ,
+                files.size() , failed.load() , megabytes , frames.load() , seconds , jobs ,
+                seconds > 0.0 ? megabytes / seconds : 0.0 , seconds > 0.0 ? frames.load() / seconds : 0.0);
+    if (cache)
+    {
+        std::printf("cache: %llu hits , %llu misses , %llu evicted\n" ,
+                    static_cast<unsigned long long>(cache->hitCount()) ,
+                    static_cast<unsigned long long>(cache->missCount()) ,
+                    static_cast<unsigned long long>(cache->evictionCount()));
+    }
+    return failed.load() == 0 ? 0 : 1;
 }
@@ -0,0 +1,142 @@
+﻿#include "mappedfile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace BVH;
+
+MappedFile::MappedFile()
+{
+
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string &filename , Access access)
+{
+    close();
+
+    HANDLE file = CreateFileA(filename.c_str() , GENERIC_READ , FILE_SHARE_READ , nullptr ,
+                              OPEN_EXISTING , access == ReadOnly ? FILE_FLAG_SEQUENTIAL_SCAN : 0 , nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file , &size))
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    m_access = access;
+    if (size.QuadPart == 0)
+    {
+        CloseHandle(file);
+        m_isOpen = true;
+        return true;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file , nullptr , access == CopyOnWrite ? PAGE_WRITECOPY : PAGE_READONLY , 0 , 0 , nullptr);
+    if (mapping == nullptr)
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    void* view = MapViewOfFile(mapping , access == CopyOnWrite ? FILE_MAP_COPY : FILE_MAP_READ , 0 , 0 , 0);
+    if (view == nullptr)
+    {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    m_file = file;
+    m_mapping = mapping;
+    m_data = static_cast<const char*>(view);
+    m_size = static_cast<size_t>(size.QuadPart);
+    m_isOpen = true;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (m_data)
+        UnmapViewOfFile(m_data);
+    if (m_mapping)
+        CloseHandle(m_mapping);
+    if (m_file)
+        CloseHandle(m_file);
+
+    m_file = nullptr;
+    m_mapping = nullptr;
+    m_data = nullptr;
+    m_size = 0;
+    m_isOpen = false;
+    m_access = ReadOnly;
+}
+
+#else
+
+bool MappedFile::open(const std::string &filename , Access access)
+{
+    close();
+
+    int fd = ::open(filename.c_str() , O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd , &st) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    m_access = access;
+    if (st.st_size == 0)
+    {
+        ::close(fd);
+        m_isOpen = true;
+        return true;
+    }
+
+    int protection = access == CopyOnWrite ? PROT_READ | PROT_WRITE : PROT_READ;
+    void* view = mmap(nullptr , static_cast<size_t>(st.st_size) , protection , MAP_PRIVATE , fd , 0);
+    //! The mapping keeps its own reference to the file
+    ::close(fd);
+    if (view == MAP_FAILED)
+        return false;
+
+    if (access == ReadOnly)
+        madvise(view , static_cast<size_t>(st.st_size) , MADV_SEQUENTIAL);
+
+    m_data = static_cast<const char*>(view);
+    m_size = static_cast<size_t>(st.st_size);
+    m_isOpen = true;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (m_data)
+        munmap(const_cast<char*>(m_data) , m_size);
+
+    m_data = nullptr;
+    m_size = 0;
+    m_isOpen = false;
+    m_access = ReadOnly;
+}
+
+#endif
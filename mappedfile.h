@@ -0,0 +1,69 @@
+﻿#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <string>
+#include <cstddef>
+
+namespace BVH {
+
+//!
+//! \brief The MappedFile class Read-only memory mapping of a whole file.
+//! \remarks The mapped bytes stay valid until close() is called or the object is destructed.
+//!
+class MappedFile {
+public:
+    enum Access {
+        //! Read only , the pages are expected to be read front to back
+        ReadOnly ,
+        //! Writable private pages , writes never reach the file
+        CopyOnWrite ,
+        //! Read only , without the front to back read ahead hint
+        RandomAccess
+    };
+
+    MappedFile();
+    ~MappedFile();
+
+    //!
+    //! \brief open Map the file into memory.
+    //! \param filename The name of the file
+    //! \param access How the mapped pages may be used
+    //! \return true if the file was opened and mapped, otherwise false
+    //! \remarks An empty file is opened successfully with data() == nullptr and size() == 0.
+    //!
+    bool open(const std::string& filename , Access access = ReadOnly);
+
+    //!
+    //! \brief close Unmap the file.
+    //!
+    void close();
+
+    bool isOpen() const { return m_isOpen; }
+    const char* data() const { return m_data; }
+
+    //!
+    //! \brief writableData The mapped bytes , only valid in CopyOnWrite mode.
+    //!
+    char* writableData() const { return m_access == CopyOnWrite ? const_cast<char*>(m_data) : nullptr; }
+    size_t size() const { return m_size; }
+    const char* begin() const { return m_data; }
+    const char* end() const { return m_data + m_size; }
+
+private:
+    MappedFile(const MappedFile& other) = delete;
+    MappedFile& operator = (const MappedFile& other) = delete;
+
+    bool m_isOpen = false;
+    Access m_access = ReadOnly;
+    const char* m_data = nullptr;
+    size_t m_size = 0;
+
+#ifdef _WIN32
+    void* m_file = nullptr;
+    void* m_mapping = nullptr;
+#endif
+};
+
+}
+
+#endif // MAPPEDFILE_H
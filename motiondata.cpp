@@ -0,0 +1,229 @@
+﻿#include "motiondata.h"
+#include "bvh.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <new>
+
+using namespace BVH;
+
+//!
+//! \brief allocateFloats Aligned memory for \a count floats , nullptr for none.
+//! \remarks Throws std::bad_alloc like new when the memory can not be allocated.
+//!
+static float* allocateFloats(size_t count)
+{
+    if (count == 0)
+        return nullptr;
+    if (count > (std::numeric_limits<size_t>::max() - MotionStore::Alignment) / sizeof(float))
+        throw std::bad_alloc();
+    size_t bytes = (count * sizeof(float) + MotionStore::Alignment - 1) / MotionStore::Alignment * MotionStore::Alignment;
+#ifdef _WIN32
+    void* p = _aligned_malloc(bytes , MotionStore::Alignment);
+#else
+    void* p = nullptr;
+    if (posix_memalign(&p , MotionStore::Alignment , bytes) != 0)
+        p = nullptr;
+#endif
+    if (!p)
+        throw std::bad_alloc();
+    return static_cast<float*>(p);
+}
+
+static void freeFloats(float* p)
+{
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
+MotionStore::MotionStore()
+{
+
+}
+
+MotionStore::~MotionStore()
+{
+    if (!m_owner)
+        freeFloats(m_data);
+}
+
+void MotionStore::resize(size_t frameCount)
+{
+    load();
+    if (frameCount > m_frameCapacity)
+    {
+        reallocate(std::max(frameCount , m_frameCapacity * 2));
+    }
+    if (frameCount > m_frameCount)
+    {
+        std::memset(row(m_frameCount) , 0 , (frameCount - m_frameCount) * m_channelCount * sizeof(float));
+    }
+    m_frameCount = frameCount;
+}
+
+void MotionStore::reserve(size_t frameCount)
+{
+    load();
+    if (frameCount > m_frameCapacity)
+    {
+        reallocate(frameCount);
+    }
+}
+
+void MotionStore::setLoader(const std::function<void (MotionStore &)> &loader)
+{
+    std::lock_guard<std::mutex> lock(m_loadMutex);
+    m_loader = loader;
+    m_pending.store(static_cast<bool>(loader) , std::memory_order_release);
+}
+
+void MotionStore::runLoader()
+{
+    std::lock_guard<std::mutex> lock(m_loadMutex);
+    if (!m_pending.load(std::memory_order_relaxed))
+        return;
+
+    //! The loader fills a plain store , this one stays pending until its frames are complete
+    MotionStore frames;
+    frames.m_channelCount = m_channelCount;
+    m_loader(frames);
+
+    if (!m_owner)
+        freeFloats(m_data);
+    m_data = frames.m_data;
+    m_owner = frames.m_owner;
+    m_frameCount = frames.m_frameCount;
+    m_frameCapacity = frames.m_frameCapacity;
+    frames.m_data = nullptr;
+    frames.m_owner.reset();
+
+    m_loader = nullptr;
+    m_pending.store(false , std::memory_order_release);
+}
+
+void MotionStore::reallocate(size_t frameCapacity)
+{
+    if (m_channelCount != 0 && frameCapacity > std::numeric_limits<size_t>::max() / m_channelCount)
+        throw std::bad_alloc();
+    float* data = allocateFloats(frameCapacity * m_channelCount);
+    if (m_data && m_frameCount)
+    {
+        std::memcpy(data , m_data , m_frameCount * m_channelCount * sizeof(float));
+    }
+    if (!m_owner)
+        freeFloats(m_data);
+    m_owner.reset();
+    m_data = data;
+    m_frameCapacity = frameCapacity;
+}
+
+bool MotionStore::isBoundTo(const std::vector<Joint *> &joints) const
+{
+    if (joints.size() != m_offsets.size())
+        return false;
+
+    for (size_t i = 0; i < joints.size(); ++i)
+    {
+        const Joint* joint = joints[i];
+        if (joint->m_motion.get() != this || joint->m_channelOffset != m_offsets[i])
+            return false;
+        if (i + 1 < joints.size() && m_offsets[i] + joint->channelCount() != m_offsets[i + 1])
+            return false;
+    }
+    return joints.empty() || m_offsets.back() + joints.back()->channelCount() == m_channelCount;
+}
+
+bool MotionStore::bind(const std::vector<Joint *> &joints)
+{
+    if (joints.size() != m_offsets.size())
+        return false;
+
+    for (size_t i = 0; i < joints.size(); ++i)
+    {
+        size_t end = i + 1 < joints.size() ? m_offsets[i + 1] : m_channelCount;
+        if (m_offsets[i] + joints[i]->channelCount() != end)
+            return false;
+    }
+
+    std::shared_ptr<MotionStore> store = shared_from_this();
+    for (size_t i = 0; i < joints.size(); ++i)
+    {
+        Joint* joint = joints[i];
+        joint->m_motion = store;
+        joint->m_channelOffset = m_offsets[i];
+        std::vector<float>().swap(joint->m_frameData);
+    }
+    return true;
+}
+
+std::shared_ptr<MotionStore> MotionStore::create(const std::vector<Joint *> &joints , size_t frameCount)
+{
+    std::shared_ptr<MotionStore> store = std::make_shared<MotionStore>();
+    for (Joint* joint : joints)
+    {
+        store->m_offsets.push_back(store->m_channelCount);
+        store->m_channelCount += joint->channelCount();
+    }
+    store->resize(frameCount);
+
+    for (size_t i = 0; i < joints.size(); ++i)
+    {
+        Joint* joint = joints[i];
+        joint->m_motion = store;
+        joint->m_channelOffset = store->m_offsets[i];
+        std::vector<float>().swap(joint->m_frameData);
+    }
+    return store;
+}
+
+std::shared_ptr<MotionStore> MotionStore::copyOf(const std::vector<Joint *> &joints)
+{
+    std::shared_ptr<MotionStore> store = std::make_shared<MotionStore>();
+    size_t frameCount = 0;
+    for (const Joint* joint : joints)
+    {
+        store->m_offsets.push_back(store->m_channelCount);
+        store->m_channelCount += joint->channelCount();
+        frameCount = std::max(frameCount , joint->frameCount());
+    }
+    store->resize(frameCount);
+
+    for (size_t i = 0; i < joints.size(); ++i)
+    {
+        ConstFrameDataView values = static_cast<const Joint*>(joints[i])->frameData();
+        for (size_t f = 0; f < values.frameCount(); ++f)
+        {
+            std::memcpy(store->row(f) + store->m_offsets[i] , values.frame(f) , values.channels() * sizeof(float));
+        }
+    }
+    return store;
+}
+
+std::shared_ptr<MotionStore> MotionStore::pack(const std::vector<Joint *> &joints)
+{
+    //! Copy first , binding a joint drops the values it holds
+    std::shared_ptr<MotionStore> store = copyOf(joints);
+    for (size_t i = 0; i < joints.size(); ++i)
+    {
+        Joint* joint = joints[i];
+        joint->m_motion = store;
+        joint->m_channelOffset = store->m_offsets[i];
+        std::vector<float>().swap(joint->m_frameData);
+    }
+    return store;
+}
+
+std::shared_ptr<MotionStore> MotionStore::wrap(const std::vector<Joint *> &joints , float *data ,
+                                               size_t frameCount , const std::shared_ptr<void> &owner)
+{
+    std::shared_ptr<MotionStore> store = create(joints);
+    store->m_data = data;
+    store->m_owner = owner;
+    store->m_frameCount = frameCount;
+    store->m_frameCapacity = frameCount;
+    return store;
+}
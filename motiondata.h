@@ -0,0 +1,244 @@
+﻿#ifndef MOTIONDATA_H
+#define MOTIONDATA_H
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace BVH {
+
+class Joint;
+
+//!
+//! \brief The Span class A contiguous range of values which is not owned.
+//!
+template <typename T>
+class Span {
+public:
+    Span() {}
+    Span(T* data , size_t size) : m_data(data) , m_size(size) {}
+
+    T* data() const { return m_data; }
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    T& operator [] (size_t index) const { return m_data[index]; }
+    T* begin() const { return m_data; }
+    T* end() const { return m_data + m_size; }
+
+private:
+    T* m_data = nullptr;
+    size_t m_size = 0;
+};
+
+//!
+//! \brief The StridedSpan class Every stride-th value of a range, e.g. one channel over all frames.
+//!
+template <typename T>
+class StridedSpan {
+public:
+    StridedSpan() {}
+    StridedSpan(T* data , size_t size , size_t stride) : m_data(data) , m_size(size) , m_stride(stride) {}
+
+    T* data() const { return m_data; }
+    size_t size() const { return m_size; }
+    size_t stride() const { return m_stride; }
+    bool empty() const { return m_size == 0; }
+    T& operator [] (size_t index) const { return m_data[index * m_stride]; }
+
+private:
+    T* m_data = nullptr;
+    size_t m_size = 0;
+    size_t m_stride = 0;
+};
+
+//!
+//! \brief The BasicFrameDataView class The motion values of one joint.
+//! \remarks The values are laid out like the former per joint vector: for every frame the
+//!          position x , y , z (only if the joint has position channels) and then the rotation
+//!          x , y , z. Index i therefore is channel i % channels() of frame i / channels().
+//!          The view stays valid until the hierarchy or the motion of the document is changed.
+//!
+template <typename T>
+class BasicFrameDataView {
+public:
+    BasicFrameDataView() {}
+    BasicFrameDataView(T* data , size_t frameCount , size_t channels , size_t stride)
+        : m_data(data) , m_frameCount(frameCount) , m_channels(channels) , m_stride(stride)
+    {
+
+    }
+
+    size_t frameCount() const { return m_frameCount; }
+    size_t channels() const { return m_channels; }
+    size_t size() const { return m_frameCount * m_channels; }
+    bool empty() const { return m_frameCount == 0; }
+
+    //!
+    //! \brief frame The channels() values of one frame.
+    //!
+    T* frame(size_t frame) const { return m_data + frame * m_stride; }
+
+    T& operator [] (size_t index) const
+    {
+        return m_data[index / m_channels * m_stride + index % m_channels];
+    }
+
+    std::vector<float> toVector() const
+    {
+        std::vector<float> ret(size());
+        for (size_t i = 0; i < m_frameCount; ++i)
+        {
+            for (size_t k = 0; k < m_channels; ++k)
+            {
+                ret[i * m_channels + k] = frame(i)[k];
+            }
+        }
+        return ret;
+    }
+
+private:
+    T* m_data = nullptr;
+    size_t m_frameCount = 0;
+    size_t m_channels = 3;
+    size_t m_stride = 3;
+};
+
+typedef BasicFrameDataView<float> FrameDataView;
+typedef BasicFrameDataView<const float> ConstFrameDataView;
+
+//!
+//! \brief The MotionStore class The motion of a whole document in one frame-major matrix.
+//! \remarks Row f holds the channels of frame f for every joint which has channels, in the order
+//!          the joints appear in the file. Each joint keeps its position in the row (its channel
+//!          offset) and reads its values through a FrameDataView. The matrix is one allocation
+//!          which starts on a 64 byte boundary.
+//!
+class MotionStore : public std::enable_shared_from_this<MotionStore> {
+public:
+    static const size_t Alignment = 64;
+
+    MotionStore();
+    ~MotionStore();
+
+    size_t frameCount() const { load(); return m_frameCount; }
+    size_t channelCount() const { return m_channelCount; }
+
+    //!
+    //! \brief jointCount The number of joints which have channels.
+    //!
+    size_t jointCount() const { return m_offsets.size(); }
+    size_t channelOffset(size_t jointIndex) const { return m_offsets[jointIndex]; }
+
+    float* data() { load(); return m_data; }
+    const float* data() const { load(); return m_data; }
+
+    float* row(size_t frame) { load(); return m_data + frame * m_channelCount; }
+    const float* row(size_t frame) const { load(); return m_data + frame * m_channelCount; }
+
+    //!
+    //! \brief setLoader Decode the frames only when they are first accessed.
+    //! \param loader Fills an empty store with the channels of this one , it runs once on the
+    //!        first call of frameCount() , data() , row() , resize() or reserve()
+    //! \remarks The first access may come from several threads , the others wait for the loader.
+    //!
+    void setLoader(const std::function<void(MotionStore&)>& loader);
+
+    //!
+    //! \brief isLoaded Whether the frames are decoded , always true without a loader.
+    //!
+    bool isLoaded() const { return !m_pending.load(std::memory_order_acquire); }
+
+    //!
+    //! \brief load Run the pending loader now.
+    //!
+    void load() const
+    {
+        if (m_pending.load(std::memory_order_acquire))
+            const_cast<MotionStore*>(this)->runLoader();
+    }
+
+    //!
+    //! \brief resize Change the number of frames, existing frames are kept and new ones are zero.
+    //! \remarks Throws std::bad_alloc if the frames can not be allocated , the store is unchanged then.
+    //!
+    void resize(size_t frameCount);
+
+    //!
+    //! \brief reserve Make room for \a frameCount frames without changing frameCount().
+    //! \remarks Throws std::bad_alloc like resize().
+    //!
+    void reserve(size_t frameCount);
+
+    //!
+    //! \brief isBoundTo Whether \a joints are exactly the joints bound to this store , in row order.
+    //!
+    bool isBoundTo(const std::vector<Joint*>& joints) const;
+
+    //!
+    //! \brief bind Bind \a joints to the rows of this store , e.g. joints built again from a Skeleton.
+    //! \return false and nothing is bound if their channels do not fit the rows
+    //! \remarks Values the joints held before are dropped , the frames are not loaded.
+    //!
+    bool bind(const std::vector<Joint*>& joints);
+
+    //!
+    //! \brief create Create an empty store for \a joints and bind them to it.
+    //! \param joints The joints which have channels, in file order
+    //! \remarks Values the joints held before are dropped.
+    //!
+    static std::shared_ptr<MotionStore> create(const std::vector<Joint*>& joints , size_t frameCount = 0);
+
+    //!
+    //! \brief copyOf Copy the current values of \a joints into a new store without binding them.
+    //! \remarks Joints with fewer frames than the others are padded with zeros.
+    //!
+    static std::shared_ptr<MotionStore> copyOf(const std::vector<Joint*>& joints);
+
+    //!
+    //! \brief pack Copy the current values of \a joints into a new store and bind them to it.
+    //!
+    static std::shared_ptr<MotionStore> pack(const std::vector<Joint*>& joints);
+
+    //!
+    //! \brief wrap Bind \a joints to a matrix which lives in memory owned by somebody else.
+    //! \param data frameCount rows of the channels of \a joints , 64 byte aligned
+    //! \param owner Kept alive as long as the store uses \a data , e.g. a memory mapped file
+    //! \remarks The store copies the matrix into its own memory only when it has to grow.
+    //!
+    static std::shared_ptr<MotionStore> wrap(const std::vector<Joint*>& joints , float* data ,
+                                             size_t frameCount , const std::shared_ptr<void>& owner);
+
+private:
+    MotionStore(const MotionStore& other) = delete;
+    MotionStore& operator = (const MotionStore& other) = delete;
+
+    void reallocate(size_t frameCapacity);
+    void runLoader();
+
+    float* m_data = nullptr;
+
+    //!
+    //! \brief m_owner The owner of m_data if the store did not allocate it
+    //!
+    std::shared_ptr<void> m_owner;
+
+    size_t m_frameCount = 0;
+    size_t m_frameCapacity = 0;
+    size_t m_channelCount = 0;
+
+    //!
+    //! \brief m_offsets The first column of every bound joint
+    //!
+    std::vector<size_t> m_offsets;
+
+    std::function<void(MotionStore&)> m_loader;
+    std::atomic<bool> m_pending{false};
+    std::mutex m_loadMutex;
+};
+
+}
+
+#endif // MOTIONDATA_H
@@ -0,0 +1,49 @@
+﻿#ifndef NAMEHASH_H
+#define NAMEHASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace BVH {
+
+//!
+//! \brief NameHashSeed The start value of nameHash().
+//! \remarks FNV-1a with this seed maps every name of the 3DMaxBiped and the BioVision tables to a
+//!          different slot of the 512 slot lookup tables in bvh.cpp , a static_assert checks it.
+//!
+const uint32_t NameHashSeed = 0x811C9FC9u;
+
+//!
+//! \brief literalNameHash nameHash() of a null terminated name , usable in constant expressions.
+//!
+constexpr uint32_t literalNameHash(const char* text , uint32_t hash = NameHashSeed)
+{
+    return *text ? literalNameHash(text + 1 , (hash ^ static_cast<uint8_t>(*text)) * 16777619u) : hash;
+}
+
+//!
+//! \brief nameHash The hash of a joint name.
+//!
+inline uint32_t nameHash(const char* text , size_t size)
+{
+    uint32_t hash = NameHashSeed;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash = (hash ^ static_cast<uint8_t>(text[i])) * 16777619u;
+    }
+    return hash;
+}
+
+inline uint32_t nameHash(const std::string& name) { return nameHash(name.data() , name.size()); }
+
+//!
+//! \brief The NameHasher struct nameHash() for hash containers.
+//!
+struct NameHasher {
+    size_t operator () (const std::string& name) const { return nameHash(name); }
+};
+
+}
+
+#endif // NAMEHASH_H
@@ -0,0 +1,313 @@
+﻿#include "parsecache.h"
+#include "mappedfile.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#include <process.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/utime.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <utime.h>
+#endif
+
+using namespace BVH;
+
+//! Changes whenever the images or the keys change , old images are then never hit
+static const uint64_t KeyVersion = 1;
+
+//! FileStamp hashes this many bytes at the front and at the back of a file
+static const size_t StampBytes = 64 * 1024;
+
+//! Temporary files older than this were left behind by a process which died while writing
+static const int64_t StaleSeconds = 3600;
+
+static const char ImageSuffix[] = ".bvhb";
+static const char TemporarySuffix[] = ".tmp";
+
+static inline uint64_t rotateLeft(uint64_t value , int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+//!
+//! \brief hashBytes A 64 bit hash which reads 32 bytes per step in four independent lanes.
+//!
+static uint64_t hashBytes(const char* data , size_t size , uint64_t seed)
+{
+    static const uint64_t Prime1 = 0x9E3779B185EBCA87ULL;
+    static const uint64_t Prime2 = 0xC2B2AE3D27D4EB4FULL;
+
+    uint64_t lanes[4] = { seed + Prime1 + Prime2 , seed + Prime2 , seed , seed - Prime1 };
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32)
+    {
+        for (size_t k = 0; k < 4; ++k)
+        {
+            uint64_t word;
+            std::memcpy(&word , data + i + 8 * k , sizeof(word));
+            lanes[k] = rotateLeft(lanes[k] + word * Prime2 , 31) * Prime1;
+        }
+    }
+
+    uint64_t hash = rotateLeft(lanes[0] , 1) + rotateLeft(lanes[1] , 7) + rotateLeft(lanes[2] , 12) + rotateLeft(lanes[3] , 18);
+    hash += size;
+    for (; i < size; ++i)
+    {
+        hash = (hash ^ static_cast<uint8_t>(data[i])) * Prime1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= Prime2;
+    hash ^= hash >> 29;
+    return hash;
+}
+
+static bool makeDirectory(const std::string& path)
+{
+#ifdef _WIN32
+    if (_mkdir(path.c_str()) == 0)
+        return true;
+    struct _stat64 st;
+    return _stat64(path.c_str() , &st) == 0 && (st.st_mode & _S_IFDIR);
+#else
+    if (mkdir(path.c_str() , 0777) == 0)
+        return true;
+    struct stat st;
+    return stat(path.c_str() , &st) == 0 && S_ISDIR(st.st_mode);
+#endif
+}
+
+static bool fileStamp(const std::string& path , uint64_t& size , int64_t& modified)
+{
+#ifdef _WIN32
+    struct _stat64 st;
+    if (_stat64(path.c_str() , &st) != 0)
+        return false;
+#else
+    struct stat st;
+    if (stat(path.c_str() , &st) != 0)
+        return false;
+#endif
+    size = static_cast<uint64_t>(st.st_size);
+    modified = static_cast<int64_t>(st.st_mtime);
+    return true;
+}
+
+//!
+//! \brief touch Set the modification time to now , it orders the images for trim().
+//!
+static void touch(const std::string& path)
+{
+#ifdef _WIN32
+    _utime(path.c_str() , nullptr);
+#else
+    utime(path.c_str() , nullptr);
+#endif
+}
+
+static bool replaceFile(const std::string& from , const std::string& to)
+{
+#ifdef _WIN32
+    return MoveFileExA(from.c_str() , to.c_str() , MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return std::rename(from.c_str() , to.c_str()) == 0;
+#endif
+}
+
+static unsigned long processId()
+{
+#ifdef _WIN32
+    return static_cast<unsigned long>(_getpid());
+#else
+    return static_cast<unsigned long>(getpid());
+#endif
+}
+
+static bool endsWith(const std::string& text , const char* suffix)
+{
+    const size_t size = std::strlen(suffix);
+    return text.size() >= size && text.compare(text.size() - size , size , suffix) == 0;
+}
+
+//!
+//! \brief listDirectory The names of the files in \a directory.
+//!
+static std::vector<std::string> listDirectory(const std::string& directory)
+{
+    std::vector<std::string> names;
+#ifdef _WIN32
+    WIN32_FIND_DATAA data;
+    HANDLE find = FindFirstFileA((directory + "/*").c_str() , &data);
+    if (find == INVALID_HANDLE_VALUE)
+        return names;
+    do
+    {
+        if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+            names.push_back(data.cFileName);
+    } while (FindNextFileA(find , &data));
+    FindClose(find);
+#else
+    DIR* dir = opendir(directory.c_str());
+    if (!dir)
+        return names;
+    while (dirent* entry = readdir(dir))
+    {
+        if (entry->d_name[0] != '.')
+            names.push_back(entry->d_name);
+    }
+    closedir(dir);
+#endif
+    return names;
+}
+
+ParseCache::ParseCache(const std::string &directory , uint64_t sizeBudget , KeyMode keyMode)
+    : m_directory(directory) , m_keyMode(keyMode) , m_sizeBudget(sizeBudget)
+{
+    while (m_directory.size() > 1 && (m_directory.back() == '/' || m_directory.back() == '\\'))
+        m_directory.pop_back();
+    makeDirectory(m_directory);
+}
+
+std::string ParseCache::imagePath(const std::string &key) const
+{
+    return m_directory + "/" + key + ImageSuffix;
+}
+
+std::string ParseCache::key(const std::string &filename , const ParseOptions &options) const
+{
+    uint64_t size = 0;
+    int64_t modified = 0;
+    if (!fileStamp(filename , size , modified))
+        return std::string();
+
+    MappedFile file;
+    if (!file.open(filename , m_keyMode == ContentHash ? MappedFile::ReadOnly : MappedFile::RandomAccess))
+        return std::string();
+
+    //! Only the options which change the parsed values
+    uint64_t hash = hashBytes(reinterpret_cast<const char*>(&KeyVersion) , sizeof(KeyVersion) , options.exactFloats ? 1 : 0);
+    hash = hashBytes(reinterpret_cast<const char*>(&size) , sizeof(size) , hash);
+    if (m_keyMode == ContentHash || file.size() <= 2 * StampBytes)
+    {
+        hash = hashBytes(file.data() , file.size() , hash);
+    }
+    else
+    {
+        hash = hashBytes(reinterpret_cast<const char*>(&modified) , sizeof(modified) , hash);
+        hash = hashBytes(file.data() , StampBytes , hash);
+        hash = hashBytes(file.end() - StampBytes , StampBytes , hash);
+    }
+
+    char text[17];
+    std::snprintf(text , sizeof(text) , "%016llx" , static_cast<unsigned long long>(hash));
+    return text;
+}
+
+BvhDocument ParseCache::load(const std::string &filename , const ParseOptions &options)
+{
+    ParseOptions parseOptions = options;
+    parseOptions.cache = nullptr;
+
+    const std::string imageKey = key(filename , options);
+    if (imageKey.empty())
+    {
+        m_misses.fetch_add(1 , std::memory_order_relaxed);
+        return BvhDocument::fromFile(filename , parseOptions);
+    }
+
+    //! A damaged or foreign image is read as empty and replaced like a missing one
+    const std::string path = imagePath(imageKey);
+    BvhDocument image = BvhDocument::fromBinaryFile(path , parseOptions);
+    if (!image.isEmpty())
+    {
+        touch(path);
+        m_hits.fetch_add(1 , std::memory_order_relaxed);
+        return image;
+    }
+
+    m_misses.fetch_add(1 , std::memory_order_relaxed);
+    BvhDocument doc = BvhDocument::fromFile(filename , parseOptions);
+    if (doc.isEmpty())
+        return doc;
+
+    //! Readers never see a partial image , they find the old one , the new one or none
+    const std::string temporary = path + "." + std::to_string(processId()) + "." +
+                                  std::to_string(m_writes.fetch_add(1)) + TemporarySuffix;
+    if (doc.toBinaryFile(temporary) && replaceFile(temporary , path))
+    {
+        const uint64_t budget = sizeBudget();
+        if (budget != 0)
+            trim(budget);
+    }
+    else
+    {
+        std::remove(temporary.c_str());
+    }
+    return doc;
+}
+
+void ParseCache::resetCounters()
+{
+    m_hits.store(0 , std::memory_order_relaxed);
+    m_misses.store(0 , std::memory_order_relaxed);
+    m_evictions.store(0 , std::memory_order_relaxed);
+}
+
+uint64_t ParseCache::trim(uint64_t bytes)
+{
+    std::lock_guard<std::mutex> lock(m_trimMutex);
+
+    struct Image {
+        std::string path;
+        uint64_t size;
+        int64_t modified;
+    };
+
+    std::vector<Image> images;
+    uint64_t total = 0;
+    const int64_t now = static_cast<int64_t>(std::time(nullptr));
+    for (const std::string& name : listDirectory(m_directory))
+    {
+        Image image { m_directory + "/" + name , 0 , 0 };
+        if (!fileStamp(image.path , image.size , image.modified))
+            continue;
+
+        if (endsWith(name , TemporarySuffix))
+        {
+            if (now - image.modified > StaleSeconds)
+                std::remove(image.path.c_str());
+        }
+        else if (endsWith(name , ImageSuffix))
+        {
+            images.push_back(image);
+            total += image.size;
+        }
+    }
+
+    //! Least recently used first , hits touch their image
+    std::sort(images.begin() , images.end() , [](const Image& a , const Image& b) { return a.modified < b.modified; });
+    for (const Image& image : images)
+    {
+        if (total <= bytes)
+            break;
+
+        //! A mapped image stays readable after it is removed , except on Windows where removing fails
+        if (std::remove(image.path.c_str()) == 0)
+        {
+            total -= image.size;
+            m_evictions.fetch_add(1 , std::memory_order_relaxed);
+        }
+    }
+    return total;
+}
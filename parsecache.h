@@ -0,0 +1,98 @@
+﻿#ifndef PARSECACHE_H
+#define PARSECACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include "bvh.h"
+
+namespace BVH {
+
+//!
+//! \brief The ParseCache class Parsed bvh files kept as .bvhb images in a directory.
+//! \remarks Every file is looked up by a key of its content: a 64 bit hash of all bytes with
+//!          ContentHash , or the size , the modification time and a hash of the first and the
+//!          last 64 KiB with FileStamp , which does not read the whole file. Options which change
+//!          the parsed values are part of the key. A hit opens the image with
+//!          BvhDocument::fromBinaryFile() , which maps it instead of parsing text. A miss parses
+//!          the file and stores its image.
+//!
+//!          Several threads and processes may share one directory. An image is written to a file
+//!          of its own and renamed to its final name , so a reader either finds a complete image or
+//!          none , and images which are removed stay readable by those who mapped them.
+//!
+//!          With a size budget the images which were used least recently are removed after an
+//!          image was stored , until the directory fits the budget.
+//!
+//!          Pass the cache in ParseOptions::cache to let BvhDocument::fromFile() use it.
+//!
+class ParseCache {
+public:
+    enum KeyMode {
+        ContentHash ,
+        FileStamp
+    };
+
+    //!
+    //! \brief ParseCache Use \a directory , it is created if it does not exist.
+    //! \param sizeBudget The bytes the images may take , 0 for no limit
+    //!
+    explicit ParseCache(const std::string& directory , uint64_t sizeBudget = 0 , KeyMode keyMode = FileStamp);
+
+    const std::string& directory() const { return m_directory; }
+    KeyMode keyMode() const { return m_keyMode; }
+
+    uint64_t sizeBudget() const { return m_sizeBudget.load(std::memory_order_relaxed); }
+    void setSizeBudget(uint64_t bytes) { m_sizeBudget.store(bytes , std::memory_order_relaxed); }
+
+    //!
+    //! \brief load The document in \a filename , from the cache if it holds an image of it.
+    //! \return An empty document if the file can not be parsed , such documents are not cached
+    //!
+    BvhDocument load(const std::string& filename , const ParseOptions& options = ParseOptions());
+
+    //!
+    //! \brief key The name of the image of \a filename , an empty string if the file can not be read.
+    //!
+    std::string key(const std::string& filename , const ParseOptions& options = ParseOptions()) const;
+
+    uint64_t hitCount() const { return m_hits.load(std::memory_order_relaxed); }
+    uint64_t missCount() const { return m_misses.load(std::memory_order_relaxed); }
+    uint64_t evictionCount() const { return m_evictions.load(std::memory_order_relaxed); }
+    void resetCounters();
+
+    //!
+    //! \brief trim Remove the least recently used images until they take at most \a bytes.
+    //! \return The bytes the images take afterwards
+    //!
+    uint64_t trim(uint64_t bytes);
+
+    //!
+    //! \brief clear Remove every image.
+    //!
+    void clear() { trim(0); }
+
+private:
+    ParseCache(const ParseCache& other) = delete;
+    ParseCache& operator = (const ParseCache& other) = delete;
+
+    std::string imagePath(const std::string& key) const;
+
+    std::string m_directory;
+    KeyMode m_keyMode;
+    std::atomic<uint64_t> m_sizeBudget;
+    std::atomic<uint64_t> m_hits{0};
+    std::atomic<uint64_t> m_misses{0};
+    std::atomic<uint64_t> m_evictions{0};
+    std::atomic<uint64_t> m_writes{0};
+
+    //!
+    //! \brief m_trimMutex Lets one thread of the process trim at a time
+    //!
+    std::mutex m_trimMutex;
+};
+
+}
+
+#endif // PARSECACHE_H
@@ -0,0 +1,225 @@
+﻿#include "prune.h"
+#include "namehash.h"
+#include <cstring>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+using namespace BVH;
+
+PruneRules &PruneRules::add(PruneAction action , const Predicate &predicate)
+{
+    m_rules.push_back(Rule { action , predicate });
+    return *this;
+}
+
+PruneAction PruneRules::actionFor(const Joint *joint) const
+{
+    for (const Rule& rule : m_rules)
+    {
+        if (rule.predicate(joint))
+            return rule.action;
+    }
+    return PruneAction::Keep;
+}
+
+PruneRules::Predicate PruneRules::named(const std::vector<std::string> &names)
+{
+    std::unordered_set<std::string , NameHasher> set(names.begin() , names.end());
+    return [set](const Joint* joint) { return set.count(joint->jointName()) != 0; };
+}
+
+PruneRules::Predicate PruneRules::fingerNubs()
+{
+    return named({
+        "LeftFinger1Nub" , "LeftFinger2Nub" , "LeftFinger3Nub" , "LeftFinger4Nub" ,
+        "RightFinger1Nub" , "RightFinger2Nub" , "RightFinger3Nub" , "RightFinger4Nub"
+    });
+}
+
+PruneRules::Predicate PruneRules::ofType(JointType_3DMaxBiped type)
+{
+    return [type](const Joint* joint) { return jointTypeFromName_3DMaxBiped(joint->jointName()) == type; };
+}
+
+PruneRules::Predicate PruneRules::ofType(JointType_BioVision type)
+{
+    return [type](const Joint* joint) { return jointTypeFromName_BioVision(joint->jointName()) == type; };
+}
+
+PruneRules::Predicate PruneRules::deeperThan(int depth)
+{
+    return [depth](const Joint* joint) { return joint->depth() > depth; };
+}
+
+static Joint* copyJoint(const Joint* src , Joint* parent , bool isEndSite)
+{
+    Joint* j = new Joint(parent);
+    j->setAsEndSite(isEndSite);
+    j->setOffset(src->x() , src->y() , src->z());
+    j->setJointName(src->jointName());
+    j->setPositionAxisOrder(src->positionAxisOrder());
+    j->setRotationAxisOrder(src->rotationAxisOrder());
+    return j;
+}
+
+typedef std::vector<std::pair<Joint* , const Joint*>> JointCopies;
+
+//!
+//! \brief pruneHierarchy pruneJoints() , \a copies receives every copy and its source joint.
+//! \remarks The copies which are not End Sites are listed in pre-order.
+//!
+static Joint* pruneHierarchy(const Joint* root , const PruneRules& rules , JointCopies& copies)
+{
+    //! The copy of the last kept joint on every level below root
+    std::vector<Joint*> levels(1 , copyJoint(root , nullptr , root->isEndSite()));
+    copies.push_back(std::make_pair(levels.front() , root));
+
+    const Joint* joint = Joint::nextPreOrder(root , root);
+    while (joint)
+    {
+        const PruneAction action = rules.actionFor(joint);
+        if (action == PruneAction::Drop)
+        {
+            joint = Joint::nextPreOrder(joint , root , true);
+            continue;
+        }
+
+        const size_t level = static_cast<size_t>(joint->depth() - root->depth());
+        const bool isEndSite = joint->isEndSite() || action == PruneAction::Collapse;
+        Joint* copy = copyJoint(joint , levels[level - 1] , isEndSite);
+        copies.push_back(std::make_pair(copy , joint));
+        if (isEndSite)
+        {
+            joint = Joint::nextPreOrder(joint , root , true);
+            continue;
+        }
+        levels.resize(level);
+        levels.push_back(copy);
+        joint = Joint::nextPreOrder(joint , root);
+    }
+
+    //! Close the chains whose children were all dropped
+    const size_t keptCount = copies.size();
+    for (size_t i = 0; i < keptCount; ++i)
+    {
+        Joint* copy = copies[i].first;
+        const Joint* src = copies[i].second;
+        if (!copy->isEndSite() && copy->childrenCount() == 0 && src->childrenCount() != 0)
+        {
+            copies.push_back(std::make_pair(copyJoint(src->childAt(0) , copy , true) , src->childAt(0)));
+        }
+    }
+    return levels.front();
+}
+
+Joint *BVH::pruneJoints(const Joint *root , const PruneRules &rules)
+{
+    if (!root)
+        return nullptr;
+
+    JointCopies copies;
+    return pruneHierarchy(root , rules , copies);
+}
+
+namespace {
+
+//!
+//! \brief The ColumnRun struct Adjacent columns which are copied together.
+//!
+struct ColumnRun {
+    size_t source;
+    size_t target;
+    size_t count;
+};
+
+}
+
+//!
+//! \brief bindPrunedMotion Bind the joints below \a root to the columns of the kept joints in \a motion.
+//! \param sourceSequence The joints of the rows of \a motion
+//! \remarks They are bound to \a motion itself if every column is kept , otherwise to a store which
+//!          copies the kept columns on its first access.
+//!
+static void bindPrunedMotion(const std::shared_ptr<MotionStore>& motion , const std::vector<Joint*>& sourceSequence ,
+                             const JointCopies& copies , Joint* root)
+{
+    std::unordered_map<const Joint* , size_t> columns;
+    size_t column = 0;
+    for (const Joint* joint : sourceSequence)
+    {
+        columns[joint] = column;
+        column += joint->channelCount();
+    }
+
+    //! The kept joints are in the order of the source , so their columns form a few long runs
+    std::vector<ColumnRun> runs;
+    size_t target = 0;
+    for (const auto& copy : copies)
+    {
+        auto found = columns.find(copy.second);
+        if (copy.first->isEndSite() || found == columns.end())
+            continue;
+
+        const size_t count = copy.first->channelCount();
+        if (!runs.empty() && runs.back().source + runs.back().count == found->second)
+            runs.back().count += count;
+        else
+            runs.push_back(ColumnRun { found->second , target , count });
+        target += count;
+    }
+
+    //! Nothing with channels was removed , the rows are the same
+    const std::vector<Joint*>& jointSequence = root->channelJoints();
+    if (target == motion->channelCount() && runs.size() <= 1 && (runs.empty() || runs.front().source == 0) &&
+        motion->bind(jointSequence))
+        return;
+
+    std::shared_ptr<MotionStore> frames = MotionStore::create(jointSequence);
+    frames->setLoader([motion , runs](MotionStore& store) {
+        const size_t frameCount = motion->frameCount();
+        const size_t stride = motion->channelCount();
+        store.resize(frameCount);
+        const float* from = motion->data();
+        for (size_t f = 0; f < frameCount; ++f , from += stride)
+        {
+            float* to = store.row(f);
+            for (const ColumnRun& run : runs)
+                std::memcpy(to + run.target , from + run.source , run.count * sizeof(float));
+        }
+    });
+}
+
+BvhDocument BVH::pruneDocument(const BvhDocument &source , const PruneRules &rules)
+{
+    if (source.isEmpty())
+        return BvhDocument();
+
+    JointCopies copies;
+    Joint* root = pruneHierarchy(source.rootJoint() , rules , copies);
+    bindPrunedMotion(source.currentMotion() , source.rootJoint()->channelJoints() , copies , root);
+
+    //! The joints are bound to the pruned store , the document adopts it
+    BvhDocument doc;
+    doc.loadRootJoint(root);
+    doc.setFrameInterval(source.frameInterval());
+    return doc;
+}
+
+Joint *BVH::SubstractJoints(const Joint *src)
+{
+    PruneRules rules;
+    rules.collapse(PruneRules::fingerNubs());
+
+    JointCopies copies;
+    Joint* root = pruneHierarchy(src , rules , copies);
+
+    //! Joints bound to a store share it , others are copied into one first
+    const std::vector<Joint*>& sourceSequence = src->channelJoints();
+    MotionStore* store = sourceSequence.empty() ? nullptr : sourceSequence.front()->motionStore();
+    std::shared_ptr<MotionStore> motion = store && store->isBoundTo(sourceSequence) ?
+                                          store->shared_from_this() : MotionStore::copyOf(sourceSequence);
+    bindPrunedMotion(motion , sourceSequence , copies , root);
+    return root;
+}
@@ -0,0 +1,95 @@
+﻿#ifndef PRUNE_H
+#define PRUNE_H
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "bvh.h"
+
+namespace BVH {
+
+//!
+//! \brief The PruneAction enum What pruneJoints() does with a joint.
+//!
+enum class PruneAction {
+    Keep ,          //!< Keep the joint and look at its children
+    Drop ,          //!< Remove the joint and its subtree
+    Collapse        //!< Replace the joint and its subtree by an End Site at the joint
+};
+
+//!
+//! \brief The PruneRules class Decides which joints of a hierarchy survive pruneJoints().
+//! \remarks The rules are tried in the order they were added , the first rule whose predicate
+//!          matches decides. Joints no rule matches are kept. A typical level of detail keeps
+//!          the joints it needs and collapses everything else:
+//!
+//!          PruneRules rules;
+//!          rules.keep(PruneRules::named({ "LeftHand" , "RightHand" })).collapse(PruneRules::deeperThan(4));
+//!
+class PruneRules {
+public:
+    typedef std::function<bool(const Joint*)> Predicate;
+
+    PruneRules& add(PruneAction action , const Predicate& predicate);
+    PruneRules& keep(const Predicate& predicate) { return add(PruneAction::Keep , predicate); }
+    PruneRules& drop(const Predicate& predicate) { return add(PruneAction::Drop , predicate); }
+    PruneRules& collapse(const Predicate& predicate) { return add(PruneAction::Collapse , predicate); }
+
+    bool isEmpty() const { return m_rules.empty(); }
+
+    //!
+    //! \brief actionFor The action of the first rule which matches \a joint , Keep if none does.
+    //!
+    PruneAction actionFor(const Joint* joint) const;
+
+    //!
+    //! \brief named Matches joints whose name is one of \a names.
+    //!
+    static Predicate named(const std::vector<std::string>& names);
+
+    //!
+    //! \brief fingerNubs Matches the finger Nub joints , LeftFinger1Nub ... RightFinger4Nub.
+    //!
+    static Predicate fingerNubs();
+
+    //!
+    //! \brief ofType Matches joints whose name is the name of \a type.
+    //!
+    static Predicate ofType(JointType_3DMaxBiped type);
+    static Predicate ofType(JointType_BioVision type);
+
+    //!
+    //! \brief deeperThan Matches joints whose Joint::depth() is larger than \a depth.
+    //!
+    static Predicate deeperThan(int depth);
+
+private:
+    struct Rule {
+        PruneAction action;
+        Predicate predicate;
+    };
+
+    std::vector<Rule> m_rules;
+};
+
+//!
+//! \brief pruneJoints Copy the hierarchy below \a root without the joints \a rules remove.
+//! \return The root of the copy , owned by the caller. The joints hold no motion values.
+//! \remarks The root itself is always kept. Dropping every child of a joint would leave a chain
+//!          without an end , so its first dropped child then becomes an End Site instead.
+//!
+Joint* pruneJoints(const Joint* root , const PruneRules& rules);
+
+//!
+//! \brief pruneDocument A document with the hierarchy of pruneJoints() and the motion of the kept joints.
+//! \remarks If no joint with channels is removed the result shares the MotionStore of the source ,
+//!          value edits of either document then show in the other. Otherwise the kept columns are
+//!          copied into a store of their own on its first access , in one pass over the frames with
+//!          one memcpy per run of adjacent kept columns. Until then the result only keeps the
+//!          source store alive and sees its edits.
+//!
+BvhDocument pruneDocument(const BvhDocument& source , const PruneRules& rules);
+
+}
+
+#endif // PRUNE_H
@@ -0,0 +1,305 @@
+﻿#include "quantize.h"
+#include "rotationkernels.h"
+#include "threadpool.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+
+using namespace BVH;
+
+//! Frames quantized or decoded at once , the quaternions of a block stay in the cache
+static const size_t QuantizeGrain = 64;
+
+//! The three smaller components of a unit quaternion lie in [-1 / sqrt(2) , 1 / sqrt(2)]
+static const float SmallestRange = 0.70710678f;
+static const float SmallestStep = 2.0f * SmallestRange / 1023.0f;
+
+static inline uint32_t packComponent(float value)
+{
+    const float q = (value + SmallestRange) * (1.0f / SmallestStep) + 0.5f;
+    return static_cast<uint32_t>(std::min(1023.0f , std::max(0.0f , q)));
+}
+
+//!
+//! \brief packQuaternion The index of the largest component in bits 30 - 31 , the others in
+//!        bits 20 - 29 , 10 - 19 and 0 - 9 , negated if the largest one is negative.
+//!
+static uint32_t packQuaternion(const float* q)
+{
+    uint32_t largest = 0;
+    for (uint32_t k = 1; k < 4; ++k)
+    {
+        if (std::fabs(q[k]) > std::fabs(q[largest]))
+            largest = k;
+    }
+    const float sign = q[largest] < 0.0f ? -1.0f : 1.0f;
+    uint32_t packed = largest << 30;
+    int shift = 20;
+    for (uint32_t k = 0; k < 4; ++k)
+    {
+        if (k == largest)
+            continue;
+        packed |= packComponent(q[k] * sign) << shift;
+        shift -= 10;
+    }
+    return packed;
+}
+
+//!
+//! \brief unpackQuaternion The inverse of packQuaternion() , without branches.
+//!
+static inline void unpackQuaternion(uint32_t packed , float* q)
+{
+    const uint32_t largest = packed >> 30;
+    const float a = static_cast<float>((packed >> 20) & 1023) * SmallestStep - SmallestRange;
+    const float b = static_cast<float>((packed >> 10) & 1023) * SmallestStep - SmallestRange;
+    const float c = static_cast<float>(packed & 1023) * SmallestStep - SmallestRange;
+    const float d = std::sqrt(std::max(0.0f , 1.0f - a * a - b * b - c * c));
+    q[0] = largest == 0 ? d : a;
+    q[1] = largest == 0 ? a : (largest == 1 ? d : b);
+    q[2] = largest <= 1 ? b : (largest == 2 ? d : c);
+    q[3] = largest == 3 ? d : c;
+}
+
+//!
+//! \brief rotationAngle The angle between two unit quaternions in degrees , from their chord
+//!        which stays accurate for small angles unlike acos of the dot product.
+//!
+static double rotationAngle(const float* p , const float* q)
+{
+    double dot = 0.0;
+    for (size_t k = 0; k < 4; ++k)
+        dot += static_cast<double>(p[k]) * q[k];
+    const double sign = dot < 0.0 ? -1.0 : 1.0;
+    double chord = 0.0;
+    for (size_t k = 0; k < 4; ++k)
+    {
+        const double d = static_cast<double>(p[k]) - sign * q[k];
+        chord += d * d;
+    }
+    return 4.0 * std::asin(std::min(1.0 , std::sqrt(chord) * 0.5)) * (180.0 / 3.14159265358979323846);
+}
+
+QuantizedMotion::QuantizedMotion()
+{
+
+}
+
+QuantizedMotion QuantizedMotion::quantize(const BvhDocument &document , const QuantizeOptions &options)
+{
+    QuantizedMotion quantized;
+    if (document.isEmpty())
+        return quantized;
+
+    const std::shared_ptr<const Skeleton> skeleton = document.skeleton();
+    std::shared_ptr<MotionStore> motion = document.currentMotion();
+
+    quantized.m_skeleton = *skeleton;
+    quantized.m_rotationEncoding = options.rotationEncoding;
+    quantized.m_frameInterval = document.frameInterval();
+    quantized.m_frameCount = motion->frameCount();
+    quantized.m_channelCount = motion->channelCount();
+
+    uint32_t channel = 0;
+    for (size_t i = 0; i < skeleton->jointCount(); ++i)
+    {
+        const size_t channelCount = skeleton->jointChannelCount(i);
+        if (channelCount == 0)
+            continue;
+        const uint32_t positionCount = channelCount == 6 ? 3 : 0;
+        for (uint32_t k = 0; k < positionCount; ++k)
+            quantized.m_rangeChannels.push_back(channel + k);
+        if (options.rotationEncoding == QuantizeOptions::SmallestThree)
+        {
+            quantized.m_quaternionJoints.push_back(QuaternionJoint { channel + positionCount , skeleton->rotationAxisOrder(i) });
+        }
+        else
+        {
+            for (uint32_t k = 0; k < 3; ++k)
+                quantized.m_rangeChannels.push_back(channel + positionCount + k);
+        }
+        channel += static_cast<uint32_t>(channelCount);
+    }
+
+    const size_t frameCount = quantized.m_frameCount;
+    const size_t stride = quantized.m_channelCount;
+    const size_t rangeCount = quantized.m_rangeChannels.size();
+    const size_t quaternionCount = quantized.m_quaternionJoints.size();
+    const float* rows = motion->data();
+
+    std::vector<float> minimums(rangeCount , std::numeric_limits<float>::infinity());
+    std::vector<float> maximums(rangeCount , -std::numeric_limits<float>::infinity());
+    for (size_t f = 0; f < frameCount; ++f)
+    {
+        const float* row = rows + f * stride;
+        for (size_t k = 0; k < rangeCount; ++k)
+        {
+            const float value = row[quantized.m_rangeChannels[k]];
+            minimums[k] = std::min(minimums[k] , value);
+            maximums[k] = std::max(maximums[k] , value);
+        }
+    }
+    std::vector<float> scales(rangeCount , 0.0f);
+    for (size_t k = 0; k < rangeCount; ++k)
+    {
+        if (!(minimums[k] <= maximums[k]))
+            minimums[k] = maximums[k] = 0.0f;
+        const float step = (maximums[k] - minimums[k]) / 65535.0f;
+        quantized.m_rangeMinimums.push_back(minimums[k]);
+        quantized.m_rangeSteps.push_back(step);
+        scales[k] = step > 0.0f ? 1.0f / step : 0.0f;
+    }
+
+    quantized.m_rangeValues.resize(frameCount * rangeCount);
+    quantized.m_quaternionValues.resize(frameCount * quaternionCount);
+
+    ThreadPool& pool = ThreadPool::globalInstance();
+    const unsigned slots = pool.concurrency(options.threadCount);
+    std::vector<std::vector<float>> errors(slots , std::vector<float>(stride , 0.0f));
+    pool.parallelForRange(frameCount , QuantizeGrain , [&](size_t first , size_t last , size_t slot) {
+        float source[4 * QuantizeGrain];
+        float decoded[4];
+        std::vector<float>& error = errors[slot];
+        for (size_t block = first; block < last; block += QuantizeGrain)
+        {
+            const size_t count = std::min(QuantizeGrain , last - block);
+            for (size_t f = block; f < block + count; ++f)
+            {
+                const float* row = rows + f * stride;
+                uint16_t* values = quantized.m_rangeValues.data() + f * rangeCount;
+                for (size_t k = 0; k < rangeCount; ++k)
+                {
+                    const float value = row[quantized.m_rangeChannels[k]];
+                    const float q = (value - minimums[k]) * scales[k] + 0.5f;
+                    values[k] = static_cast<uint16_t>(std::min(65535.0f , std::max(0.0f , q)));
+                    const float restored = quantized.m_rangeMinimums[k] + quantized.m_rangeSteps[k] * static_cast<float>(values[k]);
+                    error[quantized.m_rangeChannels[k]] = std::max(error[quantized.m_rangeChannels[k]] , std::fabs(restored - value));
+                }
+            }
+
+            for (size_t j = 0; j < quaternionCount; ++j)
+            {
+                const QuaternionJoint& joint = quantized.m_quaternionJoints[j];
+                columnToQuaternions(joint.order , rows + block * stride + joint.rotationChannel , stride , count , source);
+                float angle = 0.0f;
+                for (size_t i = 0; i < count; ++i)
+                {
+                    uint32_t& packed = quantized.m_quaternionValues[(block + i) * quaternionCount + j];
+                    packed = packQuaternion(source + 4 * i);
+                    unpackQuaternion(packed , decoded);
+                    angle = std::max(angle , static_cast<float>(rotationAngle(source + 4 * i , decoded)));
+                }
+                for (size_t k = 0; k < 3; ++k)
+                    error[joint.rotationChannel + k] = std::max(error[joint.rotationChannel + k] , angle);
+            }
+        }
+    } , slots);
+
+    quantized.m_maxErrors.assign(stride , 0.0f);
+    for (const std::vector<float>& error : errors)
+    {
+        for (size_t c = 0; c < stride; ++c)
+            quantized.m_maxErrors[c] = std::max(quantized.m_maxErrors[c] , error[c]);
+    }
+    return quantized;
+}
+
+float QuantizedMotion::maxError() const
+{
+    float error = 0.0f;
+    for (float e : m_maxErrors)
+        error = std::max(error , e);
+    return error;
+}
+
+size_t QuantizedMotion::memorySize() const
+{
+    return m_rangeValues.size() * sizeof(uint16_t) + m_quaternionValues.size() * sizeof(uint32_t) +
+           m_rangeChannels.size() * (sizeof(uint32_t) + 2 * sizeof(float)) +
+           m_quaternionJoints.size() * sizeof(QuaternionJoint) + m_maxErrors.size() * sizeof(float);
+}
+
+void QuantizedMotion::decodeRanges(size_t first , size_t last , float *rows , size_t rowStride) const
+{
+    const size_t rangeCount = m_rangeChannels.size();
+    const float* minimums = m_rangeMinimums.data();
+    const float* steps = m_rangeSteps.data();
+    const uint16_t* values = m_rangeValues.data() + first * rangeCount;
+
+    //! With Fixed16 column k is channel k , the rows are converted as a whole
+    if (rangeCount == m_channelCount)
+    {
+        for (size_t f = first; f < last; ++f , values += rangeCount , rows += rowStride)
+        {
+            for (size_t k = 0; k < rangeCount; ++k)
+                rows[k] = minimums[k] + steps[k] * static_cast<float>(values[k]);
+        }
+        return;
+    }
+
+    const uint32_t* channels = m_rangeChannels.data();
+    for (size_t f = first; f < last; ++f , values += rangeCount , rows += rowStride)
+    {
+        for (size_t k = 0; k < rangeCount; ++k)
+            rows[channels[k]] = minimums[k] + steps[k] * static_cast<float>(values[k]);
+    }
+}
+
+void QuantizedMotion::decodeQuaternions(size_t first , size_t last , float *rows , size_t rowStride) const
+{
+    const size_t quaternionCount = m_quaternionJoints.size();
+    float quaternions[4 * QuantizeGrain];
+    float angles[3 * QuantizeGrain];
+    for (size_t block = first; block < last; block += QuantizeGrain)
+    {
+        const size_t count = std::min(QuantizeGrain , last - block);
+        for (size_t j = 0; j < quaternionCount; ++j)
+        {
+            const QuaternionJoint& joint = m_quaternionJoints[j];
+            const uint32_t* values = m_quaternionValues.data() + block * quaternionCount + j;
+            for (size_t i = 0; i < count; ++i)
+                unpackQuaternion(values[i * quaternionCount] , quaternions + 4 * i);
+            quaternionsToEuler(joint.order , quaternions , count , angles , angles + QuantizeGrain , angles + 2 * QuantizeGrain);
+
+            float* rotation = rows + (block - first) * rowStride + joint.rotationChannel;
+            for (size_t i = 0; i < count; ++i)
+            {
+                for (size_t k = 0; k < 3; ++k)
+                    rotation[i * rowStride + k] = angles[k * QuantizeGrain + i];
+            }
+        }
+    }
+}
+
+void QuantizedMotion::decode(size_t first , size_t last , float *rows , size_t rowStride) const
+{
+    decodeRanges(first , last , rows , rowStride);
+    if (!m_quaternionJoints.empty())
+        decodeQuaternions(first , last , rows , rowStride);
+}
+
+BvhDocument QuantizedMotion::toDocument(unsigned threadCount) const
+{
+    Joint* root = m_skeleton.createJoints();
+    if (!root)
+        return BvhDocument();
+
+    std::shared_ptr<const QuantizedMotion> values = std::make_shared<QuantizedMotion>(*this);
+    std::shared_ptr<MotionStore> frames = MotionStore::create(root->channelJoints());
+    frames->setLoader([values , threadCount](MotionStore& out) {
+        out.resize(values->frameCount());
+        float* rows = out.data();
+        const size_t stride = out.channelCount();
+        ThreadPool& pool = ThreadPool::globalInstance();
+        pool.parallelForRange(values->frameCount() , QuantizeGrain , [&](size_t first , size_t last , size_t) {
+            values->decode(first , last , rows + first * stride , stride);
+        } , pool.concurrency(threadCount));
+    });
+
+    //! The joints are bound to the new store , the document adopts it
+    BvhDocument doc;
+    doc.loadRootJoint(root);
+    doc.setFrameInterval(m_frameInterval);
+    return doc;
+}
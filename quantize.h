@@ -0,0 +1,130 @@
+﻿#ifndef QUANTIZE_H
+#define QUANTIZE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "bvh.h"
+#include "skeleton.h"
+
+namespace BVH {
+
+//!
+//! \brief The QuantizeOptions struct Options which control QuantizedMotion::quantize().
+//!
+struct QuantizeOptions {
+    enum RotationEncoding {
+        Fixed16 ,       //!< Every rotation channel as 16 bits in the range of the channel , 6 bytes per joint
+        SmallestThree   //!< Every joint rotation as a quaternion in 32 bits , 4 bytes per joint
+    };
+
+    RotationEncoding rotationEncoding = Fixed16;
+
+    //!
+    //! \brief threadCount The number of threads which quantize frames , 0 uses every hardware thread.
+    //!
+    unsigned threadCount = 0;
+};
+
+//!
+//! \brief The QuantizedMotion class The motion of a document in 16 or fewer bits per value.
+//! \remarks Position channels , and with Fixed16 the rotation channels as well , store the minimum
+//!          and the step of their channel and one 16 bit integer per frame , the error is half a
+//!          step: (maximum - minimum) / 131070.
+//!
+//!          SmallestThree converts the rotation of every joint into a quaternion in the channel
+//!          order of the joint , drops its largest component and keeps its index in 2 bits and the
+//!          other three in 10 bits each. The largest component is recovered from the unit length ,
+//!          the rotation is off by less than 0.3 degrees. Decoded angles describe the same rotation
+//!          as the source ones but are in the ranges of quaternionsToEuler() , so a channel may
+//!          differ from its source value by whole turns.
+//!
+//!          The values are stored frame-major like in a MotionStore , decode() expands a range of
+//!          frames with loops over whole rows which the compiler vectorizes.
+//!
+class QuantizedMotion {
+public:
+    QuantizedMotion();
+
+    //!
+    //! \brief quantize Quantize the motion of \a document.
+    //! \return Empty motion if the document has no hierarchy
+    //!
+    static QuantizedMotion quantize(const BvhDocument& document , const QuantizeOptions& options = QuantizeOptions());
+
+    bool isEmpty() const { return m_skeleton.isEmpty(); }
+
+    const Skeleton& skeleton() const { return m_skeleton; }
+    QuantizeOptions::RotationEncoding rotationEncoding() const { return m_rotationEncoding; }
+    float frameInterval() const { return m_frameInterval; }
+    size_t frameCount() const { return m_frameCount; }
+    size_t channelCount() const { return m_channelCount; }
+
+    //!
+    //! \brief maxError The largest difference between a decoded value and the source one.
+    //! \remarks With SmallestThree the error of a rotation channel is the angle between the
+    //!          decoded and the source rotation of its joint , in degrees.
+    //!
+    float maxError() const;
+    float maxError(size_t channel) const { return m_maxErrors[channel]; }
+
+    //!
+    //! \brief memorySize The bytes of the quantized values and their ranges , compare with denseSize().
+    //!
+    size_t memorySize() const;
+    size_t denseSize() const { return m_frameCount * m_channelCount * sizeof(float); }
+
+    //!
+    //! \brief decode The frames [first , last).
+    //! \param rows (last - first) rows of channelCount() values , \a rowStride floats apart
+    //!
+    void decode(size_t first , size_t last , float* rows , size_t rowStride) const;
+
+    //!
+    //! \brief toDocument A document with the hierarchy of skeleton() whose frames are decoded on
+    //!        their first access.
+    //! \param threadCount The number of threads which decode , 0 uses every hardware thread
+    //! \remarks The document shares the quantized values , until its frames are accessed it costs
+    //!          little more than memorySize().
+    //!
+    BvhDocument toDocument(unsigned threadCount = 0) const;
+
+private:
+    //!
+    //! \brief The QuaternionJoint struct A joint whose rotation is stored as smallest three.
+    //!
+    struct QuaternionJoint {
+        uint32_t rotationChannel;
+        AxisOrder order;
+    };
+
+    void decodeRanges(size_t first , size_t last , float* rows , size_t rowStride) const;
+    void decodeQuaternions(size_t first , size_t last , float* rows , size_t rowStride) const;
+
+    Skeleton m_skeleton;
+    QuantizeOptions::RotationEncoding m_rotationEncoding = QuantizeOptions::Fixed16;
+    float m_frameInterval = 0.0f;
+    size_t m_frameCount = 0;
+    size_t m_channelCount = 0;
+
+    //!
+    //! \brief m_rangeChannels The channel of every column of m_rangeValues , a channel is
+    //!        minimum + step * value
+    //!
+    std::vector<uint32_t> m_rangeChannels;
+    std::vector<float> m_rangeMinimums;
+    std::vector<float> m_rangeSteps;
+    std::vector<uint16_t> m_rangeValues;
+
+    //!
+    //! \brief m_quaternionJoints The columns of a row of m_quaternionValues
+    //!
+    std::vector<QuaternionJoint> m_quaternionJoints;
+    std::vector<uint32_t> m_quaternionValues;
+
+    std::vector<float> m_maxErrors;
+};
+
+}
+
+#endif // QUANTIZE_H
@@ -0,0 +1,195 @@
+﻿#include "resample.h"
+#include "rotationkernels.h"
+#include "skeleton.h"
+#include "threadpool.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace BVH;
+
+namespace {
+
+//!
+//! \brief The ResampleJoint struct The columns of one joint in a row.
+//!
+struct ResampleJoint {
+    int32_t positionColumn;     //!< -1 without position channels
+    int32_t rotationColumn;
+    AxisOrder rotationOrder;
+    int32_t middleAxis;         //!< 0 , 1 or 2 for the second rotation of rotationOrder
+};
+
+//!
+//! \brief The Resampler struct The data shared by all blocks of one resampleDocument() call.
+//!
+struct Resampler {
+    std::vector<ResampleJoint> joints;
+    const float* sourceRows;
+    size_t sourceFrames;
+    float* targetRows;
+    size_t stride;
+    double step;                //!< Source frames per new frame
+
+    //! weights , three angle sets and three quaternion sets of a block
+    static const size_t WorkspaceSize = ResampleGrain * (1 + 9 + 12);
+
+    void resampleBlock(size_t first , size_t count , float* workspace) const;
+};
+
+}
+
+//!
+//! \brief middleAxis The axis of the second rotation of \a order , x is 0.
+//!
+static int32_t middleAxis(AxisOrder order)
+{
+    switch (order)
+    {
+    case YXZ:
+    case ZXY:
+        return 0;
+    case XZY:
+    case YZX:
+        return 2;
+    default:
+        return 1;
+    }
+}
+
+//!
+//! \brief nearestTurn \a angle moved by whole turns as close as possible to \a reference.
+//!
+static inline float nearestTurn(float angle , float reference)
+{
+    return angle + 360.0f * std::floor((reference - angle) * (1.0f / 360.0f) + 0.5f);
+}
+
+void Resampler::resampleBlock(size_t first , size_t count , float *workspace) const
+{
+    const size_t n = ResampleGrain;
+    float* weights = workspace;
+    float* lowerAngles = weights + n;
+    float* upperAngles = lowerAngles + 3 * n;
+    float* angles = upperAngles + 3 * n;
+    float* lowerRotations = angles + 3 * n;
+    float* upperRotations = lowerRotations + 4 * n;
+    float* rotations = upperRotations + 4 * n;
+
+    const float* lower[ResampleGrain];
+    const float* upper[ResampleGrain];
+    for (size_t i = 0; i < count; ++i)
+    {
+        //! Snap to source frames which the float frame intervals miss by rounding
+        double position = static_cast<double>(first + i) * step;
+        const double nearest = std::floor(position + 0.5);
+        if (std::fabs(position - nearest) < 1e-4)
+            position = nearest;
+        const size_t frame = std::min(static_cast<size_t>(position) , sourceFrames - 1);
+        weights[i] = static_cast<float>(std::min(position - static_cast<double>(frame) , 1.0));
+        lower[i] = sourceRows + frame * stride;
+        upper[i] = sourceRows + std::min(frame + 1 , sourceFrames - 1) * stride;
+    }
+
+    float* rows = targetRows + first * stride;
+    for (const ResampleJoint& joint : joints)
+    {
+        if (joint.positionColumn >= 0)
+        {
+            const size_t c = static_cast<size_t>(joint.positionColumn);
+            for (size_t i = 0; i < count; ++i)
+            {
+                float* row = rows + i * stride;
+                for (size_t k = 0; k < 3; ++k)
+                    row[c + k] = lower[i][c + k] + weights[i] * (upper[i][c + k] - lower[i][c + k]);
+            }
+        }
+
+        const size_t c = static_cast<size_t>(joint.rotationColumn);
+        for (size_t k = 0; k < 3; ++k)
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                lowerAngles[k * n + i] = lower[i][c + k];
+                upperAngles[k * n + i] = upper[i][c + k];
+            }
+        }
+        eulerToQuaternions(joint.rotationOrder , lowerAngles , lowerAngles + n , lowerAngles + 2 * n , count , lowerRotations);
+        eulerToQuaternions(joint.rotationOrder , upperAngles , upperAngles + n , upperAngles + 2 * n , count , upperRotations);
+        slerpQuaternions(lowerRotations , upperRotations , weights , count , rotations);
+        quaternionsToEuler(joint.rotationOrder , rotations , count , angles , angles + n , angles + 2 * n);
+
+        //! (a , b , c) and (a + 180 , 180 - b , c + 180) are the same rotation , the triple next to
+        //! the earlier source frame keeps the curves continuous when the middle angle passes 90 degrees
+        const size_t middle = static_cast<size_t>(joint.middleAxis);
+        for (size_t i = 0; i < count; ++i)
+        {
+            float direct[3];
+            float alternate[3];
+            float directDistance = 0.0f;
+            float alternateDistance = 0.0f;
+            for (size_t k = 0; k < 3; ++k)
+            {
+                const float reference = lowerAngles[k * n + i];
+                const float angle = angles[k * n + i];
+                direct[k] = nearestTurn(angle , reference);
+                alternate[k] = nearestTurn(k == middle ? 180.0f - angle : angle + 180.0f , reference);
+                directDistance += std::fabs(direct[k] - reference);
+                alternateDistance += std::fabs(alternate[k] - reference);
+            }
+
+            const float* chosen = alternateDistance < directDistance ? alternate : direct;
+            for (size_t k = 0; k < 3; ++k)
+                rows[i * stride + c + k] = weights[i] == 0.0f ? lowerAngles[k * n + i] : chosen[k];
+        }
+    }
+}
+
+BvhDocument BVH::resampleDocument(const BvhDocument &source , float frameInterval , unsigned threadCount)
+{
+    if (source.isEmpty() || source.frameInterval() <= 0.0f || frameInterval <= 0.0f)
+        return BvhDocument();
+
+    const std::shared_ptr<const Skeleton> skeleton = source.skeleton();
+    std::shared_ptr<MotionStore> motion = source.currentMotion();
+
+    Resampler resampler;
+    int32_t column = 0;
+    for (size_t i = 0; i < skeleton->jointCount(); ++i)
+    {
+        const size_t channelCount = skeleton->jointChannelCount(i);
+        if (channelCount == 0)
+            continue;
+        const bool hasPosition = channelCount == 6;
+        const AxisOrder order = skeleton->rotationAxisOrder(i);
+        resampler.joints.push_back(ResampleJoint { hasPosition ? column : -1 , column + (hasPosition ? 3 : 0) ,
+                                                   order , middleAxis(order) });
+        column += static_cast<int32_t>(channelCount);
+    }
+
+    resampler.sourceFrames = motion->frameCount();
+    resampler.step = static_cast<double>(frameInterval) / source.frameInterval();
+    const size_t frameCount = resampler.sourceFrames == 0 ? 0 :
+        static_cast<size_t>((resampler.sourceFrames - 1) / resampler.step + 1e-6) + 1;
+
+    Joint* root = skeleton->createJoints();
+    std::shared_ptr<MotionStore> frames = MotionStore::create(root->channelJoints() , frameCount);
+    resampler.sourceRows = motion->data();
+    resampler.targetRows = frames->data();
+    resampler.stride = motion->channelCount();
+
+    ThreadPool& pool = ThreadPool::globalInstance();
+    const unsigned slots = pool.concurrency(threadCount);
+    std::vector<std::vector<float>> workspaces(slots , std::vector<float>(Resampler::WorkspaceSize));
+    pool.parallelForRange(frameCount , ResampleGrain , [&](size_t first , size_t last , size_t slot) {
+        for (size_t block = first; block < last; block += ResampleGrain)
+        {
+            resampler.resampleBlock(block , std::min(ResampleGrain , last - block) , workspaces[slot].data());
+        }
+    } , slots);
+
+    //! The joints are bound to the new store , the document adopts it
+    BvhDocument doc;
+    doc.loadRootJoint(root);
+    doc.setFrameInterval(frameInterval);
+    return doc;
+}
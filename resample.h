@@ -0,0 +1,34 @@
+﻿#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+#include <cstddef>
+#include "bvh.h"
+
+namespace BVH {
+
+//!
+//! \brief ResampleGrain The number of new frames a thread computes before it looks for more work.
+//!
+const size_t ResampleGrain = 64;
+
+//!
+//! \brief resampleDocument A copy of \a source with one frame every \a frameInterval seconds.
+//! \param threadCount The number of threads including the caller , 0 uses every hardware thread
+//! \return An empty document if \a source has no hierarchy or one of the frame intervals is not positive
+//! \remarks The new frames start with the first frame of \a source and end at or before its last one.
+//!          Positions are interpolated linearly. Rotations are converted into quaternions in the
+//!          channel order of their joint , interpolated with slerpQuaternions() and converted back.
+//!          Every rotation has two Euler triples , (a , b , c) and (a + 180 , 180 - b , c + 180) in
+//!          the channel order. Of both , moved by whole turns , the one next to the angles of the
+//!          earlier source frame is kept so that the curves stay continuous , also where the source
+//!          has its middle angle beyond 90 degrees. Frames which fall exactly on a source frame are
+//!          copied unchanged.
+//!
+//!          The frames are split with ThreadPool::parallelForRange() on the global pool and every
+//!          step runs over all frames of a block at once.
+//!
+BvhDocument resampleDocument(const BvhDocument& source , float frameInterval , unsigned threadCount = 0);
+
+}
+
+#endif // RESAMPLE_H
@@ -0,0 +1,519 @@
+﻿#include "retarget.h"
+#include "rotationkernels.h"
+#include "threadpool.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace BVH;
+
+static const size_t BlockFrames = RetargetPlan::BlockSize;
+
+//! The BioVision joint of every 3DMaxBiped joint , in the order of JointType_3DMaxBiped
+static const JointType_BioVision bioVisionJoints_3DMaxBiped[] = {
+    JointType_BioVision::Hip ,                  // Hip
+    JointType_BioVision::Invalid ,              // LeftHip
+    JointType_BioVision::LeftUpLeg ,            // LeftUpLeg
+    JointType_BioVision::LeftLeg ,              // LeftKnee
+    JointType_BioVision::Invalid ,              // LeftLowLeg
+    JointType_BioVision::Invalid ,              // LeftAnkle
+    JointType_BioVision::LeftFoot ,             // LeftFoot
+
+    JointType_BioVision::Invalid ,              // RightHip
+    JointType_BioVision::RightUpLeg ,           // RightUpLeg
+    JointType_BioVision::RightLeg ,             // RightKnee
+    JointType_BioVision::Invalid ,              // RightLowLeg
+    JointType_BioVision::Invalid ,              // RightAnkle
+    JointType_BioVision::RightFoot ,            // RightFoot
+
+    JointType_BioVision::Spine ,                // Chest
+    JointType_BioVision::Spine1 ,               // Chest2
+    JointType_BioVision::Spine2 ,               // Chest3
+    JointType_BioVision::Spine3 ,               // Chest4
+
+    JointType_BioVision::LeftShoulder ,         // LeftCollar
+    JointType_BioVision::Invalid ,              // LeftShoulder
+    JointType_BioVision::LeftArm ,              // LeftUpArm
+    JointType_BioVision::LeftforeArm ,          // LeftElbow
+    JointType_BioVision::Invalid ,              // LeftWrist
+    JointType_BioVision::LeftHand ,             // LeftHand
+    JointType_BioVision::LeftHandThumb1 ,       // LeftFinger0
+    JointType_BioVision::LeftHandThumb2 ,       // LeftFinger01
+    JointType_BioVision::LeftHandThumb3 ,       // LeftFinger02
+    JointType_BioVision::LeftInHandIndex1 ,     // LeftFinger1
+    JointType_BioVision::LeftInHandIndex2 ,     // LeftFinger11
+    JointType_BioVision::LeftInHandIndex3 ,     // LeftFinger12
+    JointType_BioVision::LeftInHandMiddle1 ,    // LeftFinger2
+    JointType_BioVision::LeftInHandMiddle2 ,    // LeftFinger21
+    JointType_BioVision::LeftInHandMiddle3 ,    // LeftFinger22
+    JointType_BioVision::LeftInHandRing1 ,      // LeftFinger3
+    JointType_BioVision::LeftInHandRing2 ,      // LeftFinger31
+    JointType_BioVision::LeftInHandRing3 ,      // LeftFinger32
+    JointType_BioVision::LeftInHandPinky1 ,     // LeftFinger4
+    JointType_BioVision::LeftInHandPinky2 ,     // LeftFinger41
+    JointType_BioVision::LeftInHandPinky3 ,     // LeftFinger42
+
+    JointType_BioVision::RightShoulder ,        // RightCollar
+    JointType_BioVision::Invalid ,              // RightShoulder
+    JointType_BioVision::RightArm ,             // RightUpArm
+    JointType_BioVision::RightforeArm ,         // RightElbow
+    JointType_BioVision::Invalid ,              // RightWrist
+    JointType_BioVision::RightHand ,            // RightHand
+    JointType_BioVision::RightHandThumb1 ,      // RightFinger0
+    JointType_BioVision::RightHandThumb2 ,      // RightFinger01
+    JointType_BioVision::RightHandThumb3 ,      // RightFinger02
+    JointType_BioVision::RightInHandIndex1 ,    // RightFinger1
+    JointType_BioVision::RightInHandIndex2 ,    // RightFinger11
+    JointType_BioVision::RightInHandIndex3 ,    // RightFinger12
+    JointType_BioVision::RightInHandMiddle1 ,   // RightFinger2
+    JointType_BioVision::RightInHandMiddle2 ,   // RightFinger21
+    JointType_BioVision::RightInHandMiddle3 ,   // RightFinger22
+    JointType_BioVision::RightInHandRing1 ,     // RightFinger3
+    JointType_BioVision::RightInHandRing2 ,     // RightFinger31
+    JointType_BioVision::RightInHandRing3 ,     // RightFinger32
+    JointType_BioVision::RightInHandPinky1 ,    // RightFinger4
+    JointType_BioVision::RightInHandPinky2 ,    // RightFinger41
+    JointType_BioVision::RightInHandPinky3 ,    // RightFinger42
+
+    JointType_BioVision::Neck ,                 // Neck
+    JointType_BioVision::Head ,                 // Head
+
+    JointType_BioVision::Invalid                // Invalid
+};
+
+static_assert(sizeof(bioVisionJoints_3DMaxBiped) / sizeof(bioVisionJoints_3DMaxBiped[0]) ==
+              static_cast<size_t>(JointType_3DMaxBiped::Invalid) + 1 , "One BioVision joint per 3DMaxBiped joint");
+
+JointType_BioVision BVH::bioVisionFrom3DMaxBiped(JointType_3DMaxBiped type)
+{
+    return bioVisionJoints_3DMaxBiped[static_cast<int>(type)];
+}
+
+SkeletonNaming BVH::detectNaming(const Skeleton &skeleton)
+{
+    size_t biped = 0;
+    size_t bioVision = 0;
+    for (size_t i = 0; i < skeleton.jointCount(); ++i)
+    {
+        const std::string name = skeleton.name(i);
+        if (jointTypeFromName_3DMaxBiped(name) != JointType_3DMaxBiped::Invalid)
+            ++biped;
+        if (jointTypeFromName_BioVision(name) != JointType_BioVision::Invalid)
+            ++bioVision;
+    }
+    if (biped == 0 && bioVision == 0)
+        return SkeletonNaming::Unknown;
+    return biped > bioVision ? SkeletonNaming::MaxBiped : SkeletonNaming::BioVision;
+}
+
+//!
+//! \brief jointType The JointType_BioVision of a joint as an index , -1 if it has none.
+//!
+static int jointType(const Skeleton& skeleton , size_t index , SkeletonNaming naming)
+{
+    JointType_BioVision type = JointType_BioVision::Invalid;
+    if (naming == SkeletonNaming::MaxBiped)
+        type = bioVisionFrom3DMaxBiped(jointTypeFromName_3DMaxBiped(skeleton.name(index)));
+    else if (naming == SkeletonNaming::BioVision)
+        type = jointTypeFromName_BioVision(skeleton.name(index));
+    return type == JointType_BioVision::Invalid ? -1 : static_cast<int>(type);
+}
+
+//!
+//! \brief restPositions The world position of every joint when all rotations are zero.
+//!
+static std::vector<float> restPositions(const Skeleton& skeleton)
+{
+    std::vector<float> positions(skeleton.jointCount() * 3);
+    for (size_t i = 0; i < skeleton.jointCount(); ++i)
+    {
+        const int parent = skeleton.parent(i);
+        positions[i * 3] = skeleton.x(i) + (parent < 0 ? 0.0f : positions[parent * 3]);
+        positions[i * 3 + 1] = skeleton.y(i) + (parent < 0 ? 0.0f : positions[parent * 3 + 1]);
+        positions[i * 3 + 2] = skeleton.z(i) + (parent < 0 ? 0.0f : positions[parent * 3 + 2]);
+    }
+    return positions;
+}
+
+static float restHeight(const std::vector<float>& positions)
+{
+    if (positions.empty())
+        return 0.0f;
+    float low = positions[1];
+    float high = positions[1];
+    for (size_t i = 4; i < positions.size(); i += 3)
+    {
+        low = std::min(low , positions[i]);
+        high = std::max(high , positions[i]);
+    }
+    return high - low;
+}
+
+//!
+//! \brief subtreeEnd The index after the last descendant of joint \a index.
+//!
+static size_t subtreeEnd(const Skeleton& skeleton , size_t index)
+{
+    size_t end = index + 1;
+    while (end < skeleton.jointCount() && skeleton.depth(end) > skeleton.depth(index))
+        ++end;
+    return end;
+}
+
+static bool isDescendant(const Skeleton& skeleton , int index , int ancestor)
+{
+    while (index > ancestor)
+        index = skeleton.parent(index);
+    return index == ancestor;
+}
+
+//!
+//! \brief firstEndSite The first End Site child of joint \a index , -1 if it has none.
+//!
+static int firstEndSite(const Skeleton& skeleton , size_t index)
+{
+    const size_t end = subtreeEnd(skeleton , index);
+    for (size_t i = index + 1; i < end; ++i)
+    {
+        if (skeleton.parent(i) == static_cast<int>(index) && skeleton.isEndSite(i))
+            return static_cast<int>(i);
+    }
+    return -1;
+}
+
+//!
+//! \brief shortestArc The quaternion which rotates the direction \a from onto \a to.
+//! \return false if one of the directions has no length
+//!
+static bool shortestArc(const float from[3] , const float to[3] , float q[4])
+{
+    const float fromLength = std::sqrt(from[0] * from[0] + from[1] * from[1] + from[2] * from[2]);
+    const float toLength = std::sqrt(to[0] * to[0] + to[1] * to[1] + to[2] * to[2]);
+    if (fromLength < 1e-6f || toLength < 1e-6f)
+        return false;
+
+    const float a[3] = { from[0] / fromLength , from[1] / fromLength , from[2] / fromLength };
+    const float b[3] = { to[0] / toLength , to[1] / toLength , to[2] / toLength };
+    const float d = a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    if (d < -0.999999f)
+    {
+        //! Opposite directions , turn half way round any perpendicular axis
+        float axis[3] = { 0.0f , -a[2] , a[1] };
+        if (std::fabs(a[0]) > 0.9f)
+        {
+            axis[0] = a[2] , axis[1] = 0.0f , axis[2] = -a[0];
+        }
+        const float length = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+        q[0] = axis[0] / length , q[1] = axis[1] / length , q[2] = axis[2] / length , q[3] = 0.0f;
+        return true;
+    }
+
+    q[0] = a[1] * b[2] - a[2] * b[1];
+    q[1] = a[2] * b[0] - a[0] * b[2];
+    q[2] = a[0] * b[1] - a[1] * b[0];
+    q[3] = 1.0f + d;
+    const float length = std::sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+    for (int k = 0; k < 4; ++k)
+        q[k] /= length;
+    return true;
+}
+
+//! Quaternions are x , y , z , w , the kernels below work on arrays of \a count quaternions and
+//! allow \a out to be one of the inputs.
+
+//!
+//! \brief multiplyQuaternions out[i] = a[i] * b[i]
+//!
+static void multiplyQuaternions(const float* a , const float* b , size_t count , float* out)
+{
+    for (size_t i = 0; i < count * 4; i += 4)
+    {
+        const float ax = a[i] , ay = a[i + 1] , az = a[i + 2] , aw = a[i + 3];
+        const float bx = b[i] , by = b[i + 1] , bz = b[i + 2] , bw = b[i + 3];
+        out[i] = aw * bx + ax * bw + ay * bz - az * by;
+        out[i + 1] = aw * by - ax * bz + ay * bw + az * bx;
+        out[i + 2] = aw * bz + ax * by - ay * bx + az * bw;
+        out[i + 3] = aw * bw - ax * bx - ay * by - az * bz;
+    }
+}
+
+//!
+//! \brief multiplyQuaternionsBy out[i] = a[i] * c
+//!
+static void multiplyQuaternionsBy(const float* a , const float c[4] , size_t count , float* out)
+{
+    const float bx = c[0] , by = c[1] , bz = c[2] , bw = c[3];
+    for (size_t i = 0; i < count * 4; i += 4)
+    {
+        const float ax = a[i] , ay = a[i + 1] , az = a[i + 2] , aw = a[i + 3];
+        out[i] = aw * bx + ax * bw + ay * bz - az * by;
+        out[i + 1] = aw * by - ax * bz + ay * bw + az * bx;
+        out[i + 2] = aw * bz + ax * by - ay * bx + az * bw;
+        out[i + 3] = aw * bw - ax * bx - ay * by - az * bz;
+    }
+}
+
+//!
+//! \brief conjugateMultiplyQuaternions out[i] = conjugate(a[i]) * b[i] , the rotation b[i] relative to a[i]
+//!
+static void conjugateMultiplyQuaternions(const float* a , const float* b , size_t count , float* out)
+{
+    for (size_t i = 0; i < count * 4; i += 4)
+    {
+        const float ax = -a[i] , ay = -a[i + 1] , az = -a[i + 2] , aw = a[i + 3];
+        const float bx = b[i] , by = b[i + 1] , bz = b[i + 2] , bw = b[i + 3];
+        out[i] = aw * bx + ax * bw + ay * bz - az * by;
+        out[i + 1] = aw * by - ax * bz + ay * bw + az * bx;
+        out[i + 2] = aw * bz + ax * by - ay * bx + az * bw;
+        out[i + 3] = aw * bw - ax * bx - ay * by - az * bz;
+    }
+}
+
+static void fillIdentity(size_t count , float* out)
+{
+    for (size_t i = 0; i < count * 4; i += 4)
+    {
+        out[i] = 0.0f , out[i + 1] = 0.0f , out[i + 2] = 0.0f , out[i + 3] = 1.0f;
+    }
+}
+
+RetargetPlan::RetargetPlan()
+{
+
+}
+
+RetargetPlan::RetargetPlan(const Skeleton &source , const Skeleton &target)
+    : m_source(source)
+    , m_target(target)
+{
+    if (source.isEmpty() || target.isEmpty())
+        return;
+
+    m_sourceJoints.resize(source.jointCount());
+    for (size_t i = 0; i < source.jointCount(); ++i)
+    {
+        SourceJoint& joint = m_sourceJoints[i];
+        joint.parent = source.parent(i);
+        if (source.channelOffset(i) < 0)
+            continue;
+        joint.rotationColumn = source.channelOffset(i) + (source.jointChannelCount(i) == 6 ? 3 : 0);
+        joint.rotationOrder = source.rotationAxisOrder(i);
+    }
+
+    //! The first source joint of every type
+    const SkeletonNaming sourceNaming = detectNaming(source);
+    const SkeletonNaming targetNaming = detectNaming(target);
+    std::vector<int> sourceTypes(source.jointCount());
+    std::vector<int> sourceByType(static_cast<size_t>(JointType_BioVision::Invalid) , -1);
+    for (size_t i = 0; i < source.jointCount(); ++i)
+    {
+        sourceTypes[i] = jointType(source , i , sourceNaming);
+        if (sourceTypes[i] >= 0 && source.channelOffset(i) >= 0 && sourceByType[sourceTypes[i]] < 0)
+            sourceByType[sourceTypes[i]] = static_cast<int>(i);
+    }
+
+    m_joints.resize(target.jointCount());
+    for (size_t i = 0; i < target.jointCount(); ++i)
+    {
+        TargetJoint& joint = m_joints[i];
+        joint.parent = target.parent(i);
+        joint.offset[0] = target.x(i);
+        joint.offset[1] = target.y(i);
+        joint.offset[2] = target.z(i);
+        int column = target.channelOffset(i);
+        if (column < 0)
+            continue;
+        if (target.jointChannelCount(i) == 6)
+        {
+            joint.positionColumn = column;
+            column += 3;
+        }
+        joint.rotationColumn = column;
+        joint.rotationOrder = target.rotationAxisOrder(i);
+
+        //! Match by type , by name only if neither joint has a type
+        const int type = jointType(target , i , targetNaming);
+        int s = type >= 0 ? sourceByType[type] : source.indexOf(target.name(i));
+        if (type < 0 && s >= 0 && sourceTypes[s] >= 0)
+            s = -1;
+        if (s < 0 || source.channelOffset(s) < 0)
+            continue;
+
+        joint.source = s;
+        joint.sourceOffset[0] = source.x(s);
+        joint.sourceOffset[1] = source.y(s);
+        joint.sourceOffset[2] = source.z(s);
+        if (source.jointChannelCount(s) == 6)
+            joint.sourcePositionColumn = source.channelOffset(s);
+    }
+
+    //! Rest pose correction , the bone of a joint points to its first mapped descendant or its End Site
+    const std::vector<float> sourceRest = restPositions(source);
+    const std::vector<float> targetRest = restPositions(target);
+    for (size_t i = 0; i < target.jointCount(); ++i)
+    {
+        TargetJoint& joint = m_joints[i];
+        if (joint.source < 0)
+            continue;
+
+        int targetEnd = -1;
+        int sourceEnd = -1;
+        const size_t end = subtreeEnd(target , i);
+        for (size_t k = i + 1; k < end && targetEnd < 0; ++k)
+        {
+            if (m_joints[k].source >= 0 && isDescendant(source , m_joints[k].source , joint.source))
+            {
+                targetEnd = static_cast<int>(k);
+                sourceEnd = m_joints[k].source;
+            }
+        }
+        if (targetEnd < 0)
+        {
+            targetEnd = firstEndSite(target , i);
+            sourceEnd = firstEndSite(source , joint.source);
+            if (targetEnd < 0 || sourceEnd < 0)
+                continue;
+        }
+
+        float targetBone[3];
+        float sourceBone[3];
+        for (int k = 0; k < 3; ++k)
+        {
+            targetBone[k] = targetRest[targetEnd * 3 + k] - targetRest[i * 3 + k];
+            sourceBone[k] = sourceRest[sourceEnd * 3 + k] - sourceRest[joint.source * 3 + k];
+        }
+        if (!shortestArc(targetBone , sourceBone , joint.correction))
+        {
+            joint.correction[0] = joint.correction[1] = joint.correction[2] = 0.0f;
+            joint.correction[3] = 1.0f;
+        }
+    }
+
+    const float sourceHeight = restHeight(sourceRest);
+    if (sourceHeight > 1e-6f)
+        m_translationScale = restHeight(targetRest) / sourceHeight;
+}
+
+RetargetPlan::RetargetPlan(const BvhDocument &source , const BvhDocument &target)
+    : RetargetPlan(source.isEmpty() ? Skeleton() : *source.skeleton() , target.isEmpty() ? Skeleton() : *target.skeleton())
+{
+
+}
+
+size_t RetargetPlan::mappedJointCount() const
+{
+    size_t count = 0;
+    for (const TargetJoint& joint : m_joints)
+    {
+        if (joint.source >= 0)
+            ++count;
+    }
+    return count;
+}
+
+void RetargetPlan::applyBlock(const float *sourceRows , size_t sourceStride , size_t count ,
+                              float *targetRows , size_t targetStride , float *workspace) const
+{
+    const size_t jointSize = 4 * BlockSize;
+    float* sourceWorld = workspace;
+    float* targetWorld = sourceWorld + m_sourceJoints.size() * jointSize;
+    float* local = targetWorld + m_joints.size() * jointSize;
+
+    //! The parent of a joint with channels always has channels , so its world rotation is ready
+    for (size_t j = 0; j < m_sourceJoints.size(); ++j)
+    {
+        const SourceJoint& joint = m_sourceJoints[j];
+        if (joint.rotationColumn < 0)
+            continue;
+        float* world = sourceWorld + j * jointSize;
+        columnToQuaternions(joint.rotationOrder , sourceRows + joint.rotationColumn , sourceStride , count , world);
+        if (joint.parent >= 0)
+            multiplyQuaternions(sourceWorld + joint.parent * jointSize , world , count , world);
+    }
+
+    for (size_t j = 0; j < m_joints.size(); ++j)
+    {
+        const TargetJoint& joint = m_joints[j];
+        if (joint.rotationColumn < 0)
+            continue;
+        float* world = targetWorld + j * jointSize;
+        const float* parentWorld = joint.parent >= 0 ? targetWorld + joint.parent * jointSize : nullptr;
+        if (joint.source >= 0)
+        {
+            multiplyQuaternionsBy(sourceWorld + joint.source * jointSize , joint.correction , count , world);
+            if (parentWorld)
+                conjugateMultiplyQuaternions(parentWorld , world , count , local);
+            else
+                std::copy(world , world + count * 4 , local);
+        }
+        else
+        {
+            if (parentWorld)
+                std::copy(parentWorld , parentWorld + count * 4 , world);
+            else
+                fillIdentity(count , world);
+            fillIdentity(count , local);
+        }
+        quaternionsToColumn(joint.rotationOrder , local , count , targetRows + joint.rotationColumn , targetStride);
+
+        if (joint.positionColumn < 0)
+            continue;
+        float* row = targetRows + joint.positionColumn;
+        if (joint.sourcePositionColumn < 0)
+        {
+            for (size_t i = 0; i < count; ++i , row += targetStride)
+                row[0] = row[1] = row[2] = 0.0f;
+            continue;
+        }
+        //! The translation offset + position is scaled as a whole , so differing OFFSETs cancel
+        const float* sourceRow = sourceRows + joint.sourcePositionColumn;
+        for (size_t i = 0; i < count; ++i , row += targetStride , sourceRow += sourceStride)
+        {
+            for (int k = 0; k < 3; ++k)
+                row[k] = m_translationScale * (joint.sourceOffset[k] + sourceRow[k]) - joint.offset[k];
+        }
+    }
+}
+
+void RetargetPlan::apply(const float *sourceRows , size_t sourceStride , size_t frameCount ,
+                         float *targetRows , size_t targetStride , std::vector<float> &workspace) const
+{
+    if (workspace.size() < workspaceSize())
+        workspace.resize(workspaceSize());
+
+    for (size_t first = 0; first < frameCount; first += BlockSize)
+    {
+        const size_t count = std::min(BlockFrames , frameCount - first);
+        applyBlock(sourceRows + first * sourceStride , sourceStride , count ,
+                   targetRows + first * targetStride , targetStride , workspace.data());
+    }
+}
+
+BvhDocument RetargetPlan::apply(const BvhDocument &source , unsigned threadCount) const
+{
+    const std::shared_ptr<MotionStore>& motion = source.motion();
+    if (isEmpty() || !motion || motion->channelCount() != m_source.channelCount())
+        return BvhDocument();
+
+    Joint* root = m_target.createJoints();
+    const size_t frameCount = motion->frameCount();
+    std::shared_ptr<MotionStore> frames = MotionStore::create(root->channelJoints() , frameCount);
+
+    ThreadPool& pool = ThreadPool::globalInstance();
+    const unsigned slots = pool.concurrency(threadCount);
+    std::vector<std::vector<float>> workspaces(slots , std::vector<float>(workspaceSize()));
+
+    const float* sourceRows = motion->data();
+    const size_t sourceStride = motion->channelCount();
+    float* targetRows = frames->data();
+    const size_t targetStride = frames->channelCount();
+    pool.parallelForRange(frameCount , BlockSize , [&](size_t first , size_t last , size_t slot) {
+        apply(sourceRows + first * sourceStride , sourceStride , last - first ,
+              targetRows + first * targetStride , targetStride , workspaces[slot]);
+    } , slots);
+
+    //! The joints are bound to the new store , the document adopts it
+    BvhDocument doc;
+    doc.loadRootJoint(root);
+    doc.setFrameInterval(source.frameInterval());
+    return doc;
+}
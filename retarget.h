@@ -0,0 +1,139 @@
+﻿#ifndef RETARGET_H
+#define RETARGET_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "bvh.h"
+#include "skeleton.h"
+
+namespace BVH {
+
+//!
+//! \brief The SkeletonNaming enum The joint names a skeleton follows.
+//!
+enum class SkeletonNaming {
+    Unknown ,
+    MaxBiped ,      //!< The names of JointType_3DMaxBiped
+    BioVision       //!< The names of JointType_BioVision
+};
+
+//!
+//! \brief detectNaming The naming which matches more joint names of \a skeleton.
+//! \return Unknown if no name matches either table
+//!
+SkeletonNaming detectNaming(const Skeleton& skeleton);
+
+//!
+//! \brief bioVisionFrom3DMaxBiped The BioVision joint which corresponds to a 3DMaxBiped joint.
+//! \return JointType_BioVision::Invalid if the joint has no counterpart , e.g. LeftAnkle
+//!
+JointType_BioVision bioVisionFrom3DMaxBiped(JointType_3DMaxBiped type);
+
+//!
+//! \brief The RetargetPlan class Transfers the motion of one skeleton onto another.
+//! \remarks The plan is built once per pair of skeletons and applied to any number of clips.
+//!
+//!          Joints correspond when they have the same JointType_BioVision , 3DMaxBiped names are
+//!          converted with bioVisionFrom3DMaxBiped() , or the same name when neither joint has a type.
+//!          Every mapped target joint takes over the world rotation of its source joint , corrected
+//!          by the rotation which turns the target bone onto the source bone in the rest poses , so
+//!          skeletons with different rest poses (T-pose against A-pose) still line up. Unmapped
+//!          joints keep their rest rotation. The local rotations are written in the channel order
+//!          of the target joints. Position channels are copied from the mapped source joint and
+//!          scaled by translationScale().
+//!
+//!          Frames are processed in blocks of BlockSize frames , every step is a loop over the
+//!          quaternions of a whole block.
+//!
+class RetargetPlan {
+public:
+    static const size_t BlockSize = 64;
+
+    RetargetPlan();
+    RetargetPlan(const Skeleton& source , const Skeleton& target);
+    RetargetPlan(const BvhDocument& source , const BvhDocument& target);
+
+    bool isEmpty() const { return m_joints.empty(); }
+
+    const Skeleton& source() const { return m_source; }
+    const Skeleton& target() const { return m_target; }
+
+    //!
+    //! \brief sourceJointOf The source joint which drives target joint \a targetIndex , -1 if none.
+    //!
+    int sourceJointOf(size_t targetIndex) const { return m_joints[targetIndex].source; }
+
+    //!
+    //! \brief mappedJointCount The number of target joints which have a source joint.
+    //!
+    size_t mappedJointCount() const;
+
+    //!
+    //! \brief translationScale The factor applied to position channels.
+    //! \remarks Defaults to the ratio of the rest pose heights of target and source.
+    //!
+    float translationScale() const { return m_translationScale; }
+    void setTranslationScale(float scale) { m_translationScale = scale; }
+
+    //!
+    //! \brief workspaceSize The number of floats a call of apply() needs as scratch memory.
+    //!
+    size_t workspaceSize() const { return (m_sourceJoints.size() + m_joints.size() + 1) * 4 * BlockSize; }
+
+    //!
+    //! \brief apply Retarget \a frameCount frames.
+    //! \param sourceRows Rows of source().channelCount() values
+    //! \param targetRows Rows of target().channelCount() values , every channel is written
+    //! \param workspace Scratch memory , resized to workspaceSize() when it is smaller
+    //!
+    void apply(const float* sourceRows , size_t sourceStride , size_t frameCount ,
+               float* targetRows , size_t targetStride , std::vector<float>& workspace) const;
+
+    //!
+    //! \brief apply Retarget every frame of \a source , in parallel.
+    //! \param threadCount The number of threads including the caller , 0 uses every hardware thread
+    //! \return A document with the hierarchy of target() , empty if \a source does not have the
+    //!         channels of source()
+    //!
+    BvhDocument apply(const BvhDocument& source , unsigned threadCount = 0) const;
+
+private:
+    //!
+    //! \brief The SourceJoint struct The compiled data of one source joint.
+    //!
+    struct SourceJoint {
+        int32_t parent = -1;
+        int32_t rotationColumn = -1;
+        AxisOrder rotationOrder = AxisOrder::Invalid;
+    };
+
+    //!
+    //! \brief The TargetJoint struct The compiled data of one target joint.
+    //! \remarks End Sites have no columns and are skipped.
+    //!
+    struct TargetJoint {
+        int32_t parent = -1;
+        int32_t source = -1;            //!< The source joint , -1 if unmapped
+        int32_t positionColumn = -1;    //!< The column of the x position , -1 without position channels
+        int32_t rotationColumn = -1;    //!< The column of the x rotation , -1 for End Sites
+        int32_t sourcePositionColumn = -1;
+        AxisOrder rotationOrder = AxisOrder::Invalid;
+        float correction[4] = { 0.0f , 0.0f , 0.0f , 1.0f };   //!< Rest pose correction , x , y , z , w
+        float offset[3] = { 0.0f , 0.0f , 0.0f };
+        float sourceOffset[3] = { 0.0f , 0.0f , 0.0f };
+    };
+
+    void applyBlock(const float* sourceRows , size_t sourceStride , size_t count ,
+                    float* targetRows , size_t targetStride , float* workspace) const;
+
+    Skeleton m_source;
+    Skeleton m_target;
+    std::vector<SourceJoint> m_sourceJoints;
+    std::vector<TargetJoint> m_joints;
+    float m_translationScale = 1.0f;
+};
+
+}
+
+#endif // RETARGET_H
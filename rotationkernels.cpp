@@ -0,0 +1,341 @@
+﻿#include "rotationkernels.h"
+#include "motiondata.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace BVH;
+
+static const float DegreesToRadians = 3.14159265358979323846f / 180.0f;
+static const double RadiansToDegrees = 180.0 / 3.14159265358979323846;
+
+//! The conversions of a column run on blocks of this many frames
+static const size_t BlockSize = 256;
+
+//!
+//! \brief sinCos Branch free sine and cosine of an angle in degrees.
+//! \remarks The angle is reduced by multiples of 90 degrees , which is exact for the usual
+//!          channel values , then both functions are evaluated on [-45 , 45] degrees.
+//!
+static inline void sinCos(float degrees , float& s , float& c)
+{
+    const float quarters = degrees * (1.0f / 90.0f);
+    const int quadrant = static_cast<int>(quarters + (quarters >= 0.0f ? 0.5f : -0.5f));
+    const float r = (degrees - static_cast<float>(quadrant) * 90.0f) * DegreesToRadians;
+    const float r2 = r * r;
+
+    const float sr = r + r * r2 * (-1.0f / 6.0f + r2 * (1.0f / 120.0f + r2 * (-1.0f / 5040.0f + r2 * (1.0f / 362880.0f))));
+    const float cr = 1.0f + r2 * (-0.5f + r2 * (1.0f / 24.0f + r2 * (-1.0f / 720.0f + r2 * (1.0f / 40320.0f + r2 * (-1.0f / 3628800.0f)))));
+
+    //! quadrant 0: (s , c) 1: (c , -s) 2: (-s , -c) 3: (-c , s)
+    const int q = quadrant & 3;
+    const float swappedS = (q & 1) ? cr : sr;
+    const float swappedC = (q & 1) ? sr : cr;
+    s = (q & 2) ? -swappedS : swappedS;
+    c = ((q + 1) & 2) ? -swappedC : swappedC;
+}
+
+void BVH::sinCosDegrees(const float *degrees , size_t count , float *sines , float *cosines)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        sinCos(degrees[i] , sines[i] , cosines[i]);
+    }
+}
+
+//!
+//! \brief applyAxisToMatrix m = m * R(Axis) , only the two columns which are not \a Axis change.
+//!
+template <int Axis>
+static inline void applyAxisToMatrix(float m[9] , float c , float s)
+{
+    const int a = (Axis + 1) % 3;
+    const int b = (Axis + 2) % 3;
+    for (int r = 0; r < 3; ++r)
+    {
+        const float ma = m[r * 3 + a];
+        const float mb = m[r * 3 + b];
+        m[r * 3 + a] = ma * c + mb * s;
+        m[r * 3 + b] = mb * c - ma * s;
+    }
+}
+
+//!
+//! \brief applyAxisToQuaternion q = q * rotation about \a Axis , q is x , y , z , w.
+//!
+template <int Axis>
+static inline void applyAxisToQuaternion(float q[4] , float c , float s)
+{
+    const int a = (Axis + 1) % 3;
+    const int b = (Axis + 2) % 3;
+    const float w = q[3];
+    const float k = q[Axis];
+    const float va = q[a];
+    const float vb = q[b];
+    q[3] = w * c - k * s;
+    q[Axis] = k * c + w * s;
+    q[a] = va * c + vb * s;
+    q[b] = vb * c - va * s;
+}
+
+template <int A0 , int A1 , int A2>
+static void eulerToMatrices(const float* const angles[3] , size_t count , float* out , size_t elementStride)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        float s0 , c0 , s1 , c1 , s2 , c2;
+        sinCos(angles[A0][i] , s0 , c0);
+        sinCos(angles[A1][i] , s1 , c1);
+        sinCos(angles[A2][i] , s2 , c2);
+
+        float m[9] = { 1.0f , 0.0f , 0.0f , 0.0f , 1.0f , 0.0f , 0.0f , 0.0f , 1.0f };
+        const int a = (A0 + 1) % 3;
+        const int b = (A0 + 2) % 3;
+        m[a * 3 + a] = c0;
+        m[a * 3 + b] = -s0;
+        m[b * 3 + a] = s0;
+        m[b * 3 + b] = c0;
+        applyAxisToMatrix<A1>(m , c1 , s1);
+        applyAxisToMatrix<A2>(m , c2 , s2);
+        for (int e = 0; e < 9; ++e)
+            out[e * elementStride + i] = m[e];
+    }
+}
+
+template <int A0 , int A1 , int A2>
+static void eulerToQuaternions(const float* const angles[3] , size_t count , float* out)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        float s0 , c0 , s1 , c1 , s2 , c2;
+        sinCos(angles[A0][i] * 0.5f , s0 , c0);
+        sinCos(angles[A1][i] * 0.5f , s1 , c1);
+        sinCos(angles[A2][i] * 0.5f , s2 , c2);
+
+        float q[4] = { 0.0f , 0.0f , 0.0f , c0 };
+        q[A0] = s0;
+        applyAxisToQuaternion<A1>(q , c1 , s1);
+        applyAxisToQuaternion<A2>(q , c2 , s2);
+        out[i * 4] = q[0];
+        out[i * 4 + 1] = q[1];
+        out[i * 4 + 2] = q[2];
+        out[i * 4 + 3] = q[3];
+    }
+}
+
+//!
+//! \brief quaternionsToEuler Decompose R = R(A0) * R(A1) * R(A2).
+//! \remarks With e = +1 for the cyclic orders XYZ , YZX , ZXY and -1 otherwise row A0 of R is
+//!          (cos b cos c , -e cos b sin c , e sin b) in the axes A0 , A1 , A2 and column A2 is
+//!          (e sin b , -e sin a cos b , cos a cos b). The middle angle takes atan2 of both parts so
+//!          that it stays accurate near +-90 degrees , in gimbal lock the third angle is 0.
+//!          atan2 does not vectorize , so this direction runs in double precision.
+//!
+template <int A0 , int A1 , int A2>
+static void quaternionsToEuler(const float* quaternions , size_t count , float* const angles[3])
+{
+    const double e = (A1 == (A0 + 1) % 3) ? 1.0 : -1.0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const float* q = quaternions + i * 4;
+        const double x = q[0] , y = q[1] , z = q[2] , w = q[3];
+        const double n = x * x + y * y + z * z + w * w;
+        const double s = n > 0.0 ? 2.0 / n : 0.0;
+        const double m[9] = {
+            1.0 - s * (y * y + z * z) , s * (x * y - z * w) , s * (x * z + y * w) ,
+            s * (x * y + z * w) , 1.0 - s * (x * x + z * z) , s * (y * z - x * w) ,
+            s * (x * z - y * w) , s * (y * z + x * w) , 1.0 - s * (x * x + y * y)
+        };
+
+        const double cosMiddle = std::sqrt(m[A0 * 3 + A0] * m[A0 * 3 + A0] + m[A0 * 3 + A1] * m[A0 * 3 + A1]);
+        const double middle = std::atan2(e * m[A0 * 3 + A2] , cosMiddle);
+        double first , last;
+        if (cosMiddle > 1e-9)
+        {
+            first = std::atan2(-e * m[A1 * 3 + A2] , m[A2 * 3 + A2]);
+            last = std::atan2(-e * m[A0 * 3 + A1] , m[A0 * 3 + A0]);
+        }
+        else
+        {
+            first = std::atan2(e * m[A2 * 3 + A1] , m[A1 * 3 + A1]);
+            last = 0.0;
+        }
+        angles[A0][i] = static_cast<float>(first * RadiansToDegrees);
+        angles[A1][i] = static_cast<float>(middle * RadiansToDegrees);
+        angles[A2][i] = static_cast<float>(last * RadiansToDegrees);
+    }
+}
+
+//! Expand call(a0 , a1 , a2) with the axes of \a order
+#define BVH_DISPATCH_ORDER(order , call) \
+    switch (order) \
+    { \
+    case AxisOrder::XZY: call(0 , 2 , 1); break; \
+    case AxisOrder::YXZ: call(1 , 0 , 2); break; \
+    case AxisOrder::YZX: call(1 , 2 , 0); break; \
+    case AxisOrder::ZXY: call(2 , 0 , 1); break; \
+    case AxisOrder::ZYX: call(2 , 1 , 0); break; \
+    default: call(0 , 1 , 2); break; \
+    }
+
+void BVH::eulerToMatrices(AxisOrder order , const float *x , const float *y , const float *z , size_t count ,
+                          float *matrices , size_t elementStride)
+{
+    const float* const angles[3] = { x , y , z };
+#define BVH_CALL(a0 , a1 , a2) ::eulerToMatrices<a0 , a1 , a2>(angles , count , matrices , elementStride)
+    BVH_DISPATCH_ORDER(order , BVH_CALL)
+#undef BVH_CALL
+}
+
+void BVH::eulerToQuaternions(AxisOrder order , const float *x , const float *y , const float *z , size_t count ,
+                             float *quaternions)
+{
+    const float* const angles[3] = { x , y , z };
+#define BVH_CALL(a0 , a1 , a2) ::eulerToQuaternions<a0 , a1 , a2>(angles , count , quaternions)
+    BVH_DISPATCH_ORDER(order , BVH_CALL)
+#undef BVH_CALL
+}
+
+void BVH::quaternionsToEuler(AxisOrder order , const float *quaternions , size_t count , float *x , float *y , float *z)
+{
+    float* const angles[3] = { x , y , z };
+#define BVH_CALL(a0 , a1 , a2) ::quaternionsToEuler<a0 , a1 , a2>(quaternions , count , angles)
+    BVH_DISPATCH_ORDER(order , BVH_CALL)
+#undef BVH_CALL
+}
+
+void BVH::columnToQuaternions(AxisOrder order , const float *rotation , size_t rowStride , size_t frameCount ,
+                              float *quaternions)
+{
+    float angles[3][BlockSize];
+    for (size_t first = 0; first < frameCount; first += BlockSize)
+    {
+        const size_t count = std::min(BlockSize , frameCount - first);
+        const float* row = rotation + first * rowStride;
+        for (size_t i = 0; i < count; ++i , row += rowStride)
+        {
+            angles[0][i] = row[0];
+            angles[1][i] = row[1];
+            angles[2][i] = row[2];
+        }
+        eulerToQuaternions(order , angles[0] , angles[1] , angles[2] , count , quaternions + first * 4);
+    }
+}
+
+void BVH::quaternionsToColumn(AxisOrder order , const float *quaternions , size_t frameCount ,
+                              float *rotation , size_t rowStride)
+{
+    float angles[3][BlockSize];
+    for (size_t first = 0; first < frameCount; first += BlockSize)
+    {
+        const size_t count = std::min(BlockSize , frameCount - first);
+        quaternionsToEuler(order , quaternions + first * 4 , count , angles[0] , angles[1] , angles[2]);
+        float* row = rotation + first * rowStride;
+        for (size_t i = 0; i < count; ++i , row += rowStride)
+        {
+            row[0] = angles[0][i];
+            row[1] = angles[1][i];
+            row[2] = angles[2][i];
+        }
+    }
+}
+
+//!
+//! \brief acosUnit arccos of \a x in [0 , 1] , in degrees.
+//! \remarks Abramowitz and Stegun 4.4.46 , the absolute error is below 2e-8 radians.
+//!
+static inline float acosUnit(float x)
+{
+    const float p = 1.5707963050f + x * (-0.2145988016f + x * (0.0889789874f + x * (-0.0501743046f +
+                    x * (0.0308918810f + x * (-0.0170881256f + x * (0.0066700901f + x * -0.0012624911f))))));
+    return std::sqrt(1.0f - x) * p * static_cast<float>(RadiansToDegrees);
+}
+
+void BVH::slerpQuaternions(const float *from , const float *to , const float *weights , size_t count , float *out)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        const float ax = from[i * 4] , ay = from[i * 4 + 1] , az = from[i * 4 + 2] , aw = from[i * 4 + 3];
+        const float bx = to[i * 4] , by = to[i * 4 + 1] , bz = to[i * 4 + 2] , bw = to[i * 4 + 3];
+        const float t = weights[i];
+
+        const float dot = ax * bx + ay * by + az * bz + aw * bw;
+        const float sign = dot < 0.0f ? -1.0f : 1.0f;
+        const float theta = acosUnit(std::min(dot * sign , 1.0f));
+
+        float sinTheta , cosTheta , sinFrom , cosFrom , sinTo , cosTo;
+        sinCos(theta , sinTheta , cosTheta);
+        sinCos((1.0f - t) * theta , sinFrom , cosFrom);
+        sinCos(t * theta , sinTo , cosTo);
+
+        //! Nearly equal rotations fall back to a linear interpolation , normalized below
+        const bool tiny = sinTheta < 1e-5f;
+        const float w0 = tiny ? 1.0f - t : sinFrom / sinTheta;
+        const float w1 = (tiny ? t : sinTo / sinTheta) * sign;
+
+        const float x = w0 * ax + w1 * bx;
+        const float y = w0 * ay + w1 * by;
+        const float z = w0 * az + w1 * bz;
+        const float w = w0 * aw + w1 * bw;
+        const float scale = 1.0f / std::sqrt(x * x + y * y + z * z + w * w);
+        out[i * 4] = x * scale;
+        out[i * 4 + 1] = y * scale;
+        out[i * 4 + 2] = z * scale;
+        out[i * 4 + 3] = w * scale;
+    }
+}
+
+RotationCache::RotationCache()
+{
+
+}
+
+RotationCache::RotationCache(const std::shared_ptr<MotionStore> &motion , const Joint *root)
+    : m_motion(motion)
+    , m_root(root)
+    , m_revision(root ? root->revision() : 0)
+{
+    if (!root)
+        return;
+
+    const std::vector<Joint*>& joints = root->channelJoints();
+    m_bound = motion && motion->isBoundTo(joints);
+    const std::shared_ptr<MotionStore> source = m_bound ? motion : MotionStore::copyOf(joints);
+    m_frameCount = source->frameCount();
+    m_jointCount = joints.size();
+
+    m_quaternions.resize(m_jointCount * m_frameCount * 4);
+    for (size_t i = 0; i < m_jointCount; ++i)
+    {
+        const Joint* joint = joints[i];
+        const size_t column = source->channelOffset(i) + (joint->channelCount() == 6 ? 3 : 0);
+        columnToQuaternions(joint->rotationAxisOrder() , source->data() + column , source->channelCount() ,
+                            m_frameCount , m_quaternions.data() + i * m_frameCount * 4);
+    }
+}
+
+size_t RotationCache::sourceFrameCount(const MotionStore *motion , const std::vector<Joint *> &joints , bool bound)
+{
+    if (bound)
+        return motion->frameCount();
+
+    //! MotionStore::copyOf() pads the joints to the longest one
+    size_t frameCount = 0;
+    for (const Joint* joint : joints)
+        frameCount = std::max(frameCount , joint->frameCount());
+    return frameCount;
+}
+
+bool RotationCache::isBuiltFrom(const std::shared_ptr<MotionStore> &motion , const Joint *root) const
+{
+    if (root != m_root)
+        return false;
+    if (!root)
+        return true;
+    if (root->revision() != m_revision || m_motion.lock() != motion)
+        return false;
+
+    const MotionStore* store = motion.get();
+    const std::vector<Joint*>& joints = root->channelJoints();
+    const bool bound = store && store->isBoundTo(joints);
+    return bound == m_bound && sourceFrameCount(store , joints , bound) == m_frameCount;
+}
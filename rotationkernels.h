@@ -0,0 +1,118 @@
+﻿#ifndef ROTATIONKERNELS_H
+#define ROTATIONKERNELS_H
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include "bvh.h"
+
+namespace BVH {
+
+//! Batched conversions between the Euler angles of the rotation channels and quaternions or
+//! matrices. Angles are in degrees like in a bvh file , a triple of \a order rotates by
+//! R(first axis) * R(second axis) * R(third axis). Quaternions are stored as x , y , z , w and
+//! matrices row major. Every kernel is specialized per order at compile time and evaluates
+//! sin / cos with a polynomial , so the loops over the values vectorize.
+
+//!
+//! \brief sinCosDegrees The sine and cosine of \a count angles in degrees.
+//! \remarks The absolute error is below 2e-7 for angles up to a few thousand degrees.
+//!
+void sinCosDegrees(const float* degrees , size_t count , float* sines , float* cosines);
+
+//!
+//! \brief eulerToMatrices Convert \a count angle triples into rotation matrices.
+//! \param x , y , z The angles about every axis , \a count values each
+//! \param matrices 9 arrays of \a count values , element e of matrix i is matrices[e * elementStride + i]
+//!
+void eulerToMatrices(AxisOrder order , const float* x , const float* y , const float* z , size_t count ,
+                     float* matrices , size_t elementStride);
+
+//!
+//! \brief eulerToQuaternions Convert \a count angle triples into unit quaternions.
+//! \param quaternions 4 * \a count values
+//!
+void eulerToQuaternions(AxisOrder order , const float* x , const float* y , const float* z , size_t count ,
+                        float* quaternions);
+
+//!
+//! \brief quaternionsToEuler Convert \a count unit quaternions back into angle triples.
+//! \remarks The middle angle is in [-90 , 90] , the other two in (-180 , 180].
+//!
+void quaternionsToEuler(AxisOrder order , const float* quaternions , size_t count , float* x , float* y , float* z);
+
+//!
+//! \brief columnToQuaternions Convert the rotation channels of one joint in \a frameCount rows.
+//! \param rotation The x rotation of the first row , y and z follow it
+//! \param rowStride The distance between two rows , in floats
+//!
+void columnToQuaternions(AxisOrder order , const float* rotation , size_t rowStride , size_t frameCount ,
+                         float* quaternions);
+
+//!
+//! \brief quaternionsToColumn Write \a frameCount quaternions back into the rotation channels of one joint.
+//!
+void quaternionsToColumn(AxisOrder order , const float* quaternions , size_t frameCount ,
+                         float* rotation , size_t rowStride);
+
+//!
+//! \brief slerpQuaternions Spherical linear interpolation of \a count pairs of unit quaternions.
+//! \param weights How far to go from \a from towards \a to , one value in [0 , 1] per pair
+//! \param out 4 * \a count values , may be \a from or \a to
+//! \remarks Takes the shorter arc. The angle comes from a polynomial arccos and the weights from
+//!          the same sin / cos as the other kernels , so the loop vectorizes. The maximum deviation
+//!          from an exact slerp is about 1e-6.
+//!
+void slerpQuaternions(const float* from , const float* to , const float* weights , size_t count , float* out);
+
+//!
+//! \brief The RotationCache class The rotations of every joint of a motion store as quaternions.
+//! \remarks The quaternions of a joint are contiguous , frameCount() * 4 values per joint. The
+//!          joints are in the order of the store. See BvhDocument::rotations().
+//!
+//!          Joints which are not bound to the store any more , because they were edited without
+//!          BvhDocument::packMotion() , are read from a copy of their values. The cache remembers
+//!          the store , the root and its revision it was built for , so it stays current until one
+//!          of them changes instead of being rebuilt on every call.
+//!
+class RotationCache {
+public:
+    RotationCache();
+
+    //!
+    //! \brief RotationCache Convert the rotation channels of the joints below \a root.
+    //! \param motion The store of the document , it is read if the joints are bound to it
+    //!
+    RotationCache(const std::shared_ptr<MotionStore>& motion , const Joint* root);
+
+    size_t frameCount() const { return m_frameCount; }
+    size_t jointCount() const { return m_jointCount; }
+
+    const float* quaternions(size_t jointIndex) const { return m_quaternions.data() + jointIndex * m_frameCount * 4; }
+    const float* quaternion(size_t jointIndex , size_t frame) const { return quaternions(jointIndex) + frame * 4; }
+
+    //!
+    //! \brief isBuiltFrom Whether the cache was built from \a motion and \a root as they are now.
+    //! \remarks Compares the store , the revision of the hierarchy , whether the joints are bound
+    //!          and the frame count. Values edited in place are not noticed.
+    //!
+    bool isBuiltFrom(const std::shared_ptr<MotionStore>& motion , const Joint* root) const;
+
+private:
+    //!
+    //! \brief sourceFrameCount The frames the cache is built from , bound tells whether \a motion is read.
+    //!
+    static size_t sourceFrameCount(const MotionStore* motion , const std::vector<Joint*>& joints , bool bound);
+
+    std::weak_ptr<MotionStore> m_motion;
+    const Joint* m_root = nullptr;
+    uint64_t m_revision = 0;
+    bool m_bound = false;
+    size_t m_frameCount = 0;
+    size_t m_jointCount = 0;
+    std::vector<float> m_quaternions;
+};
+
+}
+
+#endif // ROTATIONKERNELS_H
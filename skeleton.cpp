@@ -0,0 +1,213 @@
+﻿#include "skeleton.h"
+#include "namehash.h"
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+using namespace BVH;
+
+//!
+//! \brief hashBytes 64 bit FNV-1a of \a size bytes , continued from \a hash.
+//!
+static uint64_t hashBytes(const char* data , size_t size , uint64_t hash)
+{
+    for (size_t i = 0; i < size; ++i)
+        hash = (hash ^ static_cast<uint8_t>(data[i])) * 0x100000001B3ULL;
+    return hash;
+}
+
+Skeleton::Skeleton()
+{
+
+}
+
+Skeleton::Skeleton(const Joint *root)
+{
+    if (!root)
+        return;
+
+    //! Pre-order walk with an explicit stack , End Sites and everything below them have no channels
+    struct Entry {
+        const Joint* joint;
+        int32_t parent;
+        int32_t depth;
+        bool hasChannels;
+    };
+    std::vector<Entry> joints;
+    std::vector<Entry> stack;
+    stack.push_back(Entry { root , -1 , 0 , !root->isEndSite() });
+    while (!stack.empty())
+    {
+        Entry entry = stack.back();
+        stack.pop_back();
+        int32_t index = static_cast<int32_t>(joints.size());
+        joints.push_back(entry);
+
+        const std::vector<Joint*>& children = entry.joint->children();
+        for (auto i = children.rbegin(); i != children.rend(); ++i)
+        {
+            stack.push_back(Entry { *i , index , entry.depth + 1 , entry.hasChannels && !(*i)->isEndSite() });
+        }
+    }
+
+    //! Intern the names
+    std::unordered_map<std::string , uint32_t> internedNames;
+    std::vector<uint32_t> nameOffsets(joints.size());
+    std::string names;
+    for (size_t i = 0; i < joints.size(); ++i)
+    {
+        const std::string& name = joints[i].joint->jointName();
+        auto found = internedNames.find(name);
+        if (found == internedNames.end())
+        {
+            found = internedNames.insert(std::make_pair(name , static_cast<uint32_t>(names.size()))).first;
+            names += name;
+        }
+        nameOffsets[i] = found->second;
+    }
+
+    //! Lay out the arena , the 4 byte arrays first so that every array stays aligned
+    const size_t n = joints.size();
+    size_t size = 0;
+    m_parents = size;           size += n * sizeof(int32_t);
+    m_depths = size;            size += n * sizeof(int32_t);
+    m_offsetsX = size;          size += n * sizeof(float);
+    m_offsetsY = size;          size += n * sizeof(float);
+    m_offsetsZ = size;          size += n * sizeof(float);
+    m_channelOffsets = size;    size += n * sizeof(int32_t);
+    m_nameOffsets = size;       size += n * sizeof(uint32_t);
+    m_nameSizes = size;         size += n * sizeof(uint32_t);
+
+    //! The name table has at least twice as many slots as joints , so probe sequences stay short
+    size_t tableSize = 4;
+    while (tableSize < n * 2)
+        tableSize *= 2;
+    m_nameTableMask = tableSize - 1;
+    m_nameTable = size;         size += tableSize * sizeof(int32_t);
+    m_endSites = size;          size += n;
+    m_positionOrders = size;    size += n;
+    m_rotationOrders = size;    size += n;
+    m_names = size;             size += names.size();
+
+    m_arena.assign(size , 0);
+    m_jointCount = n;
+    char* arena = m_arena.data();
+    int32_t* parents = reinterpret_cast<int32_t*>(arena + m_parents);
+    int32_t* depths = reinterpret_cast<int32_t*>(arena + m_depths);
+    float* xs = reinterpret_cast<float*>(arena + m_offsetsX);
+    float* ys = reinterpret_cast<float*>(arena + m_offsetsY);
+    float* zs = reinterpret_cast<float*>(arena + m_offsetsZ);
+    int32_t* channelOffsets = reinterpret_cast<int32_t*>(arena + m_channelOffsets);
+    uint32_t* nameSizes = reinterpret_cast<uint32_t*>(arena + m_nameSizes);
+    uint8_t* endSites = reinterpret_cast<uint8_t*>(arena + m_endSites);
+    uint8_t* positionOrders = reinterpret_cast<uint8_t*>(arena + m_positionOrders);
+    uint8_t* rotationOrders = reinterpret_cast<uint8_t*>(arena + m_rotationOrders);
+
+    std::memcpy(arena + m_nameOffsets , nameOffsets.data() , n * sizeof(uint32_t));
+    std::memcpy(arena + m_names , names.data() , names.size());
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        const Joint* joint = joints[i].joint;
+        parents[i] = joints[i].parent;
+        depths[i] = joints[i].depth;
+        xs[i] = joint->x();
+        ys[i] = joint->y();
+        zs[i] = joint->z();
+        nameSizes[i] = static_cast<uint32_t>(joint->jointName().size());
+        endSites[i] = joint->isEndSite() ? 1 : 0;
+        positionOrders[i] = static_cast<uint8_t>(joint->positionAxisOrder());
+        rotationOrders[i] = static_cast<uint8_t>(joint->rotationAxisOrder());
+        if (joints[i].hasChannels)
+        {
+            channelOffsets[i] = static_cast<int32_t>(m_channelCount);
+            m_channelCount += joint->channelCount();
+        }
+        else
+        {
+            channelOffsets[i] = -1;
+        }
+    }
+
+    //! Only the first joint of every name enters the table
+    int32_t* nameTable = reinterpret_cast<int32_t*>(arena + m_nameTable);
+    std::fill(nameTable , nameTable + tableSize , -1);
+    for (size_t i = 0; i < n; ++i)
+    {
+        size_t slot = nameHash(nameData(i) , nameSize(i)) & m_nameTableMask;
+        while (nameTable[slot] >= 0 && nameOffsets[nameTable[slot]] != nameOffsets[i])
+            slot = (slot + 1) & m_nameTableMask;
+        if (nameTable[slot] < 0)
+            nameTable[slot] = static_cast<int32_t>(i);
+    }
+
+    //! Equal hierarchies build equal arenas , 64 bit FNV-1a over them with -0 offsets hashed as 0
+    const size_t offsetsEnd = m_channelOffsets;
+    m_fingerprint = hashBytes(arena , m_offsetsX , 0xCBF29CE484222325ULL);
+    for (const float* offset = xs; offset != xs + 3 * n; ++offset)
+    {
+        const float value = *offset == 0.0f ? 0.0f : *offset;
+        m_fingerprint = hashBytes(reinterpret_cast<const char*>(&value) , sizeof(value) , m_fingerprint);
+    }
+    m_fingerprint = hashBytes(arena + offsetsEnd , m_arena.size() - offsetsEnd , m_fingerprint);
+}
+
+size_t Skeleton::jointChannelCount(size_t index) const
+{
+    if (channelOffset(index) < 0)
+        return 0;
+    return positionAxisOrder(index) == AxisOrder::Invalid ? 3 : 6;
+}
+
+int Skeleton::indexOf(const std::string &name) const
+{
+    if (m_jointCount == 0)
+        return -1;
+
+    const int32_t* nameTable = array<int32_t>(m_nameTable);
+    for (size_t slot = nameHash(name) & m_nameTableMask; nameTable[slot] >= 0; slot = (slot + 1) & m_nameTableMask)
+    {
+        const size_t i = static_cast<size_t>(nameTable[slot]);
+        if (nameSize(i) == name.size() && std::memcmp(nameData(i) , name.data() , name.size()) == 0)
+            return static_cast<int>(i);
+    }
+    return -1;
+}
+
+bool Skeleton::isIdenticalTo(const Skeleton &other) const
+{
+    if (m_fingerprint != other.m_fingerprint || m_jointCount != other.m_jointCount ||
+        m_arena.size() != other.m_arena.size())
+        return false;
+
+    //! Equal joint counts give equal layouts , the offsets are compared by value so that -0 equals 0
+    const char* a = m_arena.data();
+    const char* b = other.m_arena.data();
+    const size_t offsetsEnd = m_channelOffsets;
+    if (std::memcmp(a , b , m_offsetsX) != 0 ||
+        std::memcmp(a + offsetsEnd , b + offsetsEnd , m_arena.size() - offsetsEnd) != 0)
+        return false;
+
+    const float* offsets = array<float>(m_offsetsX);
+    const float* otherOffsets = other.array<float>(m_offsetsX);
+    return std::equal(offsets , offsets + 3 * m_jointCount , otherOffsets);
+}
+
+Joint *Skeleton::createJoints() const
+{
+    if (m_jointCount == 0)
+        return nullptr;
+
+    std::vector<Joint*> joints(m_jointCount , nullptr);
+    for (size_t i = 0; i < m_jointCount; ++i)
+    {
+        Joint* joint = new Joint(parent(i) < 0 ? nullptr : joints[parent(i)]);
+        joint->setJointName(name(i));
+        joint->setAsEndSite(isEndSite(i));
+        joint->setPositionAxisOrder(positionAxisOrder(i));
+        joint->setRotationAxisOrder(rotationAxisOrder(i));
+        joint->setOffset(x(i) , y(i) , z(i));
+        joints[i] = joint;
+    }
+    return joints[0];
+}
@@ -0,0 +1,129 @@
+﻿#ifndef SKELETON_H
+#define SKELETON_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "bvh.h"
+
+namespace BVH {
+
+//!
+//! \brief The Skeleton class A flat , index based copy of a joint hierarchy.
+//! \remarks The joints are stored in pre-order , so the parent of joint i always has a smaller
+//!          index and a loop over 0 ... jointCount() - 1 visits parents before their children.
+//!          Every per joint property is an array of its own (offsets as separate x , y and z
+//!          arrays) and all arrays together with the names live in one allocation. Equal names
+//!          are stored once.
+//!
+class Skeleton {
+public:
+    Skeleton();
+
+    //!
+    //! \brief Skeleton Flatten the hierarchy below \a root , End Sites included.
+    //!
+    explicit Skeleton(const Joint* root);
+
+    bool isEmpty() const { return m_jointCount == 0; }
+    size_t jointCount() const { return m_jointCount; }
+
+    //!
+    //! \brief channelCount The number of values in one frame of the skeleton.
+    //!
+    size_t channelCount() const { return m_channelCount; }
+
+    //!
+    //! \brief parent The index of the parent joint , -1 for the root.
+    //!
+    int parent(size_t index) const { return parents()[index]; }
+    const int32_t* parents() const { return array<int32_t>(m_parents); }
+
+    int depth(size_t index) const { return array<int32_t>(m_depths)[index]; }
+
+    float x(size_t index) const { return offsetsX()[index]; }
+    float y(size_t index) const { return offsetsY()[index]; }
+    float z(size_t index) const { return offsetsZ()[index]; }
+    const float* offsetsX() const { return array<float>(m_offsetsX); }
+    const float* offsetsY() const { return array<float>(m_offsetsY); }
+    const float* offsetsZ() const { return array<float>(m_offsetsZ); }
+
+    bool isEndSite(size_t index) const { return array<uint8_t>(m_endSites)[index] != 0; }
+    AxisOrder positionAxisOrder(size_t index) const { return static_cast<AxisOrder>(array<uint8_t>(m_positionOrders)[index]); }
+    AxisOrder rotationAxisOrder(size_t index) const { return static_cast<AxisOrder>(array<uint8_t>(m_rotationOrders)[index]); }
+
+    //!
+    //! \brief channelOffset The first column of the joint in a MotionStore row , -1 without channels.
+    //!
+    int channelOffset(size_t index) const { return array<int32_t>(m_channelOffsets)[index]; }
+    const int32_t* channelOffsets() const { return array<int32_t>(m_channelOffsets); }
+
+    //!
+    //! \brief jointChannelCount 6 with position channels , 3 with rotation channels only , 0 for End Sites.
+    //!
+    size_t jointChannelCount(size_t index) const;
+
+    //!
+    //! \brief nameData The characters of the name , the text is not null terminated.
+    //!
+    const char* nameData(size_t index) const { return m_arena.data() + m_names + array<uint32_t>(m_nameOffsets)[index]; }
+    size_t nameSize(size_t index) const { return array<uint32_t>(m_nameSizes)[index]; }
+    std::string name(size_t index) const { return std::string(nameData(index) , nameSize(index)); }
+
+    //!
+    //! \brief indexOf The index of the first joint named \a name , -1 if there is none.
+    //! \remarks An open addressing hash table in the arena makes this O(1).
+    //!
+    int indexOf(const std::string& name) const;
+
+    //!
+    //! \brief createJoints Build a Joint tree with the same hierarchy.
+    //! \return The root joint , owned by the caller , or nullptr for an empty skeleton
+    //! \remarks The joints hold no motion values.
+    //!
+    Joint* createJoints() const;
+
+    //!
+    //! \brief fingerprint A hash of the names , the hierarchy , the offsets and the channel orders.
+    //! \remarks Offsets of -0 hash like 0.
+    //!
+    uint64_t fingerprint() const { return m_fingerprint; }
+
+    //!
+    //! \brief isIdenticalTo Whether \a other has the same joints , the offsets compared by value.
+    //!
+    bool isIdenticalTo(const Skeleton& other) const;
+
+private:
+    template <typename T>
+    const T* array(size_t offset) const { return reinterpret_cast<const T*>(m_arena.data() + offset); }
+
+    size_t m_jointCount = 0;
+    size_t m_channelCount = 0;
+    uint64_t m_fingerprint = 0;
+
+    //!
+    //! \brief m_arena All arrays and the names , the members below are byte offsets into it
+    //!
+    std::vector<char> m_arena;
+
+    size_t m_parents = 0;
+    size_t m_depths = 0;
+    size_t m_offsetsX = 0;
+    size_t m_offsetsY = 0;
+    size_t m_offsetsZ = 0;
+    size_t m_channelOffsets = 0;
+    size_t m_nameOffsets = 0;
+    size_t m_nameSizes = 0;
+    size_t m_nameTable = 0;
+    size_t m_nameTableMask = 0;
+    size_t m_endSites = 0;
+    size_t m_positionOrders = 0;
+    size_t m_rotationOrders = 0;
+    size_t m_names = 0;
+};
+
+}
+
+#endif // SKELETON_H
@@ -0,0 +1,71 @@
+﻿#include "skeletonregistry.h"
+#include <algorithm>
+#include <utility>
+
+using namespace BVH;
+
+SkeletonRegistry::SkeletonRegistry()
+{
+
+}
+
+std::shared_ptr<const Skeleton> SkeletonRegistry::intern(const Joint *root)
+{
+    if (!root)
+        return nullptr;
+    return intern(Skeleton(root));
+}
+
+std::shared_ptr<const Skeleton> SkeletonRegistry::intern(Skeleton skeleton)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const uint64_t fingerprint = skeleton.fingerprint();
+    auto range = m_skeletons.equal_range(fingerprint);
+    for (auto i = range.first; i != range.second; ++i)
+    {
+        std::shared_ptr<const Skeleton> candidate = i->second.lock();
+        if (candidate && candidate->isIdenticalTo(skeleton))
+            return candidate;
+    }
+
+    std::shared_ptr<const Skeleton> shared = std::make_shared<const Skeleton>(std::move(skeleton));
+    m_skeletons.emplace(fingerprint , shared);
+
+    //! Sweeping at doubling sizes keeps the cost per call constant
+    if (m_skeletons.size() >= m_sweepAt)
+    {
+        removeExpired();
+        m_sweepAt = std::max<size_t>(64 , m_skeletons.size() * 2);
+    }
+    return shared;
+}
+
+size_t SkeletonRegistry::size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t count = 0;
+    for (const auto& entry : m_skeletons)
+    {
+        if (!entry.second.expired())
+            ++count;
+    }
+    return count;
+}
+
+void SkeletonRegistry::removeExpired()
+{
+    for (auto i = m_skeletons.begin(); i != m_skeletons.end();)
+    {
+        if (i->second.expired())
+            i = m_skeletons.erase(i);
+        else
+            ++i;
+    }
+}
+
+SkeletonRegistry &SkeletonRegistry::globalInstance()
+{
+    static SkeletonRegistry registry;
+    return registry;
+}
@@ -0,0 +1,61 @@
+﻿#ifndef SKELETONREGISTRY_H
+#define SKELETONREGISTRY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "bvh.h"
+#include "skeleton.h"
+
+namespace BVH {
+
+//!
+//! \brief The SkeletonRegistry class Shares one immutable Skeleton between identical hierarchies.
+//! \remarks intern() looks a skeleton up by Skeleton::fingerprint() and compares the candidates
+//!          with Skeleton::isIdenticalTo() , so two hierarchies get the same object exactly when
+//!          their names , parents , offsets and channel orders are equal. Whether two clips are
+//!          compatible is then a pointer compare.
+//!
+//!          The registry holds weak references , a skeleton is freed when the last document which
+//!          uses it is gone. All functions may be called from several threads.
+//!
+class SkeletonRegistry {
+public:
+    SkeletonRegistry();
+
+    //!
+    //! \brief intern The shared skeleton of the hierarchy below \a root , nullptr for nullptr.
+    //!
+    std::shared_ptr<const Skeleton> intern(const Joint* root);
+    std::shared_ptr<const Skeleton> intern(Skeleton skeleton);
+
+    //!
+    //! \brief size The number of distinct skeletons which are still in use.
+    //!
+    size_t size() const;
+
+    //!
+    //! \brief globalInstance The registry BvhDocument::skeleton() uses.
+    //!
+    static SkeletonRegistry& globalInstance();
+
+private:
+    SkeletonRegistry(const SkeletonRegistry& other) = delete;
+    SkeletonRegistry& operator = (const SkeletonRegistry& other) = delete;
+
+    void removeExpired();
+
+    mutable std::mutex m_mutex;
+    std::unordered_multimap<uint64_t , std::weak_ptr<const Skeleton>> m_skeletons;
+
+    //!
+    //! \brief m_sweepAt Expired entries are removed when the map grows to this size
+    //!
+    size_t m_sweepAt = 64;
+};
+
+}
+
+#endif // SKELETONREGISTRY_H
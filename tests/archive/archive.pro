@@ -0,0 +1,10 @@
+include(../tests.pri)
+
+CONFIG += testcase
+TARGET = archive
+
+HEADERS += \
+    ../sampledocument.h
+
+SOURCES += \
+    tst_archive.cpp
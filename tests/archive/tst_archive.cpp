@@ -0,0 +1,203 @@
+﻿#include "archive.h"
+#include "bvh.h"
+#include "motiondata.h"
+#include "sampledocument.h"
+#include "testing.h"
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+using namespace BVH;
+
+//! Field offsets of ArchiveHeader in archive.cpp
+static const size_t MagicField = 0;
+static const size_t VersionField = 4;
+static const size_t ByteOrderField = 8;
+static const size_t JointCountField = 12;
+static const size_t ChannelCountField = 16;
+static const size_t FrameCountField = 24;
+static const size_t BlockFramesField = 32;
+static const size_t NamesOffsetField = 48;
+static const size_t NamesSizeField = 56;
+static const size_t IndexOffsetField = 64;
+static const size_t HeaderSize = 72;
+
+static std::string readBytes(const std::string& path)
+{
+    std::ifstream in(path , std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in) , std::istreambuf_iterator<char>());
+}
+
+template <typename T>
+static void setField(std::string& bytes , size_t offset , T value)
+{
+    std::memcpy(&bytes[offset] , &value , sizeof(T));
+}
+
+template <typename T>
+static T field(const std::string& bytes , size_t offset)
+{
+    T value;
+    std::memcpy(&value , &bytes[offset] , sizeof(T));
+    return value;
+}
+
+//!
+//! \brief opensAsEmpty Whether MotionArchive::open() rejects a file holding \a bytes.
+//!
+static bool opensAsEmpty(const std::string& bytes)
+{
+    const std::string path = Testing::temporaryPath("damaged.bvha");
+    Testing::writeText(path , bytes);
+    MotionArchive archive;
+    const bool rejected = !archive.open(path) && !archive.isOpen();
+    std::remove(path.c_str());
+    return rejected;
+}
+
+//!
+//! \brief maxError The largest difference between the frames of \a a and the frames [first , ...) of \a b.
+//!
+static double maxError(const BvhDocument& a , const BvhDocument& b , size_t first = 0)
+{
+    if (a.channelCount() != b.channelCount() || first + a.frameCount() > b.frameCount())
+        return INFINITY;
+    double error = 0.0;
+    for (size_t frame = 0; frame < a.frameCount(); ++frame)
+    {
+        for (size_t c = 0; c < a.channelCount(); ++c)
+            error = std::fmax(error , std::fabs(double(a.pose(frame)[c]) - b.pose(first + frame)[c]));
+    }
+    return error;
+}
+
+static void testRoundTrip()
+{
+    const std::string textPath = Testing::temporaryPath("archive.bvh");
+    const std::string archivePath = Testing::temporaryPath("archive.bvha");
+    CHECK(Testing::writeText(textPath , Testing::sampleBvhText(1000)));
+    const BvhDocument doc = BvhDocument::fromFile(textPath);
+
+    ArchiveOptions options;
+    options.blockFrames = 64;
+    CHECK(MotionArchive::write(doc , archivePath , options));
+    MotionArchive archive;
+    CHECK(archive.open(archivePath));
+    CHECK(archive.frameCount() == 1000 && archive.blockCount() == 16 && archive.channelCount() == doc.channelCount());
+    CHECK(maxError(archive.toDocument() , doc) == 0.0);
+    CHECK(maxError(archive.toDocument(100 , 300) , doc , 100) == 0.0);
+    CHECK(archive.toDocument(900 , 1001).isEmpty());
+
+    //! A document without joints writes the same archive and does not build them
+    const std::string sharedPath = Testing::temporaryPath("shared.bvha");
+    ParseOptions shared;
+    shared.sharedSkeleton = true;
+    const BvhDocument sharedDoc = BvhDocument::fromFile(textPath , shared);
+    CHECK(MotionArchive::write(sharedDoc , sharedPath , options) && !sharedDoc.hasJoints());
+    CHECK(readBytes(sharedPath) == readBytes(archivePath));
+    std::remove(sharedPath.c_str());
+
+    //! Lossy archives round to a multiple of the precision
+    options.precision = 0.001f;
+    CHECK(MotionArchive::write(doc , archivePath , options));
+    CHECK(archive.open(archivePath));
+    CHECK(maxError(archive.toDocument(1 , 999) , doc , 1) <= 0.0005 + 1e-4);
+
+    std::remove(textPath.c_str());
+    std::remove(archivePath.c_str());
+}
+
+static void testDamagedFiles()
+{
+    const std::string textPath = Testing::temporaryPath("good.bvh");
+    const std::string archivePath = Testing::temporaryPath("good.bvha");
+    CHECK(Testing::writeText(textPath , Testing::sampleBvhText(100)));
+    ArchiveOptions options;
+    options.blockFrames = 16;
+    CHECK(MotionArchive::write(BvhDocument::fromFile(textPath) , archivePath , options));
+    const std::string good = readBytes(archivePath);
+    CHECK(good.size() > HeaderSize && !opensAsEmpty(good));
+
+    const uint64_t namesOffset = field<uint64_t>(good , NamesOffsetField);
+    const uint64_t indexOffset = field<uint64_t>(good , IndexOffsetField);
+
+    //! Truncated files
+    for (uint64_t size : { uint64_t(0) , uint64_t(3) , uint64_t(HeaderSize - 1) , uint64_t(HeaderSize) ,
+                           namesOffset - 1 , namesOffset + 2 , indexOffset , uint64_t(good.size() - 1) })
+    {
+        CHECK(opensAsEmpty(good.substr(0 , size)));
+    }
+
+    //! Foreign or forged headers
+    std::string bytes = good;
+    bytes[MagicField + 3] = 'X';
+    CHECK(opensAsEmpty(bytes));
+
+    bytes = good;
+    setField<uint32_t>(bytes , VersionField , field<uint32_t>(good , VersionField) + 1);
+    CHECK(opensAsEmpty(bytes));
+
+    bytes = good;
+    setField<uint32_t>(bytes , ByteOrderField , 0x04030201);
+    CHECK(opensAsEmpty(bytes));
+
+    bytes = good;
+    setField<uint32_t>(bytes , JointCountField , 0);
+    CHECK(opensAsEmpty(bytes));
+
+    bytes = good;
+    setField<uint32_t>(bytes , JointCountField , field<uint32_t>(good , JointCountField) + 1);
+    CHECK(opensAsEmpty(bytes));
+
+    bytes = good;
+    setField<uint32_t>(bytes , ChannelCountField , field<uint32_t>(good , ChannelCountField) + 1);
+    CHECK(opensAsEmpty(bytes));
+
+    bytes = good;
+    setField<uint32_t>(bytes , BlockFramesField , 0);
+    CHECK(opensAsEmpty(bytes));
+
+    for (uint64_t frameCount : { uint64_t(1) << 60 , ~uint64_t(0) })
+    {
+        bytes = good;
+        setField<uint64_t>(bytes , FrameCountField , frameCount);
+        setField<uint32_t>(bytes , BlockFramesField , 1);
+        CHECK(opensAsEmpty(bytes));
+    }
+
+    //! A names size which wraps the end of the names around
+    bytes = good;
+    setField<uint64_t>(bytes , NamesSizeField , ~uint64_t(0) - 100);
+    CHECK(opensAsEmpty(bytes));
+
+    bytes = good;
+    setField<uint64_t>(bytes , IndexOffsetField , namesOffset - 1);
+    CHECK(opensAsEmpty(bytes));
+
+    bytes = good;
+    setField<uint64_t>(bytes , IndexOffsetField , good.size() + 8);
+    CHECK(opensAsEmpty(bytes));
+
+    //! A block offset before the one of the block in front of it
+    bytes = good;
+    setField<uint64_t>(bytes , indexOffset + sizeof(uint64_t) , field<uint64_t>(good , indexOffset) - 1);
+    CHECK(opensAsEmpty(bytes));
+
+    //! A text file is not an archive
+    CHECK(opensAsEmpty(Testing::sampleBvhText(3)));
+
+    std::remove(textPath.c_str());
+    std::remove(archivePath.c_str());
+}
+
+int main()
+{
+    testRoundTrip();
+    testDamagedFiles();
+    return Testing::result("archive");
+}
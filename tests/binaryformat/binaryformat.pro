@@ -0,0 +1,10 @@
+include(../tests.pri)
+
+CONFIG += testcase
+TARGET = binaryformat
+
+HEADERS += \
+    ../sampledocument.h
+
+SOURCES += \
+    tst_binaryformat.cpp
@@ -0,0 +1,309 @@
+﻿#include "bvh.h"
+#include "motiondata.h"
+#include "sampledocument.h"
+#include "testing.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace BVH;
+
+//! Field offsets of BinaryHeader in bvhbinary.cpp
+static const size_t MagicField = 0;
+static const size_t VersionField = 4;
+static const size_t ByteOrderField = 8;
+static const size_t JointCountField = 12;
+static const size_t ChannelCountField = 16;
+static const size_t FrameCountField = 24;
+static const size_t NamesOffsetField = 32;
+static const size_t NamesSizeField = 40;
+static const size_t MotionOffsetField = 48;
+static const size_t HeaderSize = 56;
+
+static bool sameBits(float a , float b)
+{
+    return std::memcmp(&a , &b , sizeof(float)) == 0;
+}
+
+//!
+//! \brief sameHierarchy Names , offsets (bit for bit) , channels and the tree shape of two hierarchies.
+//!
+static bool sameHierarchy(const Joint* a , const Joint* b)
+{
+    const Joint* rootA = a;
+    const Joint* rootB = b;
+    while (a && b)
+    {
+        if (a->jointName() != b->jointName() || a->isEndSite() != b->isEndSite() ||
+            !sameBits(a->x() , b->x()) || !sameBits(a->y() , b->y()) || !sameBits(a->z() , b->z()) ||
+            a->positionAxisOrder() != b->positionAxisOrder() || a->rotationAxisOrder() != b->rotationAxisOrder() ||
+            a->childrenCount() != b->childrenCount() || a->depth() != b->depth())
+            return false;
+        a = Joint::nextPreOrder(a , rootA);
+        b = Joint::nextPreOrder(b , rootB);
+    }
+    return !a && !b;
+}
+
+//!
+//! \brief sameMotion The frame interval and every value , bit for bit.
+//!
+static bool sameMotion(const BvhDocument& a , const BvhDocument& b)
+{
+    if (!sameBits(a.frameInterval() , b.frameInterval()) || a.frameCount() != b.frameCount())
+        return false;
+    if (a.frameCount() == 0)
+        return true;
+    const MotionStore& motionA = *a.motion();
+    const MotionStore& motionB = *b.motion();
+    if (motionA.channelCount() != motionB.channelCount())
+        return false;
+    for (size_t frame = 0; frame < a.frameCount(); ++frame)
+    {
+        if (std::memcmp(motionA.row(frame) , motionB.row(frame) , motionA.channelCount() * sizeof(float)) != 0)
+            return false;
+    }
+    return true;
+}
+
+static std::string readBytes(const std::string& path)
+{
+    std::ifstream in(path , std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in) , std::istreambuf_iterator<char>());
+}
+
+template <typename T>
+static void setField(std::string& bytes , size_t offset , T value)
+{
+    std::memcpy(&bytes[offset] , &value , sizeof(T));
+}
+
+template <typename T>
+static T field(const std::string& bytes , size_t offset)
+{
+    T value;
+    std::memcpy(&value , &bytes[offset] , sizeof(T));
+    return value;
+}
+
+//!
+//! \brief opensAsEmpty Whether fromBinaryFile() rejects a file holding \a bytes.
+//!
+static bool opensAsEmpty(const std::string& bytes)
+{
+    const std::string path = Testing::temporaryPath("damaged.bvhb");
+    Testing::writeText(path , bytes);
+    const bool empty = BvhDocument::fromBinaryFile(path).isEmpty();
+    std::remove(path.c_str());
+    return empty;
+}
+
+static void testTextBinaryText()
+{
+    const std::string textPath = Testing::temporaryPath("sample.bvh");
+    const std::string binaryPath = Testing::temporaryPath("sample.bvhb");
+    const std::string writtenPath = Testing::temporaryPath("written.bvh");
+    const std::string rewrittenPath = Testing::temporaryPath("rewritten.bvh");
+    CHECK(Testing::writeText(textPath , Testing::sampleBvhText(257)));
+
+    ParseOptions exact;
+    exact.exactFloats = true;
+    BvhDocument text = BvhDocument::fromFile(textPath , exact);
+    CHECK(!text.isEmpty() && text.frameCount() == 257);
+
+    CHECK(text.toBinaryFile(binaryPath));
+    BvhDocument binary = BvhDocument::fromBinaryFile(binaryPath);
+    CHECK(!binary.isEmpty());
+    CHECK(sameHierarchy(text.rootJoint() , binary.rootJoint()));
+    CHECK(sameMotion(text , binary));
+
+    //! The values have six decimals , so text written with six decimals reads back to the same floats
+    WriteOptions sixDecimals;
+    sixDecimals.precision = 6;
+    CHECK(text.toFile(writtenPath , sixDecimals));
+    CHECK(binary.toFile(rewrittenPath , sixDecimals));
+    CHECK(readBytes(writtenPath) == readBytes(rewrittenPath));
+
+    BvhDocument reread = BvhDocument::fromFile(rewrittenPath , exact);
+    CHECK(sameHierarchy(text.rootJoint() , reread.rootJoint()));
+    CHECK(sameMotion(text , reread));
+
+    //! A second binary round trip gives the same bytes
+    const std::string secondPath = Testing::temporaryPath("second.bvhb");
+    CHECK(binary.toBinaryFile(secondPath));
+    CHECK(readBytes(binaryPath) == readBytes(secondPath));
+
+    for (const std::string& path : { textPath , binaryPath , writtenPath , rewrittenPath , secondPath })
+        std::remove(path.c_str());
+}
+
+//!
+//! \brief testEditedDocument Values the text format can not hold , in a document whose joints were edited.
+//!
+static void testEditedDocument()
+{
+    const std::string textPath = Testing::temporaryPath("edited.bvh");
+    const std::string binaryPath = Testing::temporaryPath("edited.bvhb");
+    CHECK(Testing::writeText(textPath , Testing::sampleBvhText(3)));
+    BvhDocument doc = BvhDocument::fromFile(textPath);
+
+    Joint* spine = doc.rootJoint()->childAt(0);
+    spine->setOffset(-0.0f , 1.0e-40f , 3.4028235e38f);
+    std::vector<float> values = spine->frameData().toVector();
+    values[0] = -0.0f;
+    values[1] = 1.17549435e-38f;
+    values[2] = 0.1f;
+    spine->setFrameData(values);
+
+    CHECK(doc.toBinaryFile(binaryPath));
+    BvhDocument binary = BvhDocument::fromBinaryFile(binaryPath);
+    CHECK(sameHierarchy(doc.rootJoint() , binary.rootJoint()));
+    const Joint* binarySpine = binary.rootJoint()->childAt(0);
+    CHECK(sameBits(binarySpine->x() , -0.0f) && sameBits(binarySpine->y() , 1.0e-40f));
+    const std::vector<float> binaryValues = binarySpine->frameData().toVector();
+    CHECK(binaryValues.size() == values.size());
+    CHECK(binaryValues.size() == values.size() && std::memcmp(binaryValues.data() , values.data() , values.size() * sizeof(float)) == 0);
+
+    std::remove(textPath.c_str());
+    std::remove(binaryPath.c_str());
+}
+
+//!
+//! \brief testSharedSkeleton Documents opened with ParseOptions::sharedSkeleton read and write like
+//!        documents with joints and share one skeleton with them , -0 offsets included.
+//!
+static void testSharedSkeleton()
+{
+    const std::string textPath = Testing::temporaryPath("shared.bvh");
+    const std::string binaryPath = Testing::temporaryPath("shared.bvhb");
+    const std::string jointsBinaryPath = Testing::temporaryPath("joints.bvhb");
+    const std::string writtenPath = Testing::temporaryPath("shared_written.bvh");
+    const std::string jointsWrittenPath = Testing::temporaryPath("joints_written.bvh");
+    CHECK(Testing::writeText(textPath , Testing::sampleBvhText(40)));
+
+    ParseOptions shared;
+    shared.sharedSkeleton = true;
+    BvhDocument withJoints = BvhDocument::fromFile(textPath);
+    BvhDocument doc = BvhDocument::fromFile(textPath , shared);
+    CHECK(!doc.isEmpty() && !doc.hasJoints());
+    CHECK(doc.skeleton() && doc.skeleton() == withJoints.skeleton());
+    CHECK(doc.frameCount() == 40 && sameMotion(doc , withJoints));
+
+    CHECK(doc.toFile(writtenPath) && withJoints.toFile(jointsWrittenPath));
+    CHECK(readBytes(writtenPath) == readBytes(jointsWrittenPath));
+    CHECK(doc.toBinaryFile(binaryPath) && withJoints.toBinaryFile(jointsBinaryPath));
+    CHECK(readBytes(binaryPath) == readBytes(jointsBinaryPath));
+    CHECK(!doc.hasJoints());
+
+    BvhDocument binary = BvhDocument::fromBinaryFile(binaryPath , shared);
+    CHECK(!binary.isEmpty() && !binary.hasJoints());
+    CHECK(binary.skeleton() == withJoints.skeleton() && sameMotion(binary , withJoints));
+
+    //! The tree is built on demand and bound to the motion
+    CHECK(doc.findJoint("LeftArm") != nullptr && doc.hasJoints());
+    CHECK(sameHierarchy(doc.rootJoint() , withJoints.rootJoint()));
+    CHECK(doc.rootJoint()->childAt(0)->frameData().toVector() == withJoints.rootJoint()->childAt(0)->frameData().toVector());
+    CHECK(doc.motion()->isBoundTo(doc.rootJoint()->channelJoints()));
+
+    //! Moving does not build the tree
+    BvhDocument moved(std::move(binary));
+    CHECK(binary.isEmpty() && !moved.hasJoints() && moved.skeleton() == withJoints.skeleton());
+
+    //! Offsets are compared by value
+    BvhDocument positiveZero = BvhDocument::fromFile(textPath);
+    BvhDocument negativeZero = BvhDocument::fromFile(textPath);
+    positiveZero.rootJoint()->childAt(0)->setOffset(0.0f , 1.0f , 0.0f);
+    negativeZero.rootJoint()->childAt(0)->setOffset(-0.0f , 1.0f , -0.0f);
+    CHECK(positiveZero.skeleton() == negativeZero.skeleton());
+    CHECK(positiveZero.skeleton() != withJoints.skeleton());
+
+    for (const std::string& path : { textPath , binaryPath , jointsBinaryPath , writtenPath , jointsWrittenPath })
+        std::remove(path.c_str());
+}
+
+static void testDamagedFiles()
+{
+    const std::string textPath = Testing::temporaryPath("good.bvh");
+    const std::string binaryPath = Testing::temporaryPath("good.bvhb");
+    const std::string text = Testing::sampleBvhText(10);
+    CHECK(Testing::writeText(textPath , text));
+    CHECK(BvhDocument::fromFile(textPath).toBinaryFile(binaryPath));
+    const std::string good = readBytes(binaryPath);
+    CHECK(good.size() > HeaderSize && !opensAsEmpty(good));
+
+    const uint64_t namesOffset = field<uint64_t>(good , NamesOffsetField);
+    const uint64_t motionOffset = field<uint64_t>(good , MotionOffsetField);
+
+    //! Truncated files
+    for (uint64_t size : { uint64_t(0) , uint64_t(3) , uint64_t(HeaderSize - 1) , uint64_t(HeaderSize) ,
+                           namesOffset - 1 , namesOffset + 2 , motionOffset , uint64_t(good.size() - 1) })
+    {
+        CHECK(opensAsEmpty(good.substr(0 , size)));
+    }
+
+    //! Foreign or damaged headers
+    std::string bytes = good;
+    bytes[MagicField + 3] = 'X';
+    CHECK(opensAsEmpty(bytes));
+
+    bytes = good;
+    setField<uint32_t>(bytes , VersionField , field<uint32_t>(good , VersionField) + 1);
+    CHECK(opensAsEmpty(bytes));
+
+    bytes = good;
+    setField<uint32_t>(bytes , ByteOrderField , 0x04030201);
+    CHECK(opensAsEmpty(bytes));
+
+    bytes = good;
+    setField<uint32_t>(bytes , JointCountField , 0);
+    CHECK(opensAsEmpty(bytes));
+
+    bytes = good;
+    setField<uint32_t>(bytes , JointCountField , field<uint32_t>(good , JointCountField) + 1);
+    CHECK(opensAsEmpty(bytes));
+
+    bytes = good;
+    setField<uint32_t>(bytes , ChannelCountField , field<uint32_t>(good , ChannelCountField) + 1);
+    CHECK(opensAsEmpty(bytes));
+
+    bytes = good;
+    setField<uint32_t>(bytes , ChannelCountField , 0);
+    CHECK(opensAsEmpty(bytes));
+
+    bytes = good;
+    setField<uint64_t>(bytes , FrameCountField , uint64_t(1) << 60);
+    CHECK(opensAsEmpty(bytes));
+
+    bytes = good;
+    setField<uint64_t>(bytes , NamesSizeField , ~uint64_t(0) - 8);
+    CHECK(opensAsEmpty(bytes));
+
+    bytes = good;
+    setField<uint64_t>(bytes , MotionOffsetField , motionOffset + 1);
+    CHECK(opensAsEmpty(bytes));
+
+    bytes = good;
+    setField<uint64_t>(bytes , MotionOffsetField , motionOffset + 64 * 1024);
+    CHECK(opensAsEmpty(bytes));
+
+    //! A text file is not a binary one
+    CHECK(opensAsEmpty(text));
+    CHECK(BvhDocument::fromBinaryFile(Testing::temporaryPath("missing.bvhb")).isEmpty());
+
+    std::remove(textPath.c_str());
+    std::remove(binaryPath.c_str());
+}
+
+int main()
+{
+    testTextBinaryText();
+    testEditedDocument();
+    testSharedSkeleton();
+    testDamagedFiles();
+    return Testing::result("binaryformat");
+}
@@ -0,0 +1,7 @@
+include(../tests.pri)
+
+CONFIG += testcase
+TARGET = floatscanner
+
+SOURCES += \
+    tst_floatscanner.cpp
@@ -0,0 +1,136 @@
+﻿#include "floatscanner.h"
+#include "testing.h"
+#include <clocale>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace BVH;
+
+static bool sameBits(float a , float b)
+{
+    return std::memcmp(&a , &b , sizeof(float)) == 0;
+}
+
+static bool scanToken(const std::string& token , float& value , bool exact)
+{
+    const char* p = token.data();
+    return scanFloat(p , token.data() + token.size() , value , exact) && p == token.data() + token.size();
+}
+
+//!
+//! \brief tokens Values as they appear in bvh files , and ones which need the slow path.
+//!
+static std::vector<std::string> tokens()
+{
+    std::vector<std::string> result = {
+        "0" , "-0" , "+1" , "0.000000" , "-0.000001" , "123.456789" , "1e10" , "1E-10" , "-3.4028235e38" ,
+        "1.17549435e-38" , "1.4e-45" , "1e-50" , "1e50" , "12345678901234567890123" , "0.1000000000000000000001" ,
+        "0.50000002980232238769531250" , "16777217" , "33554433.0" , "7.038531e-26" , "inf" , "-infinity" , "nan"
+    };
+
+    std::mt19937 random(7);
+    std::uniform_real_distribution<double> angle(-360.0 , 360.0);
+    std::uniform_int_distribution<int> digits(0 , 12);
+    char text[64];
+    for (int i = 0; i < 20000; ++i)
+    {
+        std::snprintf(text , sizeof(text) , "%.*f" , digits(random) , angle(random));
+        result.push_back(text);
+        std::snprintf(text , sizeof(text) , "%.9g" , angle(random) * std::pow(10.0 , digits(random) - 6));
+        result.push_back(text);
+    }
+    return result;
+}
+
+static void testExactMatchesStrtof(const std::vector<std::string>& values)
+{
+    for (const std::string& token : values)
+    {
+        float scanned = 0.0f;
+        const float expected = std::strtof(token.c_str() , nullptr);
+        const bool parsed = scanToken(token , scanned , true);
+        CHECK(parsed);
+        if (std::isnan(expected))
+            CHECK(std::isnan(scanned));
+        else if (!CHECK(sameBits(scanned , expected)))
+            std::fprintf(stderr , "    token %s\n" , token.c_str());
+    }
+}
+
+static void testFastIsClose(const std::vector<std::string>& values)
+{
+    for (const std::string& token : values)
+    {
+        float scanned = 0.0f;
+        const float expected = std::strtof(token.c_str() , nullptr);
+        CHECK(scanToken(token , scanned , false));
+        if (std::isfinite(expected))
+            CHECK(scanned == expected || std::fabs(scanned - expected) <= std::fabs(std::nextafter(expected , 0.0f) - expected));
+    }
+}
+
+static void testRows()
+{
+    const std::string row = " 1.5\t-2 3e2 \r\n4 x 5";
+    const char* p = row.data();
+    float values[8] = {};
+    CHECK(scanFloatRow(p , row.data() + row.size() , values , 8 , true) == 4);
+    CHECK(values[0] == 1.5f && values[1] == -2.0f && values[2] == 300.0f && values[3] == 4.0f);
+    CHECK(*p == 'x');
+
+    const std::string bad = "1.5.5 2";
+    p = bad.data();
+    CHECK(scanFloatRow(p , bad.data() + bad.size() , values , 2 , true) == 0);
+    CHECK(p == bad.data());
+}
+
+//!
+//! \brief testLocale The results do not change under a locale whose decimal point is ','.
+//! \remarks Skipped when no such locale is installed.
+//!
+static void testLocale(const std::vector<std::string>& values)
+{
+    std::vector<float> expected(values.size());
+    for (size_t i = 0; i < values.size(); ++i)
+        scanToken(values[i] , expected[i] , true);
+
+    const char* names[] = { "de_DE.UTF-8" , "de_DE.utf8" , "de_DE" , "fr_FR.UTF-8" , "fr_FR" , "German" , "French" };
+    const char* found = nullptr;
+    for (const char* name : names)
+    {
+        if (std::setlocale(LC_ALL , name) && std::strcmp(std::localeconv()->decimal_point , ",") == 0)
+        {
+            found = name;
+            break;
+        }
+    }
+    if (!found)
+    {
+        std::setlocale(LC_ALL , "C");
+        std::printf("no locale with a ',' decimal point , the locale test is skipped\n");
+        return;
+    }
+
+    for (size_t i = 0; i < values.size(); ++i)
+    {
+        float scanned = 0.0f;
+        CHECK(scanToken(values[i] , scanned , true));
+        CHECK(sameBits(scanned , expected[i]) || (std::isnan(scanned) && std::isnan(expected[i])));
+    }
+    std::setlocale(LC_ALL , "C");
+}
+
+int main()
+{
+    const std::vector<std::string> values = tokens();
+    testExactMatchesStrtof(values);
+    testFastIsClose(values);
+    testRows();
+    testLocale(values);
+    return Testing::result("floatscanner");
+}
@@ -0,0 +1,107 @@
+﻿#include "floatscanner.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace BVH;
+
+//!
+//! Compares scanFloatRow() with the stringstream extraction the parser used before:
+//!     floatscannerbenchmark [rows] [channels]
+//! Every mode parses the same MOTION rows , the exact mode must give the values of the streams.
+//!
+
+static std::string motionText(size_t rows , size_t channels)
+{
+    std::mt19937 random(1);
+    std::uniform_real_distribution<double> angle(-180.0 , 180.0);
+    std::string text;
+    text.reserve(rows * channels * 11);
+    char value[32];
+    for (size_t row = 0; row < rows; ++row)
+    {
+        for (size_t channel = 0; channel < channels; ++channel)
+        {
+            std::snprintf(value , sizeof(value) , channel == 0 ? "%.6f" : " %.6f" , angle(random));
+            text += value;
+        }
+        text += '\n';
+    }
+    return text;
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static size_t parseWithStreams(const std::string& text , size_t channels , std::vector<float>& values)
+{
+    std::istringstream in(text);
+    std::string line;
+    size_t count = 0;
+    while (std::getline(in , line))
+    {
+        std::stringstream ss(line);
+        for (size_t channel = 0; channel < channels && ss >> values[count]; ++channel)
+            ++count;
+    }
+    return count;
+}
+
+static size_t parseWithScanner(const std::string& text , size_t channels , std::vector<float>& values , bool exact)
+{
+    const char* p = text.data();
+    const char* end = p + text.size();
+    size_t count = 0;
+    while (p < end)
+    {
+        count += scanFloatRow(p , end , &values[count] , channels , exact);
+        while (p < end && isFloatSeparator(*p))
+            ++p;
+    }
+    return count;
+}
+
+int main(int argc , char* argv[])
+{
+    const size_t rows = argc > 1 ? std::strtoul(argv[1] , nullptr , 10) : 20000;
+    const size_t channels = argc > 2 ? std::strtoul(argv[2] , nullptr , 10) : 69;
+    const std::string text = motionText(rows , channels);
+    const double megabytes = text.size() / (1024.0 * 1024.0);
+    std::printf("%zu rows of %zu channels , %.2f MB\n" , rows , channels , megabytes);
+
+    std::vector<float> streamValues(rows * channels);
+    std::vector<float> fastValues(rows * channels);
+    std::vector<float> exactValues(rows * channels);
+
+    auto start = std::chrono::steady_clock::now();
+    const size_t streamCount = parseWithStreams(text , channels , streamValues);
+    const double streamSeconds = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    const size_t fastCount = parseWithScanner(text , channels , fastValues , false);
+    const double fastSeconds = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    const size_t exactCount = parseWithScanner(text , channels , exactValues , true);
+    const double exactSeconds = secondsSince(start);
+
+    std::printf("stringstream   %8.3f s %8.1f MB/s\n" , streamSeconds , megabytes / streamSeconds);
+    std::printf("scanner fast   %8.3f s %8.1f MB/s %6.1fx\n" , fastSeconds , megabytes / fastSeconds , streamSeconds / fastSeconds);
+    std::printf("scanner exact  %8.3f s %8.1f MB/s %6.1fx\n" , exactSeconds , megabytes / exactSeconds , streamSeconds / exactSeconds);
+
+    const bool same = streamCount == rows * channels && fastCount == streamCount && exactCount == streamCount &&
+                      std::memcmp(streamValues.data() , exactValues.data() , streamCount * sizeof(float)) == 0;
+    if (!same)
+    {
+        std::printf("the exact scanner does not give the values of the streams\n");
+        return 1;
+    }
+    return 0;
+}
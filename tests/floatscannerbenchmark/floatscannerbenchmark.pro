@@ -0,0 +1,6 @@
+include(../tests.pri)
+
+TARGET = floatscannerbenchmark
+
+SOURCES += \
+    floatscannerbenchmark.cpp
@@ -0,0 +1,10 @@
+include(../tests.pri)
+
+CONFIG += testcase
+TARGET = forwardkinematics
+
+HEADERS += \
+    ../sampledocument.h
+
+SOURCES += \
+    tst_forwardkinematics.cpp
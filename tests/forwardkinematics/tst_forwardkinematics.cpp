@@ -0,0 +1,250 @@
+﻿#include "forwardkinematics.h"
+#include "sampledocument.h"
+#include "testing.h"
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace BVH;
+
+//!
+//! \brief The Reference class Scalar forward kinematics in double , straight from the Joint tree.
+//!
+class Reference {
+public:
+    explicit Reference(const BvhDocument& document)
+    {
+        const Joint* root = document.rootJoint();
+        for (const Joint* joint = root; joint; joint = Joint::nextPreOrder(joint , root))
+        {
+            m_indices[joint] = m_joints.size();
+            m_joints.push_back(joint);
+        }
+    }
+
+    const std::vector<const Joint*>& joints() const { return m_joints; }
+
+    //!
+    //! \brief transforms The row major 3x4 world transform of every joint in \a frame.
+    //!
+    std::vector<double> transforms(size_t frame) const
+    {
+        std::vector<double> result(m_joints.size() * 12 , 0.0);
+        for (size_t j = 0; j < m_joints.size(); ++j)
+        {
+            const Joint* joint = m_joints[j];
+            double translation[3] = { joint->x() , joint->y() , joint->z() };
+            double rotation[9] = { 1 , 0 , 0 , 0 , 1 , 0 , 0 , 0 , 1 };
+            if (!joint->isEndSite())
+            {
+                const ConstFrameDataView values = joint->frameData();
+                const float* channels = values.frame(frame);
+                if (joint->channelCount() == 6)
+                {
+                    for (int k = 0; k < 3; ++k)
+                        translation[k] += channels[k];
+                    channels += 3;
+                }
+                localRotation(joint->rotationAxisOrder() , channels , rotation);
+            }
+
+            double* out = &result[j * 12];
+            if (!joint->parent())
+            {
+                for (int i = 0; i < 3; ++i)
+                {
+                    for (int k = 0; k < 3; ++k)
+                        out[i * 4 + k] = rotation[i * 3 + k];
+                    out[i * 4 + 3] = translation[i];
+                }
+                continue;
+            }
+
+            const double* parent = &result[m_indices.at(joint->parent()) * 12];
+            for (int i = 0; i < 3; ++i)
+            {
+                for (int k = 0; k < 3; ++k)
+                {
+                    out[i * 4 + k] = parent[i * 4] * rotation[k] + parent[i * 4 + 1] * rotation[3 + k] + parent[i * 4 + 2] * rotation[6 + k];
+                }
+                out[i * 4 + 3] = parent[i * 4] * translation[0] + parent[i * 4 + 1] * translation[1] +
+                                 parent[i * 4 + 2] * translation[2] + parent[i * 4 + 3];
+            }
+        }
+        return result;
+    }
+
+private:
+    static void axisRotation(int axis , double degrees , double* matrix)
+    {
+        const double radians = degrees * 3.14159265358979323846 / 180.0;
+        const double c = std::cos(radians);
+        const double s = std::sin(radians);
+        const double x[9] = { 1 , 0 , 0 , 0 , c , -s , 0 , s , c };
+        const double y[9] = { c , 0 , s , 0 , 1 , 0 , -s , 0 , c };
+        const double z[9] = { c , -s , 0 , s , c , 0 , 0 , 0 , 1 };
+        const double* source = axis == 0 ? x : axis == 1 ? y : z;
+        for (int e = 0; e < 9; ++e)
+            matrix[e] = source[e];
+    }
+
+    //!
+    //! \brief localRotation R(first axis) * R(second axis) * R(third axis) , \a angles are x , y , z.
+    //!
+    static void localRotation(AxisOrder order , const float* angles , double* rotation)
+    {
+        int axes[3] = { 0 , 1 , 2 };
+        switch (order)
+        {
+        case XZY: axes[1] = 2; axes[2] = 1; break;
+        case YXZ: axes[0] = 1; axes[1] = 0; break;
+        case YZX: axes[0] = 1; axes[1] = 2; axes[2] = 0; break;
+        case ZXY: axes[0] = 2; axes[1] = 0; axes[2] = 1; break;
+        case ZYX: axes[0] = 2; axes[2] = 0; break;
+        default: break;
+        }
+
+        double product[9] = { 1 , 0 , 0 , 0 , 1 , 0 , 0 , 0 , 1 };
+        for (int axis : axes)
+        {
+            double matrix[9];
+            double next[9];
+            axisRotation(axis , angles[axis] , matrix);
+            for (int i = 0; i < 3; ++i)
+            {
+                for (int k = 0; k < 3; ++k)
+                    next[i * 3 + k] = product[i * 3] * matrix[k] + product[i * 3 + 1] * matrix[3 + k] + product[i * 3 + 2] * matrix[6 + k];
+            }
+            for (int e = 0; e < 9; ++e)
+                product[e] = next[e];
+        }
+        for (int e = 0; e < 9; ++e)
+            rotation[e] = product[e];
+    }
+
+    std::vector<const Joint*> m_joints;
+    std::map<const Joint*, size_t> m_indices;
+};
+
+static bool close(double value , double expected , double tolerance)
+{
+    return std::fabs(value - expected) <= tolerance * (1.0 + std::fabs(expected));
+}
+
+//!
+//! \brief checkFrames Compare the positions and transforms of frames [first , last) with the reference.
+//!
+static void checkFrames(const BvhDocument& document , const ForwardKinematics& fk , size_t first , size_t last ,
+                        const std::vector<float>& positions , const std::vector<float>& transforms)
+{
+    const Reference reference(document);
+    const size_t jointCount = fk.jointCount();
+    CHECK(reference.joints().size() == jointCount);
+
+    size_t mismatches = 0;
+    for (size_t frame = first; frame < last; ++frame)
+    {
+        const std::vector<double> expected = reference.transforms(frame);
+        const size_t index = frame - first;
+        for (size_t j = 0; j < jointCount; ++j)
+        {
+            const double* world = &expected[j * 12];
+            const float* position = &positions[(index * jointCount + j) * 3];
+            const float* transform = &transforms[(index * jointCount + j) * ForwardKinematics::TransformSize];
+            bool same = true;
+            for (int i = 0; i < 3; ++i)
+            {
+                same = same && close(position[i] , world[i * 4 + 3] , 1e-5);
+                for (int k = 0; k < 4; ++k)
+                    same = same && close(transform[i * 4 + k] , world[i * 4 + k] , 1e-5);
+            }
+            same = same && transform[12] == 0.0f && transform[13] == 0.0f && transform[14] == 0.0f && transform[15] == 1.0f;
+            if (!same && mismatches++ == 0)
+                std::fprintf(stderr , "    frame %zu joint %s differs\n" , frame , reference.joints()[j]->jointName().c_str());
+        }
+    }
+    CHECK(mismatches == 0);
+}
+
+static void testFrameCounts()
+{
+    const std::string path = Testing::temporaryPath("fk.bvh");
+    for (size_t frameCount : { 1 , 5 , 8 , 9 , 13 , 67 , 200 })
+    {
+        CHECK(Testing::writeText(path , Testing::sampleBvhText(frameCount , static_cast<unsigned>(frameCount))));
+        const BvhDocument document = BvhDocument::fromFile(path);
+        CHECK(document.frameCount() == frameCount);
+
+        const ForwardKinematics fk(document);
+        const size_t jointCount = fk.jointCount();
+        for (size_t first : { size_t(0) , size_t(3) })
+        {
+            if (first >= frameCount)
+                continue;
+            std::vector<float> positions((frameCount - first) * jointCount * 3);
+            std::vector<float> transforms((frameCount - first) * jointCount * ForwardKinematics::TransformSize);
+            fk.computePositions(document , first , frameCount , positions.data());
+            fk.computeTransforms(document , first , frameCount , transforms.data());
+            checkFrames(document , fk , first , frameCount , positions , transforms);
+        }
+
+        //! The whole clip in parallel ranges gives the same values
+        std::vector<float> positions(frameCount * jointCount * 3);
+        std::vector<float> transforms(frameCount * jointCount * ForwardKinematics::TransformSize);
+        CHECK(fk.computeClipPositions(document , positions.data() , 3).frameCount == frameCount);
+        CHECK(fk.computeClipTransforms(document , transforms.data() , 3).frameCount == frameCount);
+        checkFrames(document , fk , 0 , frameCount , positions , transforms);
+    }
+    std::remove(path.c_str());
+}
+
+//!
+//! \brief testEditedJoints A joint gains position channels without packMotion() , the store is stale.
+//!
+static void testEditedJoints()
+{
+    const std::string path = Testing::temporaryPath("fk_edited.bvh");
+    const size_t frameCount = 21;
+    CHECK(Testing::writeText(path , Testing::sampleBvhText(frameCount)));
+    BvhDocument document = BvhDocument::fromFile(path);
+    const ForwardKinematics before(document);
+
+    Joint* leftArm = document.rootJoint()->childAt(0)->childAt(1);
+    CHECK(leftArm->jointName() == "LeftArm");
+    leftArm->setPositionAxisOrder(XYZ);
+    std::mt19937 random(3);
+    std::uniform_real_distribution<float> value(-90.0f , 90.0f);
+    std::vector<float> values(frameCount * 6);
+    for (float& v : values)
+        v = value(random);
+    leftArm->setFrameData(values);
+
+    const ForwardKinematics fk(document);
+    CHECK(fk.channelCount() == before.channelCount() + 3);
+    std::vector<float> positions(frameCount * fk.jointCount() * 3);
+    std::vector<float> transforms(frameCount * fk.jointCount() * ForwardKinematics::TransformSize);
+    fk.computePositions(document , 0 , frameCount , positions.data());
+    CHECK(fk.computeClipTransforms(document , transforms.data()).frameCount == frameCount);
+    checkFrames(document , fk , 0 , frameCount , positions , transforms);
+
+    //! The compiled skeleton no longer fits the document , nothing is computed
+    std::vector<float> untouched(frameCount * before.jointCount() * 3 , 42.0f);
+    before.computePositions(document , 0 , frameCount , untouched.data());
+    CHECK(before.computeClipPositions(document , untouched.data()).frameCount == 0);
+    bool unchanged = true;
+    for (float v : untouched)
+        unchanged = unchanged && v == 42.0f;
+    CHECK(unchanged);
+
+    std::remove(path.c_str());
+}
+
+int main()
+{
+    testFrameCounts();
+    testEditedJoints();
+    return Testing::result("forwardkinematics");
+}
@@ -0,0 +1,10 @@
+include(../tests.pri)
+
+CONFIG += testcase
+TARGET = frameindex
+
+HEADERS += \
+    ../sampledocument.h
+
+SOURCES += \
+    tst_frameindex.cpp
@@ -0,0 +1,87 @@
+﻿#include "bvh.h"
+#include "bvhframeindex.h"
+#include "motiondata.h"
+#include "sampledocument.h"
+#include "testing.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+using namespace BVH;
+
+//!
+//! \brief sameFrames Whether \a part holds the frames [first , first + part.frameCount()) of \a whole , bit for bit.
+//!
+static bool sameFrames(const BvhDocument& part , const BvhDocument& whole , size_t first)
+{
+    if (part.channelCount() != whole.channelCount() || first + part.frameCount() > whole.frameCount())
+        return false;
+    for (size_t frame = 0; frame < part.frameCount(); ++frame)
+    {
+        if (std::memcmp(part.pose(frame).data() , whole.pose(first + frame).data() , part.channelCount() * sizeof(float)) != 0)
+            return false;
+    }
+    return true;
+}
+
+static void testRanges()
+{
+    const std::string path = Testing::temporaryPath("index.bvh");
+    CHECK(Testing::writeText(path , Testing::sampleBvhText(1000)));
+    const BvhDocument whole = BvhDocument::fromFile(path);
+
+    BvhFrameIndex index;
+    CHECK(index.open(path , 64));
+    CHECK(index.frameCount() == 1000 && index.offsets().size() == 16);
+
+    for (size_t first : { size_t(0) , size_t(63) , size_t(64) , size_t(500) , size_t(999) })
+    {
+        const BvhDocument part = index.load(first , first + 130);
+        CHECK(part.frameCount() == std::min<size_t>(130 , 1000 - first));
+        CHECK(sameFrames(part , whole , first));
+    }
+    CHECK(index.load(1200 , 1300).frameCount() == 0);
+
+    //! Frame Time 0.008333 , a second is a little more than 120 frames
+    const BvhDocument seconds = index.loadTime(1.0 , 2.0);
+    CHECK(index.frameAt(1.0) == 120 && seconds.frameCount() == 121);
+    CHECK(sameFrames(seconds , whole , 120));
+
+    std::remove(path.c_str());
+}
+
+//!
+//! \brief testMalformedLine A line with too few numbers ends the frames once load() reaches it.
+//!
+static void testMalformedLine()
+{
+    const std::string path = Testing::temporaryPath("malformed.bvh");
+    std::string text = Testing::sampleBvhText(1000);
+    size_t line = text.find("Frame Time");
+    for (int i = 0; i <= 600; ++i)
+        line = text.find('\n' , line) + 1;
+    text.insert(line , "1.0 2.0 3.0\n");
+    CHECK(Testing::writeText(path , text));
+    const BvhDocument whole = BvhDocument::fromFile(path);
+    CHECK(whole.frameCount() == 600);
+
+    BvhFrameIndex index;
+    CHECK(index.open(path , 64));
+    CHECK(index.frameCount() == 1001);
+
+    const BvhDocument before = index.load(500 , 700);
+    CHECK(before.frameCount() == 100 && sameFrames(before , whole , 500));
+    CHECK(index.frameCount() == 600);
+    CHECK(index.load(0 , 1001).frameCount() == 600);
+    CHECK(index.load(650 , 700).frameCount() == 0);
+
+    std::remove(path.c_str());
+}
+
+int main()
+{
+    testRanges();
+    testMalformedLine();
+    return Testing::result("frameindex");
+}
@@ -0,0 +1,111 @@
+﻿#ifndef SAMPLEDOCUMENT_H
+#define SAMPLEDOCUMENT_H
+
+#include <cstdio>
+#include <random>
+#include <string>
+
+namespace Testing {
+
+//!
+//! \brief sampleBvhText A bvh file with \a frameCount frames of random values.
+//! \remarks Every rotation order is used once , the root and two inner joints have position
+//!          channels in different orders , and three chains end in End Sites. The values are
+//!          written with six decimals , as exporters do.
+//!
+inline std::string sampleBvhText(size_t frameCount , unsigned seed = 1)
+{
+    std::string text =
+        "HIERARCHY\n"
+        "ROOT Hips\n"
+        "{\n"
+        "\tOFFSET -0.000000 0.000000 0.000000\n"
+        "\tCHANNELS 6 Xposition Yposition Zposition Zrotation Xrotation Yrotation\n"
+        "\tJOINT Spine\n"
+        "\t{\n"
+        "\t\tOFFSET 0.125000 10.500000 -0.000001\n"
+        "\t\tCHANNELS 3 Xrotation Yrotation Zrotation\n"
+        "\t\tJOINT Neck\n"
+        "\t\t{\n"
+        "\t\t\tOFFSET 0.000000 20.250000 1.333333\n"
+        "\t\t\tCHANNELS 3 Xrotation Zrotation Yrotation\n"
+        "\t\t\tJOINT Head\n"
+        "\t\t\t{\n"
+        "\t\t\t\tOFFSET -1.000000 8.000000 0.500000\n"
+        "\t\t\t\tCHANNELS 6 Zposition Yposition Xposition Yrotation Xrotation Zrotation\n"
+        "\t\t\t\tEnd Site\n"
+        "\t\t\t\t{\n"
+        "\t\t\t\t\tOFFSET 0.000000 5.000000 0.000000\n"
+        "\t\t\t\t}\n"
+        "\t\t\t}\n"
+        "\t\t}\n"
+        "\t\tJOINT LeftArm\n"
+        "\t\t{\n"
+        "\t\t\tOFFSET 6.000000 18.000000 -0.750000\n"
+        "\t\t\tCHANNELS 3 Yrotation Zrotation Xrotation\n"
+        "\t\t\tEnd Site\n"
+        "\t\t\t{\n"
+        "\t\t\t\tOFFSET 12.000000 0.000000 0.000000\n"
+        "\t\t\t}\n"
+        "\t\t}\n"
+        "\t}\n"
+        "\tJOINT LeftLeg\n"
+        "\t{\n"
+        "\t\tOFFSET 4.000000 -2.000000 0.000000\n"
+        "\t\tCHANNELS 3 Zrotation Yrotation Xrotation\n"
+        "\t\tJOINT LeftFoot\n"
+        "\t\t{\n"
+        "\t\t\tOFFSET 0.000000 -18.000000 0.300000\n"
+        "\t\t\tCHANNELS 6 Yposition Xposition Zposition Xrotation Yrotation Zrotation\n"
+        "\t\t\tEnd Site\n"
+        "\t\t\t{\n"
+        "\t\t\t\tOFFSET 0.000000 -3.000000 4.000000\n"
+        "\t\t\t}\n"
+        "\t\t}\n"
+        "\t}\n"
+        "}\n"
+        "MOTION\n";
+
+    //! The channels of each joint in file order: root , Spine , Neck , Head , LeftArm , LeftLeg , LeftFoot
+    static const int jointChannels[] = { 6 , 3 , 3 , 6 , 3 , 3 , 6 };
+
+    char line[64];
+    std::snprintf(line , sizeof(line) , "Frames: %zu\nFrame Time: 0.008333\n" , frameCount);
+    text += line;
+
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<double> angle(-180.0 , 180.0);
+    std::uniform_real_distribution<double> position(-50.0 , 50.0);
+    for (size_t frame = 0; frame < frameCount; ++frame)
+    {
+        bool first = true;
+        for (int channels : jointChannels)
+        {
+            for (int channel = 0; channel < channels; ++channel)
+            {
+                const bool isPosition = channels == 6 && channel < 3;
+                std::snprintf(line , sizeof(line) , first ? "%.6f" : " %.6f" , isPosition ? position(random) : angle(random));
+                text += line;
+                first = false;
+            }
+        }
+        text += '\n';
+    }
+    return text;
+}
+
+//!
+//! \brief writeText Write \a text to \a path.
+//!
+inline bool writeText(const std::string& path , const std::string& text)
+{
+    std::FILE* file = std::fopen(path.c_str() , "wb");
+    if (!file)
+        return false;
+    const bool ok = std::fwrite(text.data() , 1 , text.size() , file) == text.size();
+    return std::fclose(file) == 0 && ok;
+}
+
+}
+
+#endif // SAMPLEDOCUMENT_H
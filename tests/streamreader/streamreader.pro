@@ -0,0 +1,10 @@
+include(../tests.pri)
+
+CONFIG += testcase
+TARGET = streamreader
+
+HEADERS += \
+    ../sampledocument.h
+
+SOURCES += \
+    tst_streamreader.cpp
@@ -0,0 +1,90 @@
+﻿#include "bvh.h"
+#include "bvhstreamreader.h"
+#include "motiondata.h"
+#include "sampledocument.h"
+#include "testing.h"
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace BVH;
+
+//!
+//! \brief streamsLikeDocument Whether the reader returns the frames of BvhDocument::fromFile() , bit for bit.
+//!
+static bool streamsLikeDocument(const std::string& path)
+{
+    const BvhDocument doc = BvhDocument::fromFile(path);
+    BvhStreamReader reader;
+    if (doc.isEmpty() || !reader.open(path) || reader.channelCount() != doc.channelCount())
+        return false;
+
+    const size_t channelCount = reader.channelCount();
+    std::vector<float> frames(7 * channelCount);
+    size_t frame = 0;
+    for (size_t count; (count = reader.readFrames(frames.data() , 7)) != 0; frame += count)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (frame + i >= doc.frameCount() ||
+                std::memcmp(frames.data() + i * channelCount , doc.pose(frame + i).data() , channelCount * sizeof(float)) != 0)
+                return false;
+        }
+    }
+    return reader.atEnd() && frame == doc.frameCount() && reader.framesRead() == frame;
+}
+
+static void testFrames()
+{
+    const std::string path = Testing::temporaryPath("stream.bvh");
+    const std::string text = Testing::sampleBvhText(300);
+    CHECK(Testing::writeText(path , text));
+    CHECK(streamsLikeDocument(path));
+
+    //! The last frame line without a newline
+    CHECK(Testing::writeText(path , text.substr(0 , text.size() - 1)));
+    CHECK(streamsLikeDocument(path));
+
+    //! A line with too few numbers ends the frames
+    const size_t cut = text.rfind('\n' , text.size() - 2);
+    CHECK(Testing::writeText(path , text.substr(0 , cut + 20) + "\n" + text.substr(cut + 1)));
+    CHECK(streamsLikeDocument(path));
+    CHECK(BvhDocument::fromFile(path).frameCount() == 299);
+
+    std::remove(path.c_str());
+}
+
+//!
+//! \brief testNoFrames A file may end right after the "Frame Time" line , with or without a newline.
+//!
+static void testNoFrames()
+{
+    const std::string path = Testing::temporaryPath("empty_motion.bvh");
+    const std::string text = Testing::sampleBvhText(0);
+    for (const std::string& file : { text , text.substr(0 , text.size() - 1) })
+    {
+        CHECK(Testing::writeText(path , file));
+        CHECK(!BvhDocument::fromFile(path).isEmpty());
+
+        BvhStreamReader reader;
+        CHECK(reader.open(path));
+        CHECK(reader.declaredFrameCount() == 0 && reader.channelCount() == 30);
+        std::vector<float> frame(reader.channelCount());
+        CHECK(!reader.readFrame(frame.data()) && reader.atEnd() && reader.framesRead() == 0);
+    }
+
+    //! Without the "Frame Time" line the header is incomplete
+    CHECK(Testing::writeText(path , text.substr(0 , text.find("Frame Time"))));
+    BvhStreamReader reader;
+    CHECK(!reader.open(path));
+
+    std::remove(path.c_str());
+}
+
+int main()
+{
+    testFrames();
+    testNoFrames();
+    return Testing::result("streamreader");
+}
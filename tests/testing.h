@@ -0,0 +1,55 @@
+﻿#ifndef TESTING_H
+#define TESTING_H
+
+#include <cstdio>
+#include <string>
+
+//!
+//! \brief Checks for the test programs , a failed check is printed and makes main() return 1.
+//! \remarks The tests are plain programs , qmake's testcase config runs them with "make check".
+//!
+namespace Testing {
+
+inline int& failureCount()
+{
+    static int count = 0;
+    return count;
+}
+
+inline bool check(bool condition , const char* text , const char* file , int line)
+{
+    if (!condition)
+    {
+        std::fprintf(stderr , "%s:%d: check failed: %s\n" , file , line , text);
+        ++failureCount();
+    }
+    return condition;
+}
+
+//!
+//! \brief result Print a summary , the exit code of main().
+//!
+inline int result(const char* name)
+{
+    if (failureCount() == 0)
+    {
+        std::printf("%s: passed\n" , name);
+        return 0;
+    }
+    std::printf("%s: %d checks failed\n" , name , failureCount());
+    return 1;
+}
+
+//!
+//! \brief temporaryPath A file name for the test to write , in the working directory.
+//!
+inline std::string temporaryPath(const std::string& name)
+{
+    return "./test_" + name;
+}
+
+}
+
+#define CHECK(condition) Testing::check((condition) , #condition , __FILE__ , __LINE__)
+
+#endif // TESTING_H
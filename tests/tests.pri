@@ -0,0 +1,39 @@
+# Settings shared by the test programs , every program builds the library sources itself
+
+# Don't use Qt library
+QT -= core
+QT -= gui
+
+TEMPLATE = app
+CONFIG += c++11 console thread
+CONFIG -= app_bundle
+unix: LIBS += -pthread
+
+INCLUDEPATH += $$PWD/.. $$PWD
+
+HEADERS += \
+    $$PWD/testing.h
+
+SOURCES += \
+    $$PWD/../archive.cpp \
+    $$PWD/../bvh.cpp \
+    $$PWD/../bvhbinary.cpp \
+    $$PWD/../bvhframeindex.cpp \
+    $$PWD/../bvhstreamreader.cpp \
+    $$PWD/../channellayout.cpp \
+    $$PWD/../floatscanner.cpp \
+    $$PWD/../forwardkinematics.cpp \
+    $$PWD/../jointrecords.cpp \
+    $$PWD/../keyframes.cpp \
+    $$PWD/../mappedfile.cpp \
+    $$PWD/../motiondata.cpp \
+    $$PWD/../parsecache.cpp \
+    $$PWD/../prune.cpp \
+    $$PWD/../quantize.cpp \
+    $$PWD/../resample.cpp \
+    $$PWD/../retarget.cpp \
+    $$PWD/../rotationkernels.cpp \
+    $$PWD/../skeleton.cpp \
+    $$PWD/../skeletonregistry.cpp \
+    $$PWD/../textwriter.cpp \
+    $$PWD/../threadpool.cpp
@@ -0,0 +1,11 @@
+# Tests and benchmarks of the library , "make check" builds and runs the tests
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    archive \
+    binaryformat \
+    floatscanner \
+    floatscannerbenchmark \
+    forwardkinematics \
+    frameindex \
+    streamreader
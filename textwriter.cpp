@@ -0,0 +1,136 @@
+﻿#include "textwriter.h"
+#include <cstdint>
+#include <cstring>
+
+using namespace BVH;
+
+static const uint64_t powersOfTen64[11] = {
+    1ull , 10ull , 100ull , 1000ull , 10000ull , 100000ull , 1000000ull , 10000000ull ,
+    100000000ull , 1000000000ull , 10000000000ull
+};
+
+static size_t formatFixedSlow(float value , int precision , char* out)
+{
+    char buffer[FixedFloatMaxLength * 8];
+    int n = std::snprintf(buffer , sizeof(buffer) , "%.*f" , precision , static_cast<double>(value));
+    if (n < 0)
+        return 0;
+    size_t size = static_cast<size_t>(n) < FixedFloatMaxLength ? static_cast<size_t>(n) : FixedFloatMaxLength;
+    std::memcpy(out , buffer , size);
+    return size;
+}
+
+size_t BVH::formatFixed(float value , int precision , char *out)
+{
+    uint32_t bits;
+    std::memcpy(&bits , &value , sizeof(bits));
+    const bool negative = (bits >> 31) != 0;
+    const int exponentBits = static_cast<int>((bits >> 23) & 0xFF);
+    const uint64_t fraction = bits & 0x7FFFFF;
+
+    if (exponentBits == 0xFF || precision < 0 || precision > 10)
+        return formatFixedSlow(value , precision , out);
+
+    //! value = mantissa * 2^exponent
+    const uint64_t mantissa = exponentBits == 0 ? fraction : (fraction | 0x800000);
+    const int exponent = (exponentBits == 0 ? 1 : exponentBits) - 150;
+
+    //! scaled = round(|value| * 10^precision) , mantissa * 10^precision < 2^58
+    uint64_t scaled;
+    if (exponent >= 0)
+    {
+        if (exponent > 5)
+            return formatFixedSlow(value , precision , out);
+        scaled = (mantissa << exponent) * powersOfTen64[precision];
+    }
+    else
+    {
+        const uint64_t n = mantissa * powersOfTen64[precision];
+        const int shift = -exponent;
+        if (shift >= 64)
+        {
+            scaled = 0;
+        }
+        else
+        {
+            const uint64_t half = uint64_t(1) << (shift - 1);
+            const uint64_t remainder = n & ((half << 1) - 1);
+            scaled = n >> shift;
+            if (remainder > half || (remainder == half && (scaled & 1)))
+                ++scaled;
+        }
+    }
+
+    char* p = out;
+    if (negative)
+        *p++ = '-';
+
+    uint64_t integer = scaled / powersOfTen64[precision];
+    uint64_t decimals = scaled % powersOfTen64[precision];
+
+    char digits[24];
+    int count = 0;
+    do
+    {
+        digits[count++] = static_cast<char>('0' + integer % 10);
+        integer /= 10;
+    } while (integer);
+    while (count)
+        *p++ = digits[--count];
+
+    if (precision > 0)
+    {
+        *p++ = '.';
+        for (int i = precision - 1; i >= 0; --i)
+        {
+            p[i] = static_cast<char>('0' + decimals % 10);
+            decimals /= 10;
+        }
+        p += precision;
+    }
+    return static_cast<size_t>(p - out);
+}
+
+TextFileWriter::TextFileWriter()
+{
+
+}
+
+TextFileWriter::~TextFileWriter()
+{
+    close();
+}
+
+bool TextFileWriter::open(const std::string &filename)
+{
+    close();
+    m_file = std::fopen(filename.c_str() , "w");
+    if (!m_file)
+        return false;
+    std::setvbuf(m_file , nullptr , _IONBF , 0);
+    m_good = true;
+    m_buffer.reserve(BufferSize + (BufferSize >> 2));
+    return true;
+}
+
+bool TextFileWriter::close()
+{
+    if (!m_file)
+        return m_good;
+
+    flush();
+    if (std::fclose(m_file) != 0)
+        m_good = false;
+    m_file = nullptr;
+    m_buffer.clear();
+    return m_good;
+}
+
+void TextFileWriter::flush()
+{
+    if (!m_file || m_buffer.empty())
+        return;
+    if (std::fwrite(m_buffer.data() , 1 , m_buffer.size() , m_file) != m_buffer.size())
+        m_good = false;
+    m_buffer.clear();
+}
@@ -0,0 +1,88 @@
+﻿#ifndef TEXTWRITER_H
+#define TEXTWRITER_H
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+
+namespace BVH {
+
+//!
+//! \brief FixedFloatMaxLength The longest text formatFixed() writes for precision 0 - 10.
+//!
+const size_t FixedFloatMaxLength = 64;
+
+//!
+//! \brief formatFixed Format \a value exactly like printf("%.*f" , precision , value).
+//! \param out Receives at least FixedFloatMaxLength characters , no terminating null is written
+//! \return The number of characters written
+//! \remarks Finite values with 0 - 10 decimals are converted with integer arithmetic on the
+//!          exact binary value , ties round to even as glibc does. Anything else uses snprintf.
+//!
+size_t formatFixed(float value , int precision , char* out);
+
+//!
+//! \brief appendFixed Append formatFixed() text to \a text.
+//!
+inline void appendFixed(std::string& text , float value , int precision)
+{
+    char buffer[FixedFloatMaxLength];
+    text.append(buffer , formatFixed(value , precision , buffer));
+}
+
+//!
+//! \brief The TextFileWriter class Writes text to a file in large blocks.
+//! \remarks Text is collected in memory and handed to the C library once the buffer is full ,
+//!          so a long file is written with a few large writes instead of one per line.
+//!
+class TextFileWriter {
+public:
+    static const size_t BufferSize = 1 << 20;
+
+    TextFileWriter();
+    ~TextFileWriter();
+
+    //!
+    //! \brief open Create or truncate the file , it is opened in text mode like std::ofstream.
+    //!
+    bool open(const std::string& filename);
+
+    //!
+    //! \brief close Flush the buffer and close the file.
+    //! \return false if any write failed
+    //!
+    bool close();
+
+    bool good() const { return m_file != nullptr && m_good; }
+
+    //!
+    //! \brief buffer The pending text , callers may append to it directly and call flushIfFull().
+    //!
+    std::string& buffer() { return m_buffer; }
+
+    void write(const char* text , size_t size)
+    {
+        m_buffer.append(text , size);
+        flushIfFull();
+    }
+    void write(const std::string& text) { write(text.data() , text.size()); }
+
+    void flushIfFull()
+    {
+        if (m_buffer.size() >= BufferSize)
+            flush();
+    }
+    void flush();
+
+private:
+    TextFileWriter(const TextFileWriter& other) = delete;
+    TextFileWriter& operator = (const TextFileWriter& other) = delete;
+
+    std::FILE* m_file = nullptr;
+    bool m_good = true;
+    std::string m_buffer;
+};
+
+}
+
+#endif // TEXTWRITER_H
@@ -0,0 +1,218 @@
+﻿#include "threadpool.h"
+
+using namespace BVH;
+
+ThreadPool::ThreadPool(unsigned threadCount)
+{
+    if (threadCount == 0)
+        threadCount = hardwareThreads() - 1;
+
+    for (unsigned i = 0; i < threadCount; ++i)
+    {
+        m_workers.emplace_back(&ThreadPool::workerLoop , this);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for (auto& worker : m_workers)
+    {
+        worker.join();
+    }
+}
+
+void ThreadPool::parallelFor(size_t taskCount , const std::function<void(size_t)> &task , unsigned maxThreads)
+{
+    if (taskCount == 0)
+        return;
+
+    size_t helpers = m_workers.size();
+    if (maxThreads != 0 && helpers > maxThreads - 1)
+        helpers = maxThreads - 1;
+    if (helpers > taskCount - 1)
+        helpers = taskCount - 1;
+
+    if (helpers == 0)
+    {
+        for (size_t i = 0; i < taskCount; ++i)
+        {
+            task(i);
+        }
+        return;
+    }
+
+    auto loop = std::make_shared<Loop>();
+    loop->task = &task;
+    loop->count = taskCount;
+    loop->next = 0;
+    loop->finished = 0;
+    loop->failed = false;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (size_t i = 0; i < helpers; ++i)
+        {
+            m_queue.push_back(loop);
+        }
+    }
+    if (helpers == 1)
+        m_wake.notify_one();
+    else
+        m_wake.notify_all();
+
+    runLoop(*loop);
+
+    std::unique_lock<std::mutex> lock(loop->mutex);
+    loop->done.wait(lock , [&loop]() { return loop->finished == loop->count; });
+    if (loop->error)
+        std::rethrow_exception(loop->error);
+}
+
+void ThreadPool::parallelForRange(size_t count , size_t grain , const std::function<void (size_t , size_t , size_t)> &task ,
+                                  unsigned maxThreads)
+{
+    if (count == 0)
+        return;
+    if (grain == 0)
+        grain = 1;
+
+    size_t slots = concurrency(maxThreads);
+    if (slots > (count + grain - 1) / grain)
+        slots = (count + grain - 1) / grain;
+    if (slots <= 1)
+    {
+        for (size_t first = 0; first < count; first += grain)
+        {
+            task(first , first + grain < count ? first + grain : count , 0);
+        }
+        return;
+    }
+
+    struct Share {
+        std::mutex mutex;
+        size_t first = 0;
+        size_t last = 0;
+    };
+    std::unique_ptr<Share[]> shares(new Share[slots]);
+    for (size_t i = 0; i < slots; ++i)
+    {
+        shares[i].first = count * i / slots;
+        shares[i].last = count * (i + 1) / slots;
+    }
+
+    //! One task per slot , every thread runs the share of its slot and then steals
+    parallelFor(slots , [&](size_t slot) {
+        Share& own = shares[slot];
+        for (;;)
+        {
+            size_t first , last;
+            {
+                std::lock_guard<std::mutex> lock(own.mutex);
+                first = own.first;
+                last = own.last - own.first > grain ? own.first + grain : own.last;
+                own.first = last;
+            }
+            if (first < last)
+            {
+                task(first , last , slot);
+                continue;
+            }
+
+            //! Steal the back half of the largest share , the sizes are only a hint
+            size_t victim = slots;
+            size_t largest = 0;
+            for (size_t i = 0; i < slots; ++i)
+            {
+                std::lock_guard<std::mutex> lock(shares[i].mutex);
+                size_t size = shares[i].last - shares[i].first;
+                if (i != slot && size > largest)
+                {
+                    largest = size;
+                    victim = i;
+                }
+            }
+            if (victim == slots)
+                return;
+
+            //! Never hold two locks , the stolen range is moved in two steps
+            {
+                std::lock_guard<std::mutex> lock(shares[victim].mutex);
+                Share& other = shares[victim];
+                size_t size = other.last - other.first;
+                first = size <= grain ? other.first : other.first + size / 2;
+                last = other.last;
+                other.last = first;
+            }
+            std::lock_guard<std::mutex> lock(own.mutex);
+            own.first = first;
+            own.last = last;
+        }
+    } , static_cast<unsigned>(slots));
+}
+
+ThreadPool &ThreadPool::globalInstance()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+unsigned ThreadPool::hardwareThreads()
+{
+    unsigned n = std::thread::hardware_concurrency();
+    return n == 0 ? 1 : n;
+}
+
+void ThreadPool::runLoop(Loop &loop)
+{
+    size_t finished = 0;
+    for (;;)
+    {
+        size_t i = loop.next++;
+        if (i >= loop.count)
+            break;
+
+        //! A failed loop only counts the rest of its tasks , the caller rethrows the exception
+        if (!loop.failed.load(std::memory_order_relaxed))
+        {
+            try
+            {
+                (*loop.task)(i);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(loop.mutex);
+                if (!loop.error)
+                    loop.error = std::current_exception();
+                loop.failed.store(true , std::memory_order_relaxed);
+            }
+        }
+        ++finished;
+    }
+    if (finished != 0 && (loop.finished += finished) == loop.count)
+    {
+        std::lock_guard<std::mutex> lock(loop.mutex);
+        loop.done.notify_all();
+    }
+}
+
+void ThreadPool::workerLoop()
+{
+    for (;;)
+    {
+        std::shared_ptr<Loop> loop;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock , [this]() { return m_stop || !m_queue.empty(); });
+            if (m_queue.empty())
+                return;
+            loop = m_queue.front();
+            m_queue.pop_front();
+        }
+        runLoop(*loop);
+    }
+}
@@ -0,0 +1,111 @@
+﻿#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace BVH {
+
+//!
+//! \brief The ThreadPool class A fixed set of worker threads which execute parallel loops.
+//! \remarks The calling thread always takes part in its own loop, so parallelFor may be
+//!          nested or called from a worker without dead locking.
+//!
+class ThreadPool {
+public:
+
+    //!
+    //! \brief ThreadPool Start the worker threads.
+    //! \param threadCount The number of workers, 0 means one less than the hardware concurrency
+    //!
+    explicit ThreadPool(unsigned threadCount = 0);
+
+    //!
+    //! \brief ~ThreadPool Stop the workers after the running loops are finished.
+    ~ThreadPool();
+
+    //!
+    //! \brief workerCount The number of worker threads, the calling thread is not included.
+    //!
+    unsigned workerCount() const { return static_cast<unsigned>(m_workers.size()); }
+
+    //!
+    //! \brief parallelFor Call task(i) for every i in [0 , taskCount) and wait for all of them.
+    //! \param maxThreads The maximum number of threads working on the loop including the caller,
+    //!                   0 means no limit.
+    //! \remarks If a task throws , the tasks which have not started are skipped and the first
+    //!          exception is rethrown here once no thread works on the loop any more.
+    //!
+    void parallelFor(size_t taskCount , const std::function<void(size_t)>& task , unsigned maxThreads = 0);
+
+    //!
+    //! \brief parallelForRange Call task(first , last , slot) on sub ranges which cover [0 , count).
+    //! \param grain The size of the sub ranges , only the last one of a thread may be smaller
+    //! \param task Gets the index of the calling thread in [0 , concurrency(maxThreads)) as \a slot ,
+    //!        two calls with the same slot never run at the same time
+    //! \remarks Every thread starts with an equal share of the range and takes grains from its
+    //!          front. A thread which runs out steals the back half of the largest remaining share ,
+    //!          so threads which start late or hit expensive items are evened out.
+    //!
+    void parallelForRange(size_t count , size_t grain , const std::function<void(size_t , size_t , size_t)>& task ,
+                          unsigned maxThreads = 0);
+
+    //!
+    //! \brief concurrency The number of threads a loop may use including the caller.
+    //!
+    unsigned concurrency(unsigned maxThreads = 0) const
+    {
+        unsigned n = workerCount() + 1;
+        return maxThreads != 0 && maxThreads < n ? maxThreads : n;
+    }
+
+    //!
+    //! \brief globalInstance A process wide pool sized to the hardware.
+    //!
+    static ThreadPool& globalInstance();
+
+    //!
+    //! \brief hardwareThreads The number of hardware threads, at least 1.
+    //!
+    static unsigned hardwareThreads();
+
+private:
+    ThreadPool(const ThreadPool& other) = delete;
+    ThreadPool& operator = (const ThreadPool& other) = delete;
+
+    struct Loop {
+        const std::function<void(size_t)>* task = nullptr;
+        size_t count = 0;
+        std::atomic<size_t> next;
+        std::atomic<size_t> finished;
+        std::atomic<bool> failed;
+        std::exception_ptr error;           //!< The first exception of a task , guarded by mutex
+        std::mutex mutex;
+        std::condition_variable done;
+    };
+
+    static void runLoop(Loop& loop);
+    void workerLoop();
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+
+    //!
+    //! \brief m_queue One entry per worker which is invited to help with a loop
+    //!
+    std::deque<std::shared_ptr<Loop>> m_queue;
+    bool m_stop = false;
+};
+
+}
+
+#endif // THREADPOOL_H